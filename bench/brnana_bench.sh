@@ -0,0 +1,195 @@
+#!/bin/sh
+# Forwarding benchmark of brnana: namespaces connected through a bridge by
+# veth pairs, driven by pktgen.
+#
+#   brnana_bench.sh > results.csv
+#
+# For every port count, traffic mix and frame size, pktgen offers as many
+# frames as it can for $DURATION seconds and the script prints one CSV line:
+#
+#   version,kernel,ports,mix,size,offered_pps,forwarded_pps,drops,
+#   drop_rate,busy_ns_per_pkt,softirq_ns_per_pkt
+#
+# unicast: ports 1..N/2 each send to the port N/2 further (static FDB
+#          entries, so nothing is flooded)
+# flood:   port 1 sends broadcast, replicated to the N-1 other ports
+#
+# forwarded_pps counts the frames brnana transmitted on the receiving ports.
+# drop_rate is the share of expected frames (offered, times N-1 for flood)
+# that never made it out. The *_ns_per_pkt columns are the CPU time, all
+# busy time or softirq only, spent per forwarded frame; busy time includes
+# pktgen itself. Progress goes to stderr.
+#
+# Needs root, pktgen, ethtool, tc and bridge. Loads ../brnana.ko if brnana
+# is not loaded. Knobs, as environment variables:
+#   PORTS="2 8 32" MIXES="unicast flood" SIZES="64 512 1500 9000"
+#   DURATION=10 WARMUP=2
+set -e
+
+PORTS=${PORTS:-2 8 32}
+MIXES=${MIXES:-unicast flood}
+SIZES=${SIZES:-64 512 1500 9000}
+DURATION=${DURATION:-10}
+WARMUP=${WARMUP:-2}
+
+BR=brnbench0
+NS=brnbench
+DIR=$(dirname "$0")
+NCPU=$(nproc)
+HZ=$(getconf CLK_TCK)
+
+log() {
+    echo "brnana_bench: $*" >&2
+}
+
+# pg <netns> <file> <command>: write a pktgen command in a namespace
+pg() {
+    ip netns exec "$1" sh -c "echo '$3' > /proc/net/pktgen/$2"
+}
+
+# sum <stat> <first> <last>: sum a counter over the host ends of ports
+sum() {
+    total=0
+    for i in $(seq "$2" "$3"); do
+        total=$((total + $(cat /sys/class/net/vb$i/statistics/"$1")))
+    done
+    echo $total
+}
+
+# cpu: busy and softirq ticks of all CPUs so far
+cpu() {
+    awk '$1 == "cpu" { print $2 + $3 + $4 + $7 + $8 + $9, $8 }' /proc/stat
+}
+
+drops() {
+    ethtool -S $BR | awk '$1 == "drop_packets:" { print $2; exit }'
+}
+
+# drop_locally <dev> [netns]: drop what a device receives right at ingress,
+# so that frames reaching the end of the benchmark cost next to nothing
+drop_locally() {
+    tc ${2:+-n "$2"} qdisc add dev "$1" clsact
+    tc ${2:+-n "$2"} filter add dev "$1" ingress matchall action drop
+}
+
+teardown() {
+    for ns in $(ip netns list | awk -v ns=$NS '$1 ~ "^" ns { print $1 }'); do
+        ip netns del "$ns"
+    done
+    ip link del $BR 2>/dev/null || true
+}
+
+# setup <ports>: a fresh bridge with one namespace per port
+setup() {
+    teardown
+    ip link add $BR type brnana
+    for i in $(seq 1 "$1"); do
+        ip netns add $NS$i
+        ip link add vb$i mtu 9000 type veth peer name eth0 mtu 9000 \
+            netns $NS$i
+        ip link set vb$i master $BR up
+        ip -n $NS$i addr add 10.99.$((i / 256)).$((i % 256))/16 dev eth0
+        ip -n $NS$i link set eth0 up
+        drop_locally eth0 $NS$i
+    done
+    ip link set $BR up
+    drop_locally $BR
+}
+
+# run <ports> <mix> <size>: one measurement, printed as a CSV line
+run() {
+    n=$1
+    half=$(($1 / 2))
+
+    if [ "$2" = unicast ]; then
+        senders="1 $half"
+        receivers="$((half + 1)) $n"
+        fanout=1
+    else
+        senders="1 1"
+        receivers="2 $n"
+        fanout=$((n - 1))
+    fi
+
+    for i in $(seq $senders); do
+        if [ "$2" = unicast ]; then
+            peer=$((i + half))
+            dst=$(ip netns exec $NS$peer cat /sys/class/net/eth0/address)
+            bridge fdb replace "$dst" dev vb$peer master static
+        else
+            peer=1
+            dst=ff:ff:ff:ff:ff:ff
+        fi
+
+        thread=kpktgend_$(((i - 1) % NCPU))
+        pg $NS$i $thread rem_device_all
+        pg $NS$i $thread "add_device eth0"
+        pg $NS$i eth0 "count 0"
+        pg $NS$i eth0 "clone_skb 0"
+        pg $NS$i eth0 "delay 0"
+        # pktgen sizes exclude the 4-byte FCS
+        pg $NS$i eth0 "pkt_size $(($3 - 4))"
+        pg $NS$i eth0 "dst_mac $dst"
+        pg $NS$i eth0 "dst 10.99.$((peer / 256)).$((peer % 256))"
+    done
+
+    for i in $(seq $senders); do
+        pg $NS$i pgctrl start &
+    done
+    sleep "$WARMUP"
+
+    rx0=$(sum rx_packets $senders)
+    tx0=$(sum tx_packets $receivers)
+    drop0=$(drops)
+    cpu0=$(cpu)
+    sleep "$DURATION"
+    rx1=$(sum rx_packets $senders)
+    tx1=$(sum tx_packets $receivers)
+    drop1=$(drops)
+    cpu1=$(cpu)
+
+    for i in $(seq $senders); do
+        pg $NS$i pgctrl stop
+    done
+    wait
+
+    echo "$VERSION $KERNEL $n $2 $3 $((rx1 - rx0)) $((tx1 - tx0)) \
+$((drop1 - drop0)) $fanout $DURATION $cpu0 $cpu1 $HZ" | awk '{
+        offered = $6; forwarded = $7; expected = $6 * $9
+        busy = ($13 - $11) * 1e9 / $15; softirq = ($14 - $12) * 1e9 / $15
+        printf "%s,%s,%d,%s,%d,%.0f,%.0f,%d,%.6f,%.1f,%.1f\n",
+            $1, $2, $3, $4, $5, offered / $10, forwarded / $10, $8,
+            expected ? 1 - forwarded / expected : 0,
+            forwarded ? busy / forwarded : 0,
+            forwarded ? softirq / forwarded : 0
+    }'
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "brnana_bench: must run as root" >&2
+    exit 1
+fi
+
+if [ ! -d /sys/module/brnana ]; then
+    insmod "$DIR/../brnana.ko"
+fi
+modprobe pktgen
+
+VERSION=$(cat /sys/module/brnana/version 2>/dev/null || echo unknown)
+KERNEL=$(uname -r)
+
+trap teardown EXIT INT TERM
+
+echo "version,kernel,ports,mix,size,offered_pps,forwarded_pps,drops,\
+drop_rate,busy_ns_per_pkt,softirq_ns_per_pkt"
+
+for ports in $PORTS; do
+    log "setting up $ports ports"
+    setup "$ports"
+    for mix in $MIXES; do
+        for size in $SIZES; do
+            log "$ports ports, $mix, ${size}B"
+            run "$ports" "$mix" "$size"
+        done
+    done
+done
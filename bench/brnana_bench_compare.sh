@@ -0,0 +1,32 @@
+#!/bin/sh
+# Compare two brnana_bench.sh runs, e.g. of two releases.
+#
+#   brnana_bench_compare.sh old.csv new.csv
+#
+# Prints forwarded pps and CPU time per frame of both runs, with the change,
+# for every (ports, mix, size) measured by both. Exits with status 1 if
+# forwarded pps dropped by more than $THRESHOLD percent (default 5) anywhere.
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 old.csv new.csv" >&2
+    exit 1
+fi
+
+awk -F, -v threshold="${THRESHOLD:-5}" '
+FNR == 1 { next }
+NR == FNR { pps[$3 "," $4 "," $5] = $7; ns[$3 "," $4 "," $5] = $10; next }
+{
+    key = $3 "," $4 "," $5
+    if (!(key in pps))
+        next
+    dpps = pps[key] ? 100 * ($7 - pps[key]) / pps[key] : 0
+    dns = ns[key] ? 100 * ($10 - ns[key]) / ns[key] : 0
+    flag = dpps < -threshold ? "  REGRESSION" : ""
+    if (flag)
+        failed = 1
+    printf "%-22s %12.0f -> %12.0f pps (%+6.1f%%) %8.1f -> %8.1f ns/pkt (%+6.1f%%)%s\n",
+        key, pps[key], $7, dpps, ns[key], $10, dns, flag
+}
+END { exit failed }
+' "$1" "$2"
@@ -6,52 +6,549 @@
  * used by the brnana bridge kernel module.
  */
 
+#ifndef _BRNANA_H
+#define _BRNANA_H
+
 #include <linux/etherdevice.h> /** Ethernet-specific helpers */
+#include <linux/if_arp.h>      /** ARPHRD_* device types */
+#include <linux/if_vlan.h>     /** 802.1Q tags and skb->vlan_tci helpers */
+#include <linux/jump_label.h>  /** Static key gating latency histograms */
 #include <linux/kernel.h>      /** Core kernel definitions */
 #include <linux/module.h>      /** Module macros and interfaces */
 #include <linux/netdevice.h>   /** Network device structures */
+#include <linux/rtnetlink.h>   /** RTNL lock and rtnl_dereference() */
+#include <linux/u64_stats_sync.h> /** Tear-free 64-bit counters */
+#include <linux/workqueue.h>   /** Deferred multicast database expiry */
+#include <net/gro_cells.h>     /** GRO for frames delivered to the bridge */
+#include <net/rtnetlink.h>     /** rtnl_link_ops for `ip link add type brnana` */
+
+#include "brnana_core.h"       /** FDB shared with the userspace build */
+
+/** Module version, also reported by `ethtool -i` */
+#define BRNANA_VERSION "0.2"
 
 /** Default bridge interface name pattern */
 #define BR_NAME "brnana%d"
 
+/** Offloads the bridge can advertise, subject to what its ports support */
+#define BRNANA_FEATURES                                               \
+    (NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_HIGHDMA | NETIF_F_GSO_MASK | \
+     NETIF_F_HW_CSUM)
+
+/** VLAN every new port and bridge is a PVID/untagged member of */
+#define BRNANA_DEFAULT_PVID 1
+
+/** Maximum number of ports per bridge, bounds port numbers */
+#define BRNANA_MAX_PORTS 1024
+
+/** Number of buckets and maximum entries of the multicast database */
+#define BRNANA_MDB_HASH_BITS 8
+#define BRNANA_MDB_HASH_SIZE (1 << BRNANA_MDB_HASH_BITS)
+#define BRNANA_MDB_MAX 4096
+
+/** Number of buckets and maximum entries of the ARP/ND suppression table */
+#define BRNANA_NEIGH_HASH_BITS 8
+#define BRNANA_NEIGH_HASH_SIZE (1 << BRNANA_NEIGH_HASH_BITS)
+#define BRNANA_NEIGH_MAX 4096
+
+/** Credit a storm control bucket saves up while idle, bounds bursts */
+#define BRNANA_STORM_BURST_NS (100 * NSEC_PER_MSEC)
+
+/**
+ * Credit a CPU takes from a port's shared bucket at once, and interval at
+ * which the shared bucket is refilled
+ */
+#define BRNANA_STORM_CHUNK_NS NSEC_PER_MSEC
+
+/** Fractional bits of struct brnana_storm_limit's byte_cost */
+#define BRNANA_STORM_SHIFT 16
+
+/** Number of 802.1p PCP and of DSCP values a QoS map translates */
+#define BRNANA_QOS_PCP_NUM 8
+#define BRNANA_QOS_DSCP_NUM 64
+
+/** Entry of a map passed to brnana_qos_map_set() that is not changed */
+#define BRNANA_QOS_KEEP 0xff
+
+/** Buckets of a latency histogram, bucket b > 0 holds [2^(b-1), 2^b) ns */
+#define BRNANA_LAT_BUCKETS 32
+
+/** Tells a brnana_skb_cb stamped on ingress from leftovers of other layers */
+#define BRNANA_LAT_COOKIE 0xb4a4a4a5
+
+/**
+ * enum brnana_drop_reason - Why the forwarding path dropped a frame
+ * @BRNANA_DROP_BR_DOWN:     The bridge device is not running
+ * @BRNANA_DROP_INVALID_SRC: Source MAC is multicast or all-zero
+ * @BRNANA_DROP_SAME_PORT:   Destination lives behind the ingress port
+ * @BRNANA_DROP_PORT_DOWN:   Egress port is down or has no carrier
+ * @BRNANA_DROP_PKT_TOO_BIG: Frame exceeds the egress MTU
+ * @BRNANA_DROP_NOMEM:       A replica could not be allocated
+ * @BRNANA_DROP_VLAN_FILTERED: VLAN not allowed on the ingress/egress port
+ * @BRNANA_DROP_STORM:       Flooded traffic above the ingress port's limit
+ *
+ * Reported by the brnana_drop tracepoint; mapped onto the closest
+ * SKB_DROP_REASON_* for kfree_skb_reason().
+ */
+enum brnana_drop_reason {
+    BRNANA_DROP_BR_DOWN,
+    BRNANA_DROP_INVALID_SRC,
+    BRNANA_DROP_SAME_PORT,
+    BRNANA_DROP_PORT_DOWN,
+    BRNANA_DROP_PKT_TOO_BIG,
+    BRNANA_DROP_NOMEM,
+    BRNANA_DROP_VLAN_FILTERED,
+    BRNANA_DROP_STORM,
+};
+
 /**
- * struct brnana_content - Global container for all brnana bridge instances
- * @br_list: A linked list of all registered brnana bridges
+ * enum brnana_stat - Per-CPU counters kept for bridges and ports
+ * @BRNANA_STAT_RX_PACKETS: Frames received (port) / delivered up (bridge)
+ * @BRNANA_STAT_RX_BYTES:   Bytes of the above
+ * @BRNANA_STAT_TX_PACKETS: Frames sent out (port) / transmitted by (bridge)
+ * @BRNANA_STAT_TX_BYTES:   Bytes of the above
+ * @BRNANA_STAT_FORWARD:    Frames sent to a single learned egress port
+ * @BRNANA_STAT_FLOOD:      Frames replicated to all ports
+ * @BRNANA_STAT_DROP:       Frames dropped by the forwarding path
+ * @BRNANA_STAT_NEIGH_SUPPRESS: ARP requests and neighbor solicitations
+ *                          answered by the bridge instead of being flooded
+ * @BRNANA_STAT_FCACHE_HIT: Unicast lookups answered by the forwarding cache
+ *                          (bridge only)
+ * @BRNANA_STAT_FCACHE_MISS: Unicast lookups that went to the FDB (bridge only)
+ * @BRNANA_STAT_STORM_DROP: Frames dropped by storm control, also counted in
+ *                          @BRNANA_STAT_DROP
+ * @BRNANA_STAT_NUM:        Number of counters
+ *
+ * Every *_BYTES counter directly follows its *_PACKETS counter, see
+ * brnana_stats_pkt().
  */
-struct brnana_content {
-    struct list_head br_list; /** List head for all bridge interfaces */
+enum brnana_stat {
+    BRNANA_STAT_RX_PACKETS,
+    BRNANA_STAT_RX_BYTES,
+    BRNANA_STAT_TX_PACKETS,
+    BRNANA_STAT_TX_BYTES,
+    BRNANA_STAT_FORWARD,
+    BRNANA_STAT_FLOOD,
+    BRNANA_STAT_DROP,
+    BRNANA_STAT_NEIGH_SUPPRESS,
+    BRNANA_STAT_FCACHE_HIT,
+    BRNANA_STAT_FCACHE_MISS,
+    BRNANA_STAT_STORM_DROP,
+    BRNANA_STAT_NUM,
 };
 
+/**
+ * struct brnana_pcpu_stats - One CPU's share of the counters
+ * @cnt:   Counters indexed by enum brnana_stat
+ * @syncp: Synchronizes 64-bit reads on 32-bit hosts
+ */
+struct brnana_pcpu_stats {
+    u64_stats_t cnt[BRNANA_STAT_NUM];
+    struct u64_stats_sync syncp;
+};
+
+/**
+ * struct brnana_vlan_group - 802.1Q membership of a port or of the bridge
+ * @vlan_bitmap:     VIDs the port is a member of
+ * @untagged_bitmap: VIDs sent out untagged on the port
+ * @pvid:            VID given to untagged and priority-tagged frames, 0 if
+ *                   such frames are not accepted
+ *
+ * Only used when VLAN filtering is enabled on the bridge. Written under RTNL
+ * with atomic bit operations and WRITE_ONCE(), read locklessly by the
+ * forwarding path: admitting a frame is a single test_bit().
+ */
+struct brnana_vlan_group {
+    unsigned long vlan_bitmap[BITS_TO_LONGS(VLAN_N_VID)];
+    unsigned long untagged_bitmap[BITS_TO_LONGS(VLAN_N_VID)];
+    u16 pvid;
+};
+
+/**
+ * enum brnana_storm_class - Flooded traffic subject to storm control
+ * @BRNANA_STORM_BCAST:         Broadcast frames
+ * @BRNANA_STORM_MCAST:         Multicast frames
+ * @BRNANA_STORM_UNKNOWN_UCAST: Unicast frames to addresses not in the FDB
+ * @BRNANA_STORM_NUM:           Number of classes
+ */
+enum brnana_storm_class {
+    BRNANA_STORM_BCAST,
+    BRNANA_STORM_MCAST,
+    BRNANA_STORM_UNKNOWN_UCAST,
+    BRNANA_STORM_NUM,
+};
+
+/**
+ * struct brnana_storm_limit - Storm control limit of one class on a port
+ * @pps:       Configured packets per second, 0 if unlimited
+ * @bps:       Configured bits per second, 0 if unlimited
+ * @pkt_cost:  Credit in ns one frame takes
+ * @byte_cost: Credit in ns one byte takes, << BRNANA_STORM_SHIFT
+ * @gen:       Bumped by every change of the limit
+ * @last:      Time of the last refill of the pools, in ns
+ * @pkt_pool:  Credit for frames the CPUs have yet to take, in ns
+ * @bit_pool:  Credit for bytes the CPUs have yet to take, in ns
+ *
+ * The configuration is written under RTNL and read locklessly by the
+ * forwarding path. The pools grow by the time elapsed, up to
+ * BRNANA_STORM_BURST_NS, and are only touched once per
+ * BRNANA_STORM_CHUNK_NS of credit a CPU uses, so they sit on their own
+ * cache line.
+ */
+struct brnana_storm_limit {
+    u64 pps;
+    u64 bps;
+    u64 pkt_cost;
+    u64 byte_cost;
+    unsigned int gen;
+    atomic64_t last ____cacheline_aligned_in_smp;
+    atomic64_t pkt_pool;
+    atomic64_t bit_pool;
+};
+
+/**
+ * struct brnana_storm_bucket - One CPU's share of a port's credit for a class
+ * @pkt_tokens: Credit left for frames, in ns
+ * @bit_tokens: Credit left for bytes, in ns
+ * @gen:        The limit's gen the credit was taken under
+ *
+ * Topped up from the port's pools in chunks of BRNANA_STORM_CHUNK_NS, and
+ * may go negative by the cost of the last frame admitted. Emptied when the
+ * limit changes, so debt run up under the old limit is forgotten.
+ */
+struct brnana_storm_bucket {
+    s64 pkt_tokens;
+    s64 bit_tokens;
+    unsigned int gen;
+};
+
+/**
+ * struct brnana_storm_pcpu - One CPU's storm control state of a port
+ * @bucket: Buckets indexed by enum brnana_storm_class
+ *
+ * Only used by its own CPU from the receive path, with BH disabled, so it
+ * needs no lock.
+ */
+struct brnana_storm_pcpu {
+    struct brnana_storm_bucket bucket[BRNANA_STORM_NUM];
+};
+
+/**
+ * enum brnana_qos_trust - Markings forwarded frames are prioritized by
+ * @BRNANA_QOS_TRUST_PCP:  The 802.1p PCP of the VLAN tag, 0 if untagged
+ * @BRNANA_QOS_TRUST_DSCP: The DSCP of IPv4 and IPv6 packets, which takes
+ *                         precedence over the PCP
+ */
+enum brnana_qos_trust {
+    BRNANA_QOS_TRUST_PCP,
+    BRNANA_QOS_TRUST_DSCP,
+};
+
+/**
+ * struct brnana_qos - Egress priority of forwarded frames
+ * @trust: Bit per enum brnana_qos_trust in use, none by default
+ * @pcp:   skb->priority given per PCP
+ * @dscp:  skb->priority given per DSCP
+ *
+ * The egress device picks its TX queue, and its qdisc the band, from
+ * skb->priority. Maps are written entry by entry under RTNL and read
+ * locklessly, so a frame racing with an update sees either value.
+ */
+struct brnana_qos {
+    unsigned long trust;
+    u8 pcp[BRNANA_QOS_PCP_NUM];
+    u8 dscp[BRNANA_QOS_DSCP_NUM];
+};
+
+/**
+ * enum brnana_lat_path - How a frame left the bridge, for latency histograms
+ * @BRNANA_LAT_FORWARD: Sent to the single port its destination was learned on
+ * @BRNANA_LAT_FLOOD:   Replicated to several ports, one sample per replica
+ * @BRNANA_LAT_LOCAL:   Delivered to the bridge device itself
+ * @BRNANA_LAT_NUM:     Number of paths
+ */
+enum brnana_lat_path {
+    BRNANA_LAT_FORWARD,
+    BRNANA_LAT_FLOOD,
+    BRNANA_LAT_LOCAL,
+    BRNANA_LAT_NUM,
+};
+
+/**
+ * struct brnana_lat_pcpu - One CPU's forwarding latency histograms
+ * @count: Frames per path and log2 bucket of their latency
+ * @sum:   Total latency per path in ns, for the mean
+ *
+ * Only updated by its own CPU with BH disabled, so it needs no lock.
+ */
+struct brnana_lat_pcpu {
+    u64 count[BRNANA_LAT_NUM][BRNANA_LAT_BUCKETS];
+    u64 sum[BRNANA_LAT_NUM];
+};
+
+/**
+ * struct brnana_skb_cb - What brnana keeps in skb->cb while a frame crosses it
+ * @rx_ns:  ktime_get_mono_fast_ns() when the frame entered the bridge
+ * @cookie: BRNANA_LAT_COOKIE if @rx_ns and @path were set
+ * @path:   enum brnana_lat_path the frame is sent through
+ *
+ * Only written while latency histograms are on. skb->cb is ours from the
+ * rx_handler (or ndo_start_xmit) until the frame is handed to the egress
+ * device, and clones inherit it.
+ */
+struct brnana_skb_cb {
+    u64 rx_ns;
+    u32 cookie;
+    u8 path;
+};
+
+#define BRNANA_SKB_CB(skb) ((struct brnana_skb_cb *) (skb)->cb)
+
 /**
  * struct brnana_if - Represents a brnana bridge interface
  * @lock:         Spinlock to protect concurrent access to bridge state
  * @dev:          Pointer to the associated net_device structure
- * @br_id:        Unique bridge ID
  * @mac_addr:     MAC address of the bridge
  * @port_list:    List of slave interfaces (ports) attached to this bridge
- * @link:         Link to other bridges in brnana_content.br_list
+ * @stats:        Per-CPU counters of the bridge
+ * @gro_cells:    Per-CPU NAPI contexts coalescing frames delivered up
+ * @lat:          Per-CPU forwarding latency histograms
+ * @debugfs:      The bridge's directory under /sys/kernel/debug/brnana/
+ * @mtu_set_by_user: MTU was configured explicitly, stop deriving it from ports
+ * @ports:        Snapshot of the active ports, used for flooding
+ * @vlan_enabled: 802.1Q VLAN filtering is on
+ * @vlans:        VLAN membership of the bridge device itself
+ * @port_nos:     Port numbers in use (under RTNL)
+ * @mcast_snooping: IGMP/MLD snooping is on
+ * @mdb_lock:     Serializes writers of @mdb_hash (readers use RCU)
+ * @mdb_count:    Number of entries in @mdb_hash
+ * @mcast_gc:     Periodic expiry of multicast memberships
+ * @mdb_hash:     Buckets of the multicast database (struct brnana_mdb_entry)
+ * @neigh_suppress: ARP/ND suppression is on
+ * @neigh_lock:   Serializes writers of @neigh_hash (readers use RCU)
+ * @neigh_count:  Number of entries in @neigh_hash
+ * @neigh_gc:     Periodic expiry of neighbor entries
+ * @neigh_hash:   Buckets of learned IP addresses (struct brnana_neigh_entry)
+ * @qos:          Egress priority of forwarded frames
+ * @fdb_gc:       Incremental ageing of @fdb
+ * @fdb:          Forwarding database
  */
 struct brnana_if {
     spinlock_t lock;
     struct net_device *dev;
-    int br_id;
     unsigned char mac_addr[ETH_ALEN];
     struct list_head port_list;
-    struct list_head link;
+    struct brnana_pcpu_stats __percpu *stats;
+    struct gro_cells gro_cells;
+    struct brnana_lat_pcpu __percpu *lat;
+    struct dentry *debugfs;
+    bool mtu_set_by_user;
+    struct brnana_port_array __rcu *ports;
+    bool vlan_enabled;
+    struct brnana_vlan_group vlans;
+    unsigned long port_nos[BITS_TO_LONGS(BRNANA_MAX_PORTS)];
+    bool mcast_snooping;
+    spinlock_t mdb_lock;
+    unsigned int mdb_count;
+    struct delayed_work mcast_gc;
+    struct hlist_head mdb_hash[BRNANA_MDB_HASH_SIZE];
+    bool neigh_suppress;
+    spinlock_t neigh_lock;
+    unsigned int neigh_count;
+    struct delayed_work neigh_gc;
+    struct hlist_head neigh_hash[BRNANA_NEIGH_HASH_SIZE];
+    struct brnana_qos qos;
+    struct delayed_work fdb_gc;
+    struct brnana_fdb fdb;
 };
 
 /**
  * struct brnana_port_if - Represents a slave port attached to a brnana bridge
- * @br:   Pointer back to the parent bridge structure
- * @dev:  The net_device representing the slave port
- * @link: Link in the bridge's port_list
+ * @br:    Pointer back to the parent bridge structure
+ * @dev:   The net_device representing the slave port
+ * @link:  Link in the bridge's port_list
+ * @stats: Per-CPU counters of the port
+ * @vlans: VLAN membership of the port
+ * @port_no: Number of the port in its bridge, below BRNANA_MAX_PORTS
+ * @mrouter_expires: jiffies until which a multicast router sits behind the
+ *                   port, 0 if none was seen
+ * @fdb:   The port's learned and static FDB entries
+ * @storm_mask: Bit per enum brnana_storm_class with a limit
+ * @storm: Storm control limits, indexed by enum brnana_storm_class
+ * @storm_pcpu: Per-CPU token buckets enforcing @storm
+ * @rcu:   Deferred free once readers are done
  */
 struct brnana_port_if {
     struct brnana_if *br;
     struct net_device *dev;
     struct list_head link;
+    struct brnana_pcpu_stats __percpu *stats;
+    struct brnana_vlan_group vlans;
+    u16 port_no;
+    unsigned long mrouter_expires;
+    struct brnana_fdb_port fdb;
+    unsigned long storm_mask;
+    struct brnana_storm_limit storm[BRNANA_STORM_NUM];
+    struct brnana_storm_pcpu __percpu *storm_pcpu;
+    struct rcu_head rcu;
 };
 
+/**
+ * struct brnana_port_array - Immutable snapshot of a bridge's active ports
+ * @rcu:   Deferred free once readers are done
+ * @count: Number of entries in @ports
+ * @ports: Ports that are up with carrier, in port_list order
+ *
+ * Rebuilt under RTNL on every port add/remove and link state change, then
+ * published with rcu_assign_pointer(). Replication walks this contiguous
+ * array instead of chasing port_list pointers.
+ */
+struct brnana_port_array {
+    struct rcu_head rcu;
+    unsigned int count;
+    struct brnana_port_if *ports[];
+};
+
+/**
+ * struct brnana_ip - An IP address in a VLAN, key of the mdb and neighbor table
+ * @addr:  IPv4 or IPv6 address, zero-padded
+ * @proto: ETH_P_IP or ETH_P_IPV6, network order
+ * @vid:   VLAN of the address, 0 without VLAN filtering
+ *
+ * Hashed and compared as raw memory, so it must be zeroed before use.
+ */
+struct brnana_ip {
+    union {
+        __be32 ip4;
+        struct in6_addr ip6;
+    } addr;
+    __be16 proto;
+    u16 vid;
+};
+
+/**
+ * struct brnana_mdb_entry - A multicast group with listeners on the bridge
+ * @hlist:   Link in the bridge's mdb_hash bucket
+ * @group:   The group
+ * @ports:   Port numbers with listeners, read locklessly when forwarding
+ * @members: The listening ports with their expiry (struct brnana_mdb_member)
+ * @rcu:     Deferred free once readers are done
+ */
+struct brnana_mdb_entry {
+    struct hlist_node hlist;
+    struct brnana_ip group;
+    unsigned long ports[BITS_TO_LONGS(BRNANA_MAX_PORTS)];
+    struct list_head members;
+    struct rcu_head rcu;
+};
+
+/**
+ * struct brnana_mdb_member - A port listening to a multicast group
+ * @list:    Link in the entry's members list
+ * @port:    The port
+ * @expires: jiffies when the membership times out unless refreshed
+ * @rcu:     Deferred free once readers are done
+ */
+struct brnana_mdb_member {
+    struct list_head list;
+    struct brnana_port_if *port;
+    unsigned long expires;
+    struct rcu_head rcu;
+};
+
+/**
+ * struct brnana_neigh_entry - An IP address learned from ARP or NDISC
+ * @hlist:   Link in the bridge's neigh_hash bucket
+ * @ip:      The IPv4 or IPv6 address and its VLAN
+ * @mac:     MAC address the host announced for @ip
+ * @updated: jiffies when the binding was last seen
+ * @rcu:     Deferred free once readers are done
+ *
+ * @mac never changes once the entry is published: a host moving @ip to
+ * another MAC gets a new entry replacing this one, so readers always see a
+ * consistent address.
+ */
+struct brnana_neigh_entry {
+    struct hlist_node hlist;
+    struct brnana_ip ip;
+    unsigned char mac[ETH_ALEN];
+    unsigned long updated;
+    struct rcu_head rcu;
+};
+
+/**
+ * dev_get_brnana_if - Helper to retrieve brnana_if from a net_device
+ * @dev: Pointer to the bridge's net_device
+ *
+ * Returns:
+ *   A pointer to the private brnana_if structure embedded in the net_device.
+ *   This function assumes the device was allocated via alloc_netdev().
+ */
+static inline struct brnana_if *dev_get_brnana_if(struct net_device *dev)
+{
+    /* Bridge interface pointed to by netdev_priv() */
+    return (struct brnana_if *) netdev_priv(dev);
+}
+
+/**
+ * brnana_fdb_port - Get the port an FDB entry points to
+ * @fp: The entry's dst
+ *
+ * Return: The brnana_port_if @fp is embedded in.
+ */
+static inline struct brnana_port_if *brnana_fdb_port(struct brnana_fdb_port *fp)
+{
+    return container_of(fp, struct brnana_port_if, fdb);
+}
+
+/**
+ * brnana_port_can_xmit - Check whether a port may be used as egress
+ * @p: The candidate egress port
+ *
+ * Return: true if the port's device is administratively up and has carrier.
+ */
+static inline bool brnana_port_can_xmit(const struct brnana_port_if *p)
+{
+    return (p->dev->flags & IFF_UP) && netif_carrier_ok(p->dev);
+}
+
+/**
+ * brnana_stats_add - Add to one of this CPU's counters
+ * @pcpu: Per-CPU counters of a bridge or a port
+ * @stat: The counter
+ * @val:  Amount to add
+ *
+ * Must be called with BH disabled (forwarding path).
+ */
+static inline void brnana_stats_add(struct brnana_pcpu_stats __percpu *pcpu,
+                                    enum brnana_stat stat,
+                                    u64 val)
+{
+    struct brnana_pcpu_stats *s = this_cpu_ptr(pcpu);
+
+    u64_stats_update_begin(&s->syncp);
+    u64_stats_add(&s->cnt[stat], val);
+    u64_stats_update_end(&s->syncp);
+}
+
+/**
+ * brnana_stats_pkt - Count one frame and its bytes
+ * @pcpu: Per-CPU counters of a bridge or a port
+ * @stat: BRNANA_STAT_RX_PACKETS or BRNANA_STAT_TX_PACKETS
+ * @len:  Length of the frame
+ */
+static inline void brnana_stats_pkt(struct brnana_pcpu_stats __percpu *pcpu,
+                                    enum brnana_stat stat,
+                                    unsigned int len)
+{
+    struct brnana_pcpu_stats *s = this_cpu_ptr(pcpu);
+
+    u64_stats_update_begin(&s->syncp);
+    u64_stats_inc(&s->cnt[stat]);
+    u64_stats_add(&s->cnt[stat + 1], len);
+    u64_stats_update_end(&s->syncp);
+}
+
 /**
  * brnana_add_port - Attach a port to a brnana bridge
  * @br:    Pointer to the bridge to attach to
@@ -71,4 +568,685 @@ int brnana_add_port(struct brnana_if *br,
  *
  * Return: 0 on success, or a negative errno value on failure.
  */
-int brnana_del_port(struct brnana_if *br, struct net_device *dev);
\ No newline at end of file
+int brnana_del_port(struct brnana_if *br, struct net_device *dev);
+
+/**
+ * brnana_dev_is_bridge - Check whether a device is a brnana bridge
+ * @dev: The device
+ *
+ * Return: true if @dev is a brnana bridge device.
+ */
+bool brnana_dev_is_bridge(const struct net_device *dev);
+
+/**
+ * brnana_port_get_rtnl - Get the brnana port behind a device under RTNL
+ * @dev: The candidate port device
+ *
+ * Return: The brnana_port_if if @dev is enslaved to a brnana bridge, else
+ * NULL.
+ */
+struct brnana_port_if *brnana_port_get_rtnl(const struct net_device *dev);
+
+/**
+ * brnana_port_get_rcu - Get the brnana port behind an enslaved device
+ * @dev: The enslaved net_device
+ *
+ * Must be called from the receive path, where rx_handler_data is protected
+ * by the RCU read-side section held by __netif_receive_skb_core().
+ *
+ * Return: The brnana_port_if attached to @dev.
+ */
+static inline struct brnana_port_if *brnana_port_get_rcu(
+    const struct net_device *dev)
+{
+    return rcu_dereference(dev->rx_handler_data);
+}
+
+/* brnana_forward.c */
+
+/**
+ * brnana_handle_frame - rx_handler installed on every enslaved port
+ * @pskb: Pointer to the received socket buffer
+ *
+ * Return: An rx_handler_result_t telling the core what to do with the frame.
+ */
+rx_handler_result_t brnana_handle_frame(struct sk_buff **pskb);
+
+/**
+ * brnana_dev_forward - Forward a frame originated on the bridge device
+ * @br:  The bridge the frame was transmitted on
+ * @skb: The frame, with skb->data pointing past the Ethernet header
+ */
+void brnana_dev_forward(struct brnana_if *br, struct sk_buff *skb);
+
+/**
+ * brnana_forward_init - Set up the per-CPU transmit batches
+ */
+void brnana_forward_init(void);
+
+/**
+ * brnana_forward_exit - Tear down the per-CPU transmit batches
+ */
+void brnana_forward_exit(void);
+
+/* brnana_stats.c */
+
+/** Ethtool operations of the bridge device (`ethtool -S brnana0`) */
+extern const struct ethtool_ops brnana_ethtool_ops;
+
+/**
+ * brnana_stats_fetch - Sum per-CPU counters
+ * @pcpu: The per-CPU counters of a bridge or a port
+ * @sum:  Output array of BRNANA_STAT_NUM totals
+ */
+void brnana_stats_fetch(const struct brnana_pcpu_stats __percpu *pcpu,
+                        u64 *sum);
+
+/**
+ * brnana_get_stats64 - ndo_get_stats64 callback for bridge device
+ * @dev:   The net_device representing the brnana bridge
+ * @stats: Output statistics
+ */
+void brnana_get_stats64(struct net_device *dev,
+                        struct rtnl_link_stats64 *stats);
+
+/* brnana_fdb.c */
+
+/**
+ * brnana_fdb_module_init - Create the slab cache of FDB entries
+ *
+ * Return: 0 on success, or -ENOMEM.
+ */
+int brnana_fdb_module_init(void);
+
+/**
+ * brnana_fdb_module_exit - Destroy the slab cache of FDB entries
+ */
+void brnana_fdb_module_exit(void);
+
+/**
+ * brnana_fdb_init - Initialize the forwarding database of a bridge
+ * @br: The bridge
+ *
+ * Return: 0 on success, or -ENOMEM.
+ */
+int brnana_fdb_init(struct brnana_if *br);
+
+/**
+ * brnana_fdb_destroy - Free the forwarding database of a bridge
+ * @br: The bridge
+ */
+void brnana_fdb_destroy(struct brnana_if *br);
+
+/**
+ * brnana_fdb_open - Start ageing the learned addresses of a bridge
+ * @br: The bridge
+ */
+void brnana_fdb_open(struct brnana_if *br);
+
+/**
+ * brnana_fdb_stop - Stop ageing the learned addresses of a bridge
+ * @br: The bridge
+ */
+void brnana_fdb_stop(struct brnana_if *br);
+
+/**
+ * brnana_fdb_dst_rcu - Find the port a destination address was learned on
+ * @br:   The bridge
+ * @addr: The MAC address
+ * @vid:  The VLAN, 0 without VLAN filtering
+ *
+ * Return: The port, or NULL if the address is unknown.
+ */
+struct brnana_port_if *brnana_fdb_dst_rcu(struct brnana_if *br,
+                                          const unsigned char *addr,
+                                          u16 vid);
+
+/**
+ * brnana_fdb_delete_by_port - Forget every address of a port
+ * @br: The bridge
+ * @p:  The port being removed
+ */
+void brnana_fdb_delete_by_port(struct brnana_if *br,
+                               struct brnana_port_if *p);
+
+/**
+ * brnana_fdb_delete_by_vlan - Forget the addresses learned on a port in a VLAN
+ * @br:  The bridge
+ * @p:   The port
+ * @vid: The VLAN the port left
+ */
+void brnana_fdb_delete_by_vlan(struct brnana_if *br,
+                               struct brnana_port_if *p,
+                               u16 vid);
+
+/**
+ * brnana_fdb_flush - Forget every learned address of a bridge
+ * @br: The bridge
+ */
+void brnana_fdb_flush(struct brnana_if *br);
+
+/**
+ * brnana_fdb_add - ndo_fdb_add callback (`bridge fdb add/replace`)
+ * @ndm:    The request
+ * @tb:     Its attributes
+ * @dev:    The port the address lives behind, or the bridge itself
+ * @addr:   The MAC address
+ * @vid:    The VLAN, 0 if none was given
+ * @flags:  NLM_F_* flags of the request
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_add(struct ndmsg *ndm,
+                   struct nlattr *tb[],
+                   struct net_device *dev,
+                   const unsigned char *addr,
+                   u16 vid,
+                   u16 flags,
+                   struct netlink_ext_ack *extack);
+
+/**
+ * brnana_fdb_del - ndo_fdb_del callback (`bridge fdb del`)
+ * @ndm:    The request
+ * @tb:     Its attributes
+ * @dev:    The port the address lives behind, or the bridge itself
+ * @addr:   The MAC address
+ * @vid:    The VLAN, 0 if none was given
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_del(struct ndmsg *ndm,
+                   struct nlattr *tb[],
+                   struct net_device *dev,
+                   const unsigned char *addr,
+                   u16 vid,
+                   struct netlink_ext_ack *extack);
+
+/**
+ * brnana_fdb_del_bulk - ndo_fdb_del_bulk callback (`bridge fdb flush`)
+ * @nlh:    The request
+ * @dev:    The bridge, or the port whose entries are flushed
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_del_bulk(struct nlmsghdr *nlh,
+                        struct net_device *dev,
+                        struct netlink_ext_ack *extack);
+
+/**
+ * brnana_fdb_dump - ndo_fdb_dump callback (`bridge fdb show`)
+ * @skb:        The dump being filled
+ * @cb:         Dump state
+ * @dev:        The bridge
+ * @filter_dev: The port whose entries are dumped, or NULL
+ * @idx:        Index of the next entry
+ *
+ * Return: 0 when done, -EMSGSIZE to be called again.
+ */
+int brnana_fdb_dump(struct sk_buff *skb,
+                    struct netlink_callback *cb,
+                    struct net_device *dev,
+                    struct net_device *filter_dev,
+                    int *idx);
+
+/* brnana_vlan.c */
+
+/**
+ * brnana_vlan_init - Make a port or bridge a member of the default VLAN
+ * @vg: The VLAN group to initialize
+ */
+void brnana_vlan_init(struct brnana_vlan_group *vg);
+
+/**
+ * brnana_vlan_ingress - Admit a frame into the bridge and find its VLAN
+ * @br:   The bridge
+ * @vg:   VLAN membership of the ingress port or bridge device
+ * @pskb: The frame, with skb->data pointing past the Ethernet header
+ * @vid:  Output: the frame's VLAN, 0 without VLAN filtering
+ *
+ * Return: true if the frame may enter. On false, *pskb is the frame to
+ * drop, or NULL if it was already freed.
+ */
+bool brnana_vlan_ingress(const struct brnana_if *br,
+                         const struct brnana_vlan_group *vg,
+                         struct sk_buff **pskb,
+                         u16 *vid);
+
+/**
+ * brnana_vlan_allowed_egress - Check whether a frame may leave on a port
+ * @vg:  VLAN membership of the egress port or bridge device
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Return: true if @vid is allowed out.
+ */
+static inline bool brnana_vlan_allowed_egress(
+    const struct brnana_vlan_group *vg, u16 vid)
+{
+    return !vid || test_bit(vid, vg->vlan_bitmap);
+}
+
+/**
+ * brnana_vlan_egress - Pop the tag of a frame sent untagged
+ * @vg:  VLAN membership of the egress port or bridge device
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ * @skb: The frame
+ *
+ * Tags live in skb->vlan_tci inside the bridge, so popping one never moves
+ * packet data; the core inserts kept tags in software on the way out if the
+ * egress device cannot.
+ */
+static inline void brnana_vlan_egress(const struct brnana_vlan_group *vg,
+                                      u16 vid,
+                                      struct sk_buff *skb)
+{
+    if (vid && test_bit(vid, vg->untagged_bitmap))
+        __vlan_hwaccel_clear_tag(skb);
+}
+
+/**
+ * brnana_vlan_filtering_set - Turn VLAN filtering on or off
+ * @br:     The bridge
+ * @on:     The new state
+ * @extack: Extended netlink ack for reporting errors to user space, or NULL
+ *
+ * Return: 0, or -EBUSY if the bridge has static FDB entries.
+ */
+int brnana_vlan_filtering_set(struct brnana_if *br,
+                              bool on,
+                              struct netlink_ext_ack *extack);
+
+/**
+ * brnana_bridge_setlink - ndo_bridge_setlink callback (`bridge vlan add`)
+ * @dev:    The port, or the bridge itself with `self`
+ * @nlh:    The RTM_SETLINK request
+ * @flags:  BRIDGE_FLAGS_* of the request
+ * @extack: Netlink extended acknowledgment structure
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_setlink(struct net_device *dev,
+                          struct nlmsghdr *nlh,
+                          u16 flags,
+                          struct netlink_ext_ack *extack);
+
+/**
+ * brnana_bridge_dellink - ndo_bridge_dellink callback (`bridge vlan del`)
+ * @dev:   The port, or the bridge itself with `self`
+ * @nlh:   The RTM_DELLINK request
+ * @flags: BRIDGE_FLAGS_* of the request
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_dellink(struct net_device *dev,
+                          struct nlmsghdr *nlh,
+                          u16 flags);
+
+/**
+ * brnana_bridge_getlink - ndo_bridge_getlink callback (`bridge vlan show`)
+ * @skb:         The dump being filled
+ * @pid:         Netlink port ID of the requester
+ * @seq:         Sequence number of the request
+ * @dev:         The port, or the bridge itself
+ * @filter_mask: RTEXT_FILTER_* of the request
+ * @nlflags:     Netlink flags of the message
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_getlink(struct sk_buff *skb,
+                          u32 pid,
+                          u32 seq,
+                          struct net_device *dev,
+                          u32 filter_mask,
+                          int nlflags);
+
+/* brnana_mcast.c */
+
+/**
+ * brnana_mcast_init - Initialize the multicast state of a bridge
+ * @br: The bridge
+ */
+void brnana_mcast_init(struct brnana_if *br);
+
+/**
+ * brnana_mcast_open - Start expiring memberships of a bridge
+ * @br: The bridge
+ */
+void brnana_mcast_open(struct brnana_if *br);
+
+/**
+ * brnana_mcast_stop - Stop expiring memberships of a bridge
+ * @br: The bridge
+ */
+void brnana_mcast_stop(struct brnana_if *br);
+
+/**
+ * brnana_mcast_flush - Forget every multicast membership of a bridge
+ * @br: The bridge
+ */
+void brnana_mcast_flush(struct brnana_if *br);
+
+/**
+ * brnana_mcast_del_port - Forget the memberships of a port being removed
+ * @br: The bridge
+ * @p:  The port
+ */
+void brnana_mcast_del_port(struct brnana_if *br, struct brnana_port_if *p);
+
+/**
+ * brnana_mcast_snooping_set - Turn IGMP/MLD snooping on or off
+ * @br: The bridge
+ * @on: The new state
+ */
+void brnana_mcast_snooping_set(struct brnana_if *br, bool on);
+
+/**
+ * brnana_mcast_rcv - Snoop a multicast frame and find where it must go
+ * @br:  The bridge
+ * @p:   Ingress port, NULL for frames sent by the bridge device
+ * @skb: The frame, with skb->data pointing at the network header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Return: The entry restricting the ports the frame goes to, or NULL if it
+ * must be flooded.
+ */
+const struct brnana_mdb_entry *brnana_mcast_rcv(struct brnana_if *br,
+                                                struct brnana_port_if *p,
+                                                struct sk_buff *skb,
+                                                u16 vid);
+
+/**
+ * brnana_mcast_wants - Check whether a port takes a multicast frame
+ * @mdst: Entry returned by brnana_mcast_rcv(), NULL to flood
+ * @p:    The candidate egress port
+ *
+ * Multicast routers get every group, they forward it further.
+ *
+ * Return: true if the frame goes out on @p.
+ */
+static inline bool brnana_mcast_wants(const struct brnana_mdb_entry *mdst,
+                                      const struct brnana_port_if *p)
+{
+    unsigned long mrouter = READ_ONCE(p->mrouter_expires);
+
+    return !mdst || test_bit(p->port_no, mdst->ports) ||
+           (mrouter && time_before(jiffies, mrouter));
+}
+
+/**
+ * brnana_mdb_dump - ndo_mdb_dump callback (`bridge mdb show`)
+ * @dev: The bridge
+ * @skb: The dump being filled
+ * @cb:  Dump state; cb->args[1] is the next entry to emit
+ *
+ * Return: 0 when done with @dev, -EMSGSIZE to be called again.
+ */
+int brnana_mdb_dump(struct net_device *dev,
+                    struct sk_buff *skb,
+                    struct netlink_callback *cb);
+
+/* brnana_neigh.c */
+
+/**
+ * brnana_neigh_init - Initialize the ARP/ND suppression state of a bridge
+ * @br: The bridge
+ */
+void brnana_neigh_init(struct brnana_if *br);
+
+/**
+ * brnana_neigh_open - Start expiring neighbor entries of a bridge
+ * @br: The bridge
+ */
+void brnana_neigh_open(struct brnana_if *br);
+
+/**
+ * brnana_neigh_stop - Stop expiring neighbor entries of a bridge
+ * @br: The bridge
+ */
+void brnana_neigh_stop(struct brnana_if *br);
+
+/**
+ * brnana_neigh_flush - Forget every neighbor entry of a bridge
+ * @br: The bridge
+ */
+void brnana_neigh_flush(struct brnana_if *br);
+
+/**
+ * brnana_neigh_suppress_set - Turn ARP/ND suppression on or off
+ * @br: The bridge
+ * @on: The new state
+ */
+void brnana_neigh_suppress_set(struct brnana_if *br, bool on);
+
+/**
+ * brnana_neigh_rcv - Learn from ARP/NDISC and answer requests for known hosts
+ * @br:  The bridge
+ * @p:   The ingress port
+ * @skb: The frame, with skb->data pointing at the network header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Return: true if a reply was sent on @p and @skb must not be flooded.
+ */
+bool brnana_neigh_rcv(struct brnana_if *br,
+                      struct brnana_port_if *p,
+                      struct sk_buff *skb,
+                      u16 vid);
+
+/* brnana_storm.c */
+
+/**
+ * brnana_storm_set - Set the storm control limit of a port
+ * @p:     The port
+ * @class: The class of flooded traffic
+ * @pps:   Packets per second, 0 for no limit
+ * @bps:   Bits per second, 0 for no limit
+ */
+void brnana_storm_set(struct brnana_port_if *p,
+                      enum brnana_storm_class class,
+                      u64 pps,
+                      u64 bps);
+
+/**
+ * __brnana_storm_exceeded - Charge a frame to this CPU's storm control bucket
+ * @p:     The ingress port
+ * @class: The class of the frame
+ * @len:   Length of the frame, with its Ethernet header
+ *
+ * Return: true if the frame is above the port's limit and must be dropped.
+ */
+bool __brnana_storm_exceeded(struct brnana_port_if *p,
+                             enum brnana_storm_class class,
+                             unsigned int len);
+
+/**
+ * brnana_storm_exceeded - Check a flooded frame against storm control
+ * @p:     The ingress port
+ * @class: The class of the frame
+ * @len:   Length of the frame, with its Ethernet header
+ *
+ * Costs a single test when the port has no limit for @class.
+ *
+ * Return: true if the frame is above the port's limit and must be dropped.
+ */
+static inline bool brnana_storm_exceeded(struct brnana_port_if *p,
+                                         enum brnana_storm_class class,
+                                         unsigned int len)
+{
+    if (likely(!(READ_ONCE(p->storm_mask) & BIT(class))))
+        return false;
+
+    return __brnana_storm_exceeded(p, class, len);
+}
+
+/* brnana_qos.c */
+
+/**
+ * brnana_qos_init - Set a bridge's default QoS maps
+ * @br: The bridge
+ */
+void brnana_qos_init(struct brnana_if *br);
+
+/**
+ * brnana_qos_trust_set - Prioritize forwarded frames by a marking, or stop
+ * @br:    The bridge
+ * @trust: The marking
+ * @on:    Whether it is used
+ */
+void brnana_qos_trust_set(struct brnana_if *br,
+                          enum brnana_qos_trust trust,
+                          bool on);
+
+/**
+ * brnana_qos_map_set - Change entries of a QoS map
+ * @br:    The bridge
+ * @trust: The marking whose map changes
+ * @map:   New priority per value, BRNANA_QOS_KEEP for entries left as is
+ */
+void brnana_qos_map_set(struct brnana_if *br,
+                        enum brnana_qos_trust trust,
+                        const u8 *map);
+
+/**
+ * __brnana_qos_classify - Set a frame's priority from its marking
+ * @br:    The bridge
+ * @skb:   The frame, with skb->data pointing at the network header
+ * @trust: Bit per enum brnana_qos_trust in use, not 0
+ */
+void __brnana_qos_classify(const struct brnana_if *br,
+                           struct sk_buff *skb,
+                           unsigned long trust);
+
+/**
+ * brnana_qos_classify - Set a received frame's egress priority
+ * @br:  The bridge
+ * @skb: The frame, with skb->data pointing at the network header
+ *
+ * Costs a single test when the bridge trusts no marking.
+ */
+static inline void brnana_qos_classify(const struct brnana_if *br,
+                                       struct sk_buff *skb)
+{
+    unsigned long trust = READ_ONCE(br->qos.trust);
+
+    if (likely(!trust))
+        return;
+
+    __brnana_qos_classify(br, skb, trust);
+}
+
+/* brnana_lat.c */
+
+/** Enabled while latency histograms are recorded */
+DECLARE_STATIC_KEY_FALSE(brnana_lat_key);
+
+/**
+ * brnana_lat_init - Create /sys/kernel/debug/brnana/
+ */
+void __init brnana_lat_init(void);
+
+/**
+ * brnana_lat_exit - Remove /sys/kernel/debug/brnana/
+ */
+void brnana_lat_exit(void);
+
+/**
+ * brnana_lat_add - Create the debugfs directory of a bridge
+ * @br: The bridge
+ */
+void brnana_lat_add(struct brnana_if *br);
+
+/**
+ * brnana_lat_del - Remove the debugfs directory of a bridge
+ * @br: The bridge
+ */
+void brnana_lat_del(struct brnana_if *br);
+
+/**
+ * __brnana_lat_record - Account a stamped frame handed off by a bridge
+ * @br:   The bridge
+ * @skb:  The frame
+ * @path: How it left the bridge
+ */
+void __brnana_lat_record(struct brnana_if *br,
+                         struct sk_buff *skb,
+                         enum brnana_lat_path path);
+
+/**
+ * __brnana_lat_xmit - Account a stamped frame handed to its egress port
+ * @skb: The frame, skb->dev being the egress port
+ */
+void __brnana_lat_xmit(struct sk_buff *skb);
+
+/**
+ * brnana_lat_stamp - Note when a frame entered the bridge
+ * @skb: The frame, not shared
+ *
+ * The frame counts as forwarded until brnana_lat_mark() says otherwise.
+ */
+static inline void brnana_lat_stamp(struct sk_buff *skb)
+{
+    struct brnana_skb_cb *cb = BRNANA_SKB_CB(skb);
+
+    if (!static_branch_unlikely(&brnana_lat_key))
+        return;
+
+    cb->rx_ns = ktime_get_mono_fast_ns();
+    cb->cookie = BRNANA_LAT_COOKIE;
+    cb->path = BRNANA_LAT_FORWARD;
+}
+
+/**
+ * brnana_lat_mark - Note how a stamped frame leaves the bridge
+ * @skb:  The frame, before it is cloned
+ * @path: The path
+ */
+static inline void brnana_lat_mark(struct sk_buff *skb,
+                                   enum brnana_lat_path path)
+{
+    if (static_branch_unlikely(&brnana_lat_key))
+        BRNANA_SKB_CB(skb)->path = path;
+}
+
+/**
+ * brnana_lat_local - Account a frame delivered to the bridge device
+ * @br:  The bridge
+ * @skb: The frame
+ */
+static inline void brnana_lat_local(struct brnana_if *br, struct sk_buff *skb)
+{
+    if (static_branch_unlikely(&brnana_lat_key))
+        __brnana_lat_record(br, skb, BRNANA_LAT_LOCAL);
+}
+
+/**
+ * brnana_lat_xmit - Account a frame handed to its egress port
+ * @skb: The frame, skb->dev being the egress port
+ */
+static inline void brnana_lat_xmit(struct sk_buff *skb)
+{
+    if (static_branch_unlikely(&brnana_lat_key))
+        __brnana_lat_xmit(skb);
+}
+
+/* brnana_sysfs.c */
+
+/** Attributes under /sys/class/net/<bridge>/brnana/ */
+extern const struct attribute_group brnana_group;
+
+/** Attributes under /sys/class/net/<port>/brnana_port/ */
+extern const struct attribute_group brnana_port_group;
+
+/* brnana_xdp.c */
+
+#if IS_ENABLED(CONFIG_BPF_SYSCALL)
+/**
+ * brnana_xdp_init - Register the brnana kfuncs for XDP programs
+ */
+void brnana_xdp_init(void);
+#else
+static inline void brnana_xdp_init(void) {}
+#endif
+
+#endif /* _BRNANA_H */
@@ -0,0 +1,712 @@
+/**
+ * @file brnana_core.h
+ * @brief Forwarding core of brnana, shared by the module and by userspace
+ *
+ * The MAC learning table, its per-CPU cache, the classification of received
+ * frames and the parsers of the headers the bridge looks into only need
+ * lists, RCU, a spinlock, a hash and byte buffers. This header and
+ * brnana_fdb_core.c use nothing else, so they build against the kernel
+ * headers for the module and against user/brnana_shim.h for the userspace
+ * library the microbenchmarks and fuzz targets under user/ link against.
+ *
+ * The core knows nothing of net_devices or skbs: parsers take the bytes the
+ * caller made linear, ports are the struct
+ * brnana_fdb_port the module embeds in its own struct brnana_port_if, and
+ * the few things only the host can do (allocate, free after a grace period,
+ * trace) are the brnana_fdb_host_*() hooks each side implements.
+ */
+
+#ifndef _BRNANA_CORE_H
+#define _BRNANA_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/etherdevice.h>
+#include <linux/hash.h>
+#include <linux/if_arp.h>
+#include <linux/if_vlan.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <net/ndisc.h>
+#include <asm/unaligned.h>
+#else
+#include "user/brnana_shim.h"
+#endif
+
+/**
+ * Bounds of the number of buckets of a forwarding database, which is sized
+ * for BRNANA_FDB_LOAD entries per bucket once full, see brnana_fdb_resize()
+ */
+#define BRNANA_FDB_HASH_MIN_BITS 6
+#define BRNANA_FDB_HASH_MAX_BITS 19
+#define BRNANA_FDB_LOAD 2
+
+/** Default and upper bound of the number of learned entries per bridge */
+#define BRNANA_FDB_MAX_DEFAULT 8192
+#define BRNANA_FDB_MAX_LIMIT (1 << 19)
+
+/** Upper bound of the number of static entries per bridge */
+#define BRNANA_FDB_STATIC_MAX (1 << 19)
+
+/**
+ * Sets and ways of each CPU's forwarding cache, see __brnana_fdb_dst_rcu():
+ * room for a few hundred active destinations per CPU
+ */
+#define BRNANA_FCACHE_BITS 8
+#define BRNANA_FCACHE_SIZE (1 << BRNANA_FCACHE_BITS)
+#define BRNANA_FCACHE_WAYS 2
+
+/** Default and upper bound of the time an unseen address is remembered */
+#define BRNANA_FDB_AGEING_DEFAULT (300 * HZ)
+#define BRNANA_FDB_AGEING_MAX (1000000UL * HZ)
+
+/**
+ * Calls of brnana_fdb_gc_slice() per pass over a table, whatever its size,
+ * and buckets it examines per hold of the hash_lock
+ */
+#define BRNANA_FDB_GC_PASS 64
+#define BRNANA_FDB_GC_SLICE 64
+
+/**
+ * Bytes brnana_arp_parse() and brnana_nd_parse() read: an Ethernet/IPv4 ARP
+ * packet, an IPv6 header and the fixed part of an NS/NA
+ */
+#define BRNANA_ARP_LEN 28
+#define BRNANA_ND_LEN (40 + 24)
+
+/** Flags of brnana_fdb_insert(), as NLM_F_CREATE and NLM_F_EXCL */
+#define BRNANA_FDB_CREATE BIT(0)
+#define BRNANA_FDB_EXCL BIT(1)
+
+/**
+ * struct brnana_fdb_port - What the FDB keeps about a port
+ * @lru:       Entries learned on the port, least recently queued first
+ * @statics:   Static entries pointing to the port
+ * @n_learned: Number of entries on @lru
+ *
+ * Protected by the table's hash_lock.
+ */
+struct brnana_fdb_port {
+    struct list_head lru;
+    struct list_head statics;
+    unsigned int n_learned;
+};
+
+/**
+ * struct brnana_fdb_entry - A learned or configured MAC address
+ * @hlist:   Links in a bucket of the table, and of the one replacing it
+ *           while it is resized: see struct brnana_fdb_table
+ * @dst:     Port the address was last seen on
+ * @addr:    The MAC address
+ * @vid:     VLAN the address was learned in, 0 without VLAN filtering
+ * @is_static: Configured over netlink, never aged, evicted nor moved
+ * @updated: When the address was last seen, see brnana_fdb_now()
+ * @queued:  When the entry was (re)queued on the LRU lists
+ * @lru:     Link in the table's lru, unused if @is_static
+ * @port_lru: Link in @dst's lru, or statics if @is_static
+ * @rcu:     Deferred free once readers are done
+ *
+ * Entries are keyed by (@addr, @vid): the same host may sit behind
+ * different ports in different VLANs. @dst and @updated are written without
+ * the hash_lock on the learning fast path, so they are accessed with
+ * READ_ONCE()/WRITE_ONCE(). The rest is only written under the hash_lock.
+ */
+struct brnana_fdb_entry {
+    struct hlist_node hlist[2];
+    struct brnana_fdb_port *dst;
+    unsigned char addr[ETH_ALEN];
+    u16 vid;
+    bool is_static;
+    unsigned long updated;
+    unsigned long queued;
+    struct list_head lru;
+    struct list_head port_lru;
+    struct rcu_head rcu;
+};
+
+/**
+ * struct brnana_fcache_slot - An FDB answer cached by one CPU
+ * @addr: The destination MAC address
+ * @vid:  Its VLAN
+ * @gen:  The table's fcache_gen when the answer was cached
+ * @dst:  The port the FDB had for (@addr, @vid)
+ */
+struct brnana_fcache_slot {
+    unsigned char addr[ETH_ALEN];
+    u16 vid;
+    unsigned int gen;
+    struct brnana_fdb_port *dst;
+};
+
+/**
+ * struct brnana_fcache_set - Slots a (MAC address, VLAN) pair may be in
+ * @way: The slots, most recently filled first
+ */
+struct brnana_fcache_set {
+    struct brnana_fcache_slot way[BRNANA_FCACHE_WAYS];
+};
+
+/**
+ * struct brnana_fcache - One CPU's set-associative forwarding cache
+ * @set: Sets indexed by a hash of (MAC address, VLAN)
+ *
+ * Only read and written by its own CPU from the forwarding path, with BH
+ * disabled, so it needs no lock.
+ */
+struct brnana_fcache {
+    struct brnana_fcache_set set[BRNANA_FCACHE_SIZE];
+};
+
+/**
+ * struct brnana_fdb_table - Buckets of a forwarding database
+ * @bits: log2 of the number of buckets
+ * @node: Which of each entry's two hlist nodes links it in @hash
+ * @hash: Buckets of MAC addresses (struct brnana_fdb_entry)
+ *
+ * A resize links every entry in a new table through its other node while
+ * lookups keep walking this one, then publishes the new table at once.
+ */
+struct brnana_fdb_table {
+    unsigned int bits;
+    unsigned int node;
+    struct hlist_head hash[];
+};
+
+/**
+ * struct brnana_fdb - A bridge's forwarding database
+ * @hash_lock:   Serializes writers of the buckets, @lru and the counters
+ *               (readers use RCU)
+ * @hash_seed:   Random seed of the hash, so that colliding addresses cannot
+ *               be precomputed
+ * @tbl:         The buckets lookups walk
+ * @future:      The buckets replacing @tbl while it is resized, else NULL
+ * @resize_next: First bucket of @tbl whose entries are not yet in @future
+ * @lru:         Learned entries, least recently queued first
+ * @n_learned:   Number of entries on @lru
+ * @n_static:    Number of static entries, which are on no @lru
+ * @max_learned: Bound of @n_learned
+ * @port_max_learned: Bound of each port's n_learned, 0 if none
+ * @ageing_time: jiffies after which an unseen address is forgotten, 0 to
+ *               remember addresses until evicted
+ * @gc_next:     First bucket the next brnana_fdb_gc_slice() examines
+ * @fcache:      Per-CPU cache of answers in front of @tbl, allocated by the
+ *               host
+ * @fcache_gen:  Bumped whenever an entry of @tbl goes away or moves, which
+ *               invalidates every slot of @fcache at once
+ */
+struct brnana_fdb {
+    spinlock_t hash_lock;
+    u32 hash_seed;
+    struct brnana_fdb_table __rcu *tbl;
+    struct brnana_fdb_table *future;
+    unsigned int resize_next;
+    struct list_head lru;
+    unsigned int n_learned;
+    unsigned int n_static;
+    unsigned int max_learned;
+    unsigned int port_max_learned;
+    unsigned long ageing_time;
+    unsigned int gc_next;
+    struct brnana_fcache __percpu *fcache;
+    atomic_t fcache_gen ____cacheline_aligned_in_smp;
+};
+
+/**
+ * enum brnana_fwd - Where a frame goes, by its destination address
+ * @BRNANA_FWD_UNICAST: To the port the FDB has for it, flooded if unknown
+ * @BRNANA_FWD_LOCAL:   To the bridge device itself
+ * @BRNANA_FWD_MCAST:   Flooded, restricted to the listeners if snooped
+ * @BRNANA_FWD_BCAST:   Flooded, and to the bridge device
+ */
+enum brnana_fwd {
+    BRNANA_FWD_UNICAST,
+    BRNANA_FWD_LOCAL,
+    BRNANA_FWD_MCAST,
+    BRNANA_FWD_BCAST,
+};
+
+/**
+ * enum brnana_vlan_tag - What VLAN filtering makes of a frame's outer tag
+ * @BRNANA_VLAN_UNTAGGED: No 802.1Q tag, the frame belongs to the PVID; an
+ *                        802.1ad tag is payload
+ * @BRNANA_VLAN_PRIO:     Priority-tagged (VID 0): the PVID, with the PCP
+ * @BRNANA_VLAN_TAGGED:   The VLAN of the tag
+ */
+enum brnana_vlan_tag {
+    BRNANA_VLAN_UNTAGGED,
+    BRNANA_VLAN_PRIO,
+    BRNANA_VLAN_TAGGED,
+};
+
+/**
+ * struct brnana_arp - Fields of an Ethernet/IPv4 ARP request or reply
+ * @op:  ARPOP_REQUEST or ARPOP_REPLY
+ * @sha: Sender MAC address, inside the packet
+ * @sip: Sender IPv4 address
+ * @tip: Target IPv4 address
+ */
+struct brnana_arp {
+    u16 op;
+    const unsigned char *sha;
+    __be32 sip;
+    __be32 tip;
+};
+
+/**
+ * struct brnana_nd - Fields of a neighbor solicitation or advertisement
+ * @type:   NDISC_NEIGHBOUR_SOLICITATION or NDISC_NEIGHBOUR_ADVERTISEMENT
+ * @saddr:  IPv6 source address, 16 bytes inside the packet
+ * @target: Target address, 16 bytes inside the packet
+ */
+struct brnana_nd {
+    u8 type;
+    const u8 *saddr;
+    const u8 *target;
+};
+
+/**
+ * struct brnana_grec - A group record of an IGMPv3 or MLDv2 report
+ * @type:  IGMPV3_MODE_IS_INCLUDE..IGMPV3_BLOCK_OLD_SOURCES, the MLDv2 record
+ *         types have the same values
+ * @nsrcs: Number of sources listed after the group
+ * @group: The group address, 4 or 16 bytes
+ */
+struct brnana_grec {
+    u8 type;
+    u16 nsrcs;
+    const void *group;
+};
+
+/**
+ * brnana_mac_hash - Hash a (MAC address, VLAN) pair
+ * @fdb:  The table
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Return: The hash, whose low bits index the buckets, see brnana_fdb_bucket().
+ */
+static inline u32 brnana_mac_hash(const struct brnana_fdb *fdb,
+                                  const unsigned char *addr,
+                                  u16 vid)
+{
+    return jhash(addr, ETH_ALEN, fdb->hash_seed ^ vid);
+}
+
+/**
+ * brnana_fdb_bucket - Find the bucket of a hash
+ * @tbl:  The buckets
+ * @hash: The hash, see brnana_mac_hash()
+ *
+ * Return: The bucket.
+ */
+static inline struct hlist_head *brnana_fdb_bucket(struct brnana_fdb_table *tbl,
+                                                   u32 hash)
+{
+    return &tbl->hash[hash & ((1U << tbl->bits) - 1)];
+}
+
+/**
+ * brnana_fdb_match - Check whether an entry is the one for (@addr, @vid)
+ * @f:    The entry
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Return: true on a match.
+ */
+static inline bool brnana_fdb_match(const struct brnana_fdb_entry *f,
+                                    const unsigned char *addr,
+                                    u16 vid)
+{
+    return f->vid == vid && ether_addr_equal(f->addr, addr);
+}
+
+/**
+ * brnana_fdb_find_rcu - Look up an address locklessly
+ * @fdb:  The table
+ * @addr: The MAC address
+ * @vid:  The VLAN, 0 without VLAN filtering
+ *
+ * Must be called under rcu_read_lock(). The returned entry stays valid until
+ * the read-side section ends.
+ *
+ * Return: The matching entry, or NULL.
+ */
+static inline struct brnana_fdb_entry *brnana_fdb_find_rcu(
+    struct brnana_fdb *fdb, const unsigned char *addr, u16 vid)
+{
+    struct brnana_fdb_table *tbl = rcu_dereference(fdb->tbl);
+    struct hlist_head *head;
+    struct brnana_fdb_entry *f;
+
+    head = brnana_fdb_bucket(tbl, brnana_mac_hash(fdb, addr, vid));
+    hlist_for_each_entry_rcu (f, head, hlist[tbl->node]) {
+        if (brnana_fdb_match(f, addr, vid))
+            return f;
+    }
+
+    return NULL;
+}
+
+/**
+ * brnana_fcache_hash - Hash a (MAC address, VLAN) pair into a cache set
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Cheaper than brnana_mac_hash(): a collision only costs a miss, and the
+ * slot content cannot be chosen by a remote host to cost anything more.
+ *
+ * Return: A set index in [0, BRNANA_FCACHE_SIZE).
+ */
+static inline u32 brnana_fcache_hash(const unsigned char *addr, u16 vid)
+{
+    /* The last four bytes of a MAC address are the most random ones */
+    return hash_32(get_unaligned((const u32 *) (addr + 2)) ^ vid,
+                   BRNANA_FCACHE_BITS);
+}
+
+/**
+ * __brnana_fdb_dst_rcu - Find the port a destination address was learned on
+ * @fdb:  The table
+ * @addr: The MAC address
+ * @vid:  The VLAN, 0 without VLAN filtering
+ * @hit:  Set to whether this CPU's cache had the answer
+ *
+ * A hit costs one access to this CPU's cache and no walk of the shared hash
+ * table. A miss fills the first way of the pair's set and evicts the last,
+ * so a pair colliding with a busy one does not keep displacing it. Must be
+ * called under rcu_read_lock() with BH disabled.
+ *
+ * Return: The port, or NULL if the address is unknown.
+ */
+static inline struct brnana_fdb_port *__brnana_fdb_dst_rcu(
+    struct brnana_fdb *fdb, const unsigned char *addr, u16 vid, bool *hit)
+{
+    unsigned int gen = atomic_read_acquire(&fdb->fcache_gen);
+    struct brnana_fcache_set *set;
+    struct brnana_fcache_slot *s;
+    struct brnana_fdb_entry *f;
+
+    set = &this_cpu_ptr(fdb->fcache)->set[brnana_fcache_hash(addr, vid)];
+    for (int i = 0; i < BRNANA_FCACHE_WAYS; ++i) {
+        s = &set->way[i];
+        *hit = s->gen == gen && s->dst && s->vid == vid &&
+               ether_addr_equal(s->addr, addr);
+        if (likely(*hit))
+            return s->dst;
+    }
+
+    f = brnana_fdb_find_rcu(fdb, addr, vid);
+    if (!f)
+        return NULL;
+
+    for (int i = BRNANA_FCACHE_WAYS - 1; i > 0; --i)
+        set->way[i] = set->way[i - 1];
+    s = &set->way[0];
+
+    /**
+     * @gen was read before the lookup: should @f go away or move from now
+     * on, the slot is stale before anybody can hit it.
+     */
+    ether_addr_copy(s->addr, addr);
+    s->vid = vid;
+    s->gen = gen;
+    s->dst = READ_ONCE(f->dst);
+
+    return s->dst;
+}
+
+/**
+ * brnana_fdb_port_init - Initialize what the FDB keeps about a new port
+ * @fp: The port's FDB state
+ */
+static inline void brnana_fdb_port_init(struct brnana_fdb_port *fp)
+{
+    INIT_LIST_HEAD(&fp->lru);
+    INIT_LIST_HEAD(&fp->statics);
+    fp->n_learned = 0;
+}
+
+/**
+ * brnana_grec_next - Parse the next group record of an IGMPv3/MLDv2 report
+ * @recs:      The records, following the report header
+ * @len:       Length of @recs
+ * @off:       Offset of the record to parse, advanced past it
+ * @group_len: Length of an address: 4 for IGMPv3, 16 for MLDv2
+ * @rec:       Output
+ *
+ * Both protocols lay a record out the same way: type, auxiliary data length
+ * in 32-bit words, number of sources, group address, then the sources and
+ * the auxiliary data. A record not entirely within @len is not returned.
+ *
+ * Return: true if @rec was filled, false at the end of @recs.
+ */
+static inline bool brnana_grec_next(const u8 *recs,
+                                    size_t len,
+                                    size_t *off,
+                                    size_t group_len,
+                                    struct brnana_grec *rec)
+{
+    const u8 *r = recs + *off;
+    size_t rec_len;
+
+    if (*off > len || len - *off < 4 + group_len)
+        return false;
+
+    rec->type = r[0];
+    rec->nsrcs = get_unaligned_be16(r + 2);
+    rec->group = r + 4;
+
+    rec_len = 4 + group_len + (size_t) rec->nsrcs * group_len + r[1] * 4;
+    if (len - *off < rec_len)
+        return false;
+
+    *off += rec_len;
+    return true;
+}
+
+/**
+ * brnana_fwd_classify - Decide where a frame goes by its destination
+ * @dest:  The destination MAC address
+ * @local: The bridge device's MAC address
+ *
+ * Return: The frame's enum brnana_fwd.
+ */
+static inline enum brnana_fwd brnana_fwd_classify(const unsigned char *dest,
+                                                  const unsigned char *local)
+{
+    if (is_multicast_ether_addr(dest))
+        return is_broadcast_ether_addr(dest) ? BRNANA_FWD_BCAST
+                                             : BRNANA_FWD_MCAST;
+    if (ether_addr_equal(dest, local))
+        return BRNANA_FWD_LOCAL;
+    return BRNANA_FWD_UNICAST;
+}
+
+/**
+ * brnana_vlan_classify - Classify a frame's outer tag for VLAN filtering
+ * @tpid: The tag's protocol in host order, 0 if the frame is untagged
+ * @tci:  The tag's control information, 0 if untagged
+ *
+ * Return: The frame's enum brnana_vlan_tag.
+ */
+static inline enum brnana_vlan_tag brnana_vlan_classify(u16 tpid, u16 tci)
+{
+    if (tpid != ETH_P_8021Q)
+        return BRNANA_VLAN_UNTAGGED;
+    return tci & VLAN_VID_MASK ? BRNANA_VLAN_TAGGED : BRNANA_VLAN_PRIO;
+}
+
+/**
+ * brnana_dscp - Read the DSCP of an IP packet
+ * @proto: The ethertype in host order
+ * @hdr:   The first two bytes of the network header
+ *
+ * Version and IHL, then the TOS byte for IPv4; version, then the traffic
+ * class across the nibble boundary for IPv6.
+ *
+ * Return: The DSCP, or -1 if @proto is neither IPv4 nor IPv6.
+ */
+static inline int brnana_dscp(u16 proto, const u8 *hdr)
+{
+    if (proto == ETH_P_IP)
+        return hdr[1] >> 2;
+    if (proto == ETH_P_IPV6)
+        return ((hdr[0] & 0xf) << 4 | hdr[1] >> 4) >> 2;
+    return -1;
+}
+
+/**
+ * brnana_arp_parse - Extract the fields of an ARP packet
+ * @data: The ARP header
+ * @len:  Bytes available at @data
+ * @arp:  Output
+ *
+ * Only requests and replies resolving IPv4 over Ethernet are returned.
+ *
+ * Return: true if @arp was filled.
+ */
+static inline bool brnana_arp_parse(const u8 *data,
+                                    size_t len,
+                                    struct brnana_arp *arp)
+{
+    /* sha, sip, tha, tip follow the fixed header */
+    if (len < BRNANA_ARP_LEN || get_unaligned_be16(data) != ARPHRD_ETHER ||
+        get_unaligned_be16(data + 2) != ETH_P_IP || data[4] != ETH_ALEN ||
+        data[5] != sizeof(__be32))
+        return false;
+
+    arp->op = get_unaligned_be16(data + 6);
+    if (arp->op != ARPOP_REQUEST && arp->op != ARPOP_REPLY)
+        return false;
+
+    arp->sha = data + 8;
+    memcpy(&arp->sip, data + 8 + ETH_ALEN, sizeof(arp->sip));
+    memcpy(&arp->tip, data + 8 + 2 * ETH_ALEN + sizeof(arp->sip),
+           sizeof(arp->tip));
+    return true;
+}
+
+/**
+ * brnana_nd_parse - Extract the fields of a neighbor solicitation or advert
+ * @data: The IPv6 header
+ * @len:  Bytes available at @data
+ * @nd:   Output
+ *
+ * NDISC is only valid from on-link senders (hop limit 255), without
+ * extension headers, and never targets a multicast address.
+ *
+ * Return: true if @nd was filled.
+ */
+static inline bool brnana_nd_parse(const u8 *data,
+                                   size_t len,
+                                   struct brnana_nd *nd)
+{
+    const u8 *icmp = data + 40;
+
+    if (len < BRNANA_ND_LEN || data[6] != IPPROTO_ICMPV6 || data[7] != 255 ||
+        get_unaligned_be16(data + 4) < BRNANA_ND_LEN - 40 || icmp[1])
+        return false;
+
+    nd->type = icmp[0];
+    if (nd->type != NDISC_NEIGHBOUR_SOLICITATION &&
+        nd->type != NDISC_NEIGHBOUR_ADVERTISEMENT)
+        return false;
+
+    nd->saddr = data + 8;
+    nd->target = icmp + 8;
+    return nd->target[0] != 0xff;
+}
+
+/* brnana_fdb_core.c */
+
+/**
+ * brnana_fdb_host_alloc - Allocate an entry, provided by the host
+ * @gfp: Allocation flags
+ *
+ * Return: The entry, or NULL.
+ */
+struct brnana_fdb_entry *brnana_fdb_host_alloc(gfp_t gfp);
+
+/**
+ * brnana_fdb_host_free - Free an entry after a grace period, by the host
+ * @f: The entry, unhashed
+ */
+void brnana_fdb_host_free(struct brnana_fdb_entry *f);
+
+/**
+ * brnana_fdb_host_moved - Report a host moving, provided by the host
+ * @fdb: The table
+ * @f:   The entry, still pointing to the old port
+ * @to:  The new port
+ */
+void brnana_fdb_host_moved(struct brnana_fdb *fdb,
+                           const struct brnana_fdb_entry *f,
+                           struct brnana_fdb_port *to);
+
+/**
+ * brnana_fdb_core_init - Initialize a table and allocate its buckets
+ * @fdb: The table; @fdb->fcache is left to the caller
+ *
+ * Return: 0, or -ENOMEM.
+ */
+int brnana_fdb_core_init(struct brnana_fdb *fdb);
+
+/**
+ * brnana_fdb_core_destroy - Free the buckets of an empty table
+ * @fdb: The table
+ */
+void brnana_fdb_core_destroy(struct brnana_fdb *fdb);
+
+/**
+ * brnana_fdb_update - Learn the source address of a received frame
+ * @fdb:    The table
+ * @source: The port the frame arrived on
+ * @addr:   The frame's source MAC address
+ * @vid:    The frame's VLAN, 0 without VLAN filtering
+ */
+void brnana_fdb_update(struct brnana_fdb *fdb,
+                       struct brnana_fdb_port *source,
+                       const unsigned char *addr,
+                       u16 vid);
+
+/**
+ * brnana_fdb_insert - Configure the entry of an address
+ * @fdb:       The table
+ * @new:       Preallocated entry, set to NULL if it was used
+ * @dst:       The port the address lives behind
+ * @addr:      The MAC address
+ * @vid:       The VLAN
+ * @is_static: Add a static entry rather than a learned one
+ * @flags:     BRNANA_FDB_CREATE and/or BRNANA_FDB_EXCL
+ *
+ * Return: 0, -EEXIST, -ENOENT, -ENOSPC if there are too many static
+ * entries, or -ENOMEM.
+ */
+int brnana_fdb_insert(struct brnana_fdb *fdb,
+                      struct brnana_fdb_entry **new,
+                      struct brnana_fdb_port *dst,
+                      const unsigned char *addr,
+                      u16 vid,
+                      bool is_static,
+                      unsigned int flags);
+
+/**
+ * brnana_fdb_remove - Forget an address if it lives behind a port
+ * @fdb:  The table
+ * @dst:  The port
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Return: 0, or -ENOENT.
+ */
+int brnana_fdb_remove(struct brnana_fdb *fdb,
+                      struct brnana_fdb_port *dst,
+                      const unsigned char *addr,
+                      u16 vid);
+
+/**
+ * brnana_fdb_delete_match - Forget the addresses matching a port and VLAN
+ * @fdb:         The table
+ * @p:           Only entries pointing to this port, or NULL for any port
+ * @vid:         Only entries of this VLAN, or -1 for any VLAN
+ * @with_static: Also forget the static entries of @p
+ */
+void brnana_fdb_delete_match(struct brnana_fdb *fdb,
+                             struct brnana_fdb_port *p,
+                             int vid,
+                             bool with_static);
+
+/**
+ * brnana_fdb_sweep - Forget the entries matching a filter, bucket by bucket
+ * @fdb:     The table
+ * @p:       Only entries pointing to this port, or NULL for any port
+ * @vid:     Only entries of this VLAN, or -1 for any VLAN
+ * @learned: Forget learned entries
+ * @statics: Forget static entries
+ */
+void brnana_fdb_sweep(struct brnana_fdb *fdb,
+                      struct brnana_fdb_port *p,
+                      int vid,
+                      bool learned,
+                      bool statics);
+
+/**
+ * brnana_fdb_set_max_learned - Bound the number of learned entries
+ * @fdb:      The table
+ * @max:      Bound for the whole bridge, at least 1
+ * @port_max: Bound for each port, 0 for none
+ *
+ * Return: 0, -EINVAL if a bound is out of range, or -ENOMEM.
+ */
+int brnana_fdb_set_max_learned(struct brnana_fdb *fdb,
+                               unsigned int max,
+                               unsigned int port_max);
+
+/**
+ * brnana_fdb_gc_slice - Forget the unseen addresses of the next slice
+ * @fdb: The table
+ */
+void brnana_fdb_gc_slice(struct brnana_fdb *fdb);
+
+#endif /* _BRNANA_CORE_H */
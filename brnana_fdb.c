@@ -0,0 +1,586 @@
+/**
+ * @file brnana_fdb.c
+ * @brief MAC learning table (forwarding database) of the brnana bridge
+ *
+ * The table itself, learning, eviction and ageing live in
+ * brnana_fdb_core.c, which also builds in userspace. This file binds it to
+ * the kernel: entries come from a slab cache and are freed by RCU, and
+ * addresses not seen for the bridge's ageing time are forgotten by a
+ * deferrable work that examines a slice of buckets per run, so ageing a
+ * large table never holds the hash_lock for long nor wakes an idle CPU.
+ *
+ * Forwarding asks a small per-CPU cache first, which remembers the answers
+ * to recent lookups. Any entry going away or moving bumps a bridge-wide
+ * generation number, which invalidates every cached answer at once.
+ *
+ * Entries can also be added, removed and listed over netlink (`bridge fdb`).
+ * Static entries are configuration: they are neither aged, evicted nor
+ * moved by learning, and do not count against the learning bounds.
+ */
+#include <linux/neighbour.h>
+#include <linux/slab.h>
+#include <net/netlink.h>
+
+#include "brnana.h"
+#include "brnana_trace.h"
+
+/** Period of the ageing work, see brnana_fdb_gc_slice() */
+#define BRNANA_FDB_GC_INTERVAL (HZ / 10)
+
+/**
+ * Dump cursor, see brnana_fdb_dump(). cb->args[0..2] belong to
+ * rtnl_fdb_dump().
+ */
+#define BRNANA_FDB_DUMP_IFINDEX 3
+#define BRNANA_FDB_DUMP_BUCKET 4
+#define BRNANA_FDB_DUMP_IDX 5
+
+/** Slab cache all bridges allocate their entries from */
+static struct kmem_cache *brnana_fdb_cache __read_mostly;
+
+/**
+ * brnana_fdb_dst_rcu - Find the port a destination address was learned on
+ * @br:   The bridge
+ * @addr: The MAC address
+ * @vid:  The VLAN, 0 without VLAN filtering
+ *
+ * Asks this CPU's forwarding cache first, see __brnana_fdb_dst_rcu(). The
+ * cached port is only the FDB's answer: the caller still checks it against
+ * the ingress port, its carrier and its VLANs. Must be called under
+ * rcu_read_lock() with BH disabled.
+ *
+ * Return: The port, or NULL if the address is unknown.
+ */
+struct brnana_port_if *brnana_fdb_dst_rcu(struct brnana_if *br,
+                                          const unsigned char *addr,
+                                          u16 vid)
+{
+    struct brnana_fdb_port *dst;
+    bool hit;
+
+    dst = __brnana_fdb_dst_rcu(&br->fdb, addr, vid, &hit);
+    brnana_stats_add(br->stats,
+                     hit ? BRNANA_STAT_FCACHE_HIT : BRNANA_STAT_FCACHE_MISS, 1);
+
+    return dst ? brnana_fdb_port(dst) : NULL;
+}
+
+/**
+ * brnana_fdb_host_alloc - Allocate an entry from the slab cache
+ * @gfp: Allocation flags
+ *
+ * Return: The entry, or NULL.
+ */
+struct brnana_fdb_entry *brnana_fdb_host_alloc(gfp_t gfp)
+{
+    return kmem_cache_alloc(brnana_fdb_cache, gfp);
+}
+
+/**
+ * brnana_fdb_free_rcu - Return an entry to the slab cache
+ * @head: The entry's rcu_head
+ */
+static void brnana_fdb_free_rcu(struct rcu_head *head)
+{
+    kmem_cache_free(brnana_fdb_cache,
+                    container_of(head, struct brnana_fdb_entry, rcu));
+}
+
+/**
+ * brnana_fdb_host_free - Free an unhashed entry after a grace period
+ * @f: The entry
+ */
+void brnana_fdb_host_free(struct brnana_fdb_entry *f)
+{
+    call_rcu(&f->rcu, brnana_fdb_free_rcu);
+}
+
+/**
+ * brnana_fdb_host_moved - Trace a host moving to another port
+ * @fdb: The bridge's table
+ * @f:   The entry, still pointing to the old port
+ * @to:  The new port
+ */
+void brnana_fdb_host_moved(struct brnana_fdb *fdb,
+                           const struct brnana_fdb_entry *f,
+                           struct brnana_fdb_port *to)
+{
+    struct brnana_if *br = container_of(fdb, struct brnana_if, fdb);
+
+    trace_brnana_fdb_move(br->dev, f->addr, f->vid,
+                          brnana_fdb_port(f->dst)->dev,
+                          brnana_fdb_port(to)->dev);
+}
+
+/**
+ * brnana_fdb_delete_by_port - Forget every address of a port
+ * @br: The bridge
+ * @p:  The port being removed
+ *
+ * Static entries go too. Must be called before @p itself is freed.
+ */
+void brnana_fdb_delete_by_port(struct brnana_if *br,
+                               struct brnana_port_if *p)
+{
+    brnana_fdb_delete_match(&br->fdb, &p->fdb, -1, true);
+}
+
+/**
+ * brnana_fdb_delete_by_vlan - Forget the addresses learned on a port in a VLAN
+ * @br:  The bridge
+ * @p:   The port
+ * @vid: The VLAN the port left
+ *
+ * Hosts seen there are unknown again and get flooded within the VLAN,
+ * instead of being sent to a port that no longer carries it.
+ */
+void brnana_fdb_delete_by_vlan(struct brnana_if *br,
+                               struct brnana_port_if *p,
+                               u16 vid)
+{
+    brnana_fdb_delete_match(&br->fdb, &p->fdb, vid, false);
+}
+
+/**
+ * brnana_fdb_flush - Forget every learned address of a bridge
+ * @br: The bridge
+ *
+ * Used when entries can no longer match, e.g. when VLAN filtering is
+ * toggled and every frame's VLAN changes. Static entries are kept, which
+ * is why VLAN filtering cannot be toggled while there are any.
+ */
+void brnana_fdb_flush(struct brnana_if *br)
+{
+    brnana_fdb_delete_match(&br->fdb, NULL, -1, false);
+}
+
+/**
+ * brnana_fdb_check_vid - Validate the VLAN of a configured entry
+ * @br:     The bridge
+ * @p:      The port the entry points to
+ * @vid:    The VLAN, 0 if none was given
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Entries are keyed like the frames they match: by VLAN with filtering on,
+ * by VLAN 0 with it off.
+ *
+ * Return: 0 if @vid can be used, else -EINVAL.
+ */
+static int brnana_fdb_check_vid(const struct brnana_if *br,
+                                const struct brnana_port_if *p,
+                                u16 vid,
+                                struct netlink_ext_ack *extack)
+{
+    if (!br->vlan_enabled) {
+        if (vid) {
+            NL_SET_ERR_MSG(extack, "brnana: VLAN filtering is off");
+            return -EINVAL;
+        }
+        return 0;
+    }
+
+    if (!vid) {
+        NL_SET_ERR_MSG(extack, "brnana: VLAN filtering is on, give a VLAN");
+        return -EINVAL;
+    }
+    if (!test_bit(vid, p->vlans.vlan_bitmap)) {
+        NL_SET_ERR_MSG(extack, "brnana: port is not a member of the VLAN");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * brnana_fdb_add - ndo_fdb_add callback (`bridge fdb add/replace`)
+ * @ndm:    The request; ndm_state selects a static or a dynamic entry
+ * @tb:     Its attributes
+ * @dev:    The port the address lives behind, or the bridge itself
+ * @addr:   The MAC address
+ * @vid:    The VLAN, 0 if none was given
+ * @flags:  NLM_F_* flags of the request
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Entries added on the bridge device are its own secondary addresses, as
+ * for any other device. Permanent and static entries are added as static
+ * ones; dynamic entries are learned as if a frame had been received. The
+ * new entry is allocated beforehand and entered in a single pass under the
+ * hash_lock, so programming many entries never stalls forwarding for long.
+ * Called under RTNL.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_add(struct ndmsg *ndm,
+                   struct nlattr *tb[],
+                   struct net_device *dev,
+                   const unsigned char *addr,
+                   u16 vid,
+                   u16 flags,
+                   struct netlink_ext_ack *extack)
+{
+    bool is_static = ndm->ndm_state & (NUD_PERMANENT | NUD_NOARP);
+    unsigned int fdb_flags = 0;
+    struct brnana_fdb_entry *new;
+    struct brnana_port_if *p;
+    struct brnana_if *br;
+    int err;
+
+    if (brnana_dev_is_bridge(dev))
+        return ndo_dflt_fdb_add(ndm, tb, dev, addr, vid, flags);
+
+    p = brnana_port_get_rtnl(dev);
+    if (!p)
+        return -EINVAL;
+    br = p->br;
+
+    if (!(ndm->ndm_state & (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE))) {
+        NL_SET_ERR_MSG(extack, "brnana: entry must be static or dynamic");
+        return -EINVAL;
+    }
+    if (!is_valid_ether_addr(addr)) {
+        NL_SET_ERR_MSG(extack, "brnana: address must be a unicast address");
+        return -EINVAL;
+    }
+    err = brnana_fdb_check_vid(br, p, vid, extack);
+    if (err)
+        return err;
+
+    new = kmem_cache_alloc(brnana_fdb_cache, GFP_KERNEL);
+    if (!new)
+        return -ENOMEM;
+
+    if (flags & NLM_F_CREATE)
+        fdb_flags |= BRNANA_FDB_CREATE;
+    if (flags & NLM_F_EXCL)
+        fdb_flags |= BRNANA_FDB_EXCL;
+
+    err = brnana_fdb_insert(&br->fdb, &new, &p->fdb, addr, vid, is_static,
+                            fdb_flags);
+    if (err == -ENOSPC)
+        NL_SET_ERR_MSG(extack, "brnana: too many static entries");
+
+    if (new)
+        kmem_cache_free(brnana_fdb_cache, new);
+    return err;
+}
+
+/**
+ * brnana_fdb_del - ndo_fdb_del callback (`bridge fdb del`)
+ * @ndm:    The request
+ * @tb:     Its attributes
+ * @dev:    The port the address lives behind, or the bridge itself
+ * @addr:   The MAC address
+ * @vid:    The VLAN, 0 if none was given
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Static and learned entries alike can be deleted. Called under RTNL.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_del(struct ndmsg *ndm,
+                   struct nlattr *tb[],
+                   struct net_device *dev,
+                   const unsigned char *addr,
+                   u16 vid,
+                   struct netlink_ext_ack *extack)
+{
+    struct brnana_port_if *p;
+
+    if (brnana_dev_is_bridge(dev))
+        return ndo_dflt_fdb_del(ndm, tb, dev, addr, vid);
+
+    p = brnana_port_get_rtnl(dev);
+    if (!p)
+        return -EINVAL;
+
+    return brnana_fdb_remove(&p->br->fdb, &p->fdb, addr, vid);
+}
+
+/**
+ * brnana_fdb_del_bulk_policy - Filters accepted by brnana_fdb_del_bulk()
+ */
+static const struct nla_policy brnana_fdb_del_bulk_policy[NDA_MAX + 1] = {
+    [NDA_VLAN] = NLA_POLICY_RANGE(NLA_U16, 1, VLAN_N_VID - 2),
+    [NDA_IFINDEX] = NLA_POLICY_MIN(NLA_S32, 1),
+    [NDA_NDM_STATE_MASK] = { .type = NLA_U16 },
+};
+
+/**
+ * brnana_fdb_del_bulk - ndo_fdb_del_bulk callback (`bridge fdb flush`)
+ * @nlh:    The request
+ * @dev:    The bridge, or the port whose entries are flushed
+ * @extack: Extended netlink ack for reporting errors to user space
+ *
+ * Entries can be filtered by port (NDA_IFINDEX), by VLAN (NDA_VLAN) and by
+ * kind: with NUD_NOARP or NUD_PERMANENT in NDA_NDM_STATE_MASK, ndm_state
+ * selects static entries (bit set) or learned ones (bit clear). The table
+ * is swept one bucket at a time, see brnana_fdb_sweep(). Called under RTNL.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_fdb_del_bulk(struct nlmsghdr *nlh,
+                        struct net_device *dev,
+                        struct netlink_ext_ack *extack)
+{
+    struct ndmsg *ndm = nlmsg_data(nlh);
+    const u16 static_mask = NUD_PERMANENT | NUD_NOARP;
+    bool learned = true, statics = true;
+    struct nlattr *tb[NDA_MAX + 1];
+    struct brnana_port_if *p = NULL;
+    struct net_device *pdev;
+    struct brnana_if *br;
+    int vid = -1;
+    int err;
+
+    err = nlmsg_parse(nlh, sizeof(*ndm), tb, NDA_MAX,
+                      brnana_fdb_del_bulk_policy, extack);
+    if (err)
+        return err;
+
+    if (brnana_dev_is_bridge(dev)) {
+        br = dev_get_brnana_if(dev);
+    } else {
+        p = brnana_port_get_rtnl(dev);
+        if (!p)
+            return -EINVAL;
+        br = p->br;
+    }
+
+    if (tb[NDA_IFINDEX]) {
+        pdev = __dev_get_by_index(dev_net(dev), nla_get_s32(tb[NDA_IFINDEX]));
+        if (!pdev) {
+            NL_SET_ERR_MSG(extack, "brnana: unknown port");
+            return -ENODEV;
+        }
+        if (p && pdev != p->dev) {
+            NL_SET_ERR_MSG(extack, "brnana: flushing another port's entries");
+            return -EINVAL;
+        }
+        p = brnana_port_get_rtnl(pdev);
+        if (!p || p->br != br) {
+            NL_SET_ERR_MSG(extack, "brnana: not a port of this bridge");
+            return -EINVAL;
+        }
+    }
+    if (tb[NDA_VLAN])
+        vid = nla_get_u16(tb[NDA_VLAN]);
+    if (tb[NDA_NDM_STATE_MASK] &&
+        (nla_get_u16(tb[NDA_NDM_STATE_MASK]) & static_mask)) {
+        statics = ndm->ndm_state & static_mask;
+        learned = !statics;
+    }
+
+    brnana_fdb_sweep(&br->fdb, p ? &p->fdb : NULL, vid, learned, statics);
+    return 0;
+}
+
+/**
+ * brnana_fdb_fill - Put one entry in a dump
+ * @skb: The dump being filled
+ * @br:  The bridge
+ * @f:   The entry
+ * @cb:  Dump state
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_fdb_fill(struct sk_buff *skb,
+                           const struct brnana_if *br,
+                           const struct brnana_fdb_entry *f,
+                           struct netlink_callback *cb)
+{
+    unsigned long age = jiffies - READ_ONCE(f->updated);
+    struct nda_cacheinfo ci = {};
+    struct nlmsghdr *nlh;
+    struct ndmsg *ndm;
+
+    nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+                    RTM_NEWNEIGH, sizeof(*ndm), NLM_F_MULTI);
+    if (!nlh)
+        return -EMSGSIZE;
+
+    ndm = nlmsg_data(nlh);
+    memset(ndm, 0, sizeof(*ndm));
+    ndm->ndm_family = AF_BRIDGE;
+    ndm->ndm_flags = NTF_MASTER;
+    ndm->ndm_ifindex = brnana_fdb_port(READ_ONCE(f->dst))->dev->ifindex;
+    ndm->ndm_state = f->is_static ? NUD_NOARP : NUD_REACHABLE;
+
+    ci.ndm_used = jiffies_to_clock_t(age);
+    ci.ndm_updated = ci.ndm_used;
+
+    if (nla_put(skb, NDA_LLADDR, ETH_ALEN, f->addr) ||
+        nla_put_u32(skb, NDA_MASTER, br->dev->ifindex) ||
+        nla_put(skb, NDA_CACHEINFO, sizeof(ci), &ci) ||
+        (f->vid && nla_put_u16(skb, NDA_VLAN, f->vid))) {
+        nlmsg_cancel(skb, nlh);
+        return -EMSGSIZE;
+    }
+
+    nlmsg_end(skb, nlh);
+    return 0;
+}
+
+/**
+ * brnana_fdb_dump - ndo_fdb_dump callback (`bridge fdb show`)
+ * @skb:        The dump being filled
+ * @cb:         Dump state; cb->args[2] is the first index to emit
+ * @dev:        The bridge
+ * @filter_dev: The port whose entries are dumped, or NULL for the bridge's
+ *              own addresses
+ * @idx:        Index of the next entry, advanced past the ones walked
+ *
+ * rtnl_fdb_dump() calls this once per port. The hash table is walked under
+ * RCU only. When @skb fills up, the bucket being walked and the index of
+ * its first entry are kept in cb->args[], so the next call resumes at that
+ * bucket instead of skipping every entry emitted so far, which keeps a
+ * dump of a large table linear. Like any change between two calls, a
+ * resize of the table may repeat or skip entries.
+ *
+ * Return: 0 when done with @filter_dev, -EMSGSIZE to be called again.
+ */
+int brnana_fdb_dump(struct sk_buff *skb,
+                    struct netlink_callback *cb,
+                    struct net_device *dev,
+                    struct net_device *filter_dev,
+                    int *idx)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_fdb_table *tbl;
+    long *args = cb->args;
+    struct brnana_fdb_entry *f;
+    unsigned int start = 0;
+    int err = 0;
+    int base;
+
+    if (!filter_dev)
+        return ndo_dflt_fdb_dump(skb, cb, dev, NULL, idx);
+
+    /**
+     * The cursor is only valid for the port it was left at, and only if
+     * the dump resumes at or after the bucket it points to.
+     */
+    if (args[BRNANA_FDB_DUMP_IFINDEX] == filter_dev->ifindex &&
+        *idx <= args[BRNANA_FDB_DUMP_IDX] &&
+        args[BRNANA_FDB_DUMP_IDX] <= args[2]) {
+        start = args[BRNANA_FDB_DUMP_BUCKET];
+        *idx = args[BRNANA_FDB_DUMP_IDX];
+    }
+
+    rcu_read_lock();
+
+    tbl = rcu_dereference(br->fdb.tbl);
+    for (unsigned int i = start; i < 1U << tbl->bits; ++i) {
+        base = *idx;
+        hlist_for_each_entry_rcu (f, &tbl->hash[i], hlist[tbl->node]) {
+            if (brnana_fdb_port(READ_ONCE(f->dst))->dev != filter_dev)
+                continue;
+            if (*idx >= args[2]) {
+                err = brnana_fdb_fill(skb, br, f, cb);
+                if (err) {
+                    start = i;
+                    goto out;
+                }
+            }
+            ++*idx;
+        }
+    }
+
+    start = 1U << BRNANA_FDB_HASH_MAX_BITS;
+    base = *idx;
+out:
+    rcu_read_unlock();
+
+    args[BRNANA_FDB_DUMP_IFINDEX] = filter_dev->ifindex;
+    args[BRNANA_FDB_DUMP_BUCKET] = start;
+    args[BRNANA_FDB_DUMP_IDX] = base;
+
+    return err;
+}
+
+/**
+ * brnana_fdb_gc - Forget the addresses of one slice that were not seen
+ * @work: The bridge's fdb_gc work
+ *
+ * Runs every BRNANA_FDB_GC_INTERVAL while the bridge is up, each time on the
+ * next 1/BRNANA_FDB_GC_PASS of the buckets: a full pass over the table
+ * takes BRNANA_FDB_GC_PASS runs, about 6.4s, whatever its size.
+ */
+static void brnana_fdb_gc(struct work_struct *work)
+{
+    struct brnana_if *br = container_of(to_delayed_work(work),
+                                        struct brnana_if, fdb_gc);
+
+    brnana_fdb_gc_slice(&br->fdb);
+
+    queue_delayed_work(system_power_efficient_wq, &br->fdb_gc,
+                       BRNANA_FDB_GC_INTERVAL);
+}
+
+/**
+ * brnana_fdb_open - Start ageing the learned addresses of a bridge
+ * @br: The bridge
+ */
+void brnana_fdb_open(struct brnana_if *br)
+{
+    queue_delayed_work(system_power_efficient_wq, &br->fdb_gc,
+                       BRNANA_FDB_GC_INTERVAL);
+}
+
+/**
+ * brnana_fdb_stop - Stop ageing the learned addresses of a bridge
+ * @br: The bridge
+ *
+ * Learned addresses are kept while the bridge is down; the ones that got
+ * too old are forgotten once it is up again.
+ */
+void brnana_fdb_stop(struct brnana_if *br)
+{
+    cancel_delayed_work_sync(&br->fdb_gc);
+}
+
+/**
+ * brnana_fdb_init - Initialize the forwarding database of a bridge
+ * @br: The bridge
+ *
+ * Return: 0 on success, or -ENOMEM.
+ */
+int brnana_fdb_init(struct brnana_if *br)
+{
+    INIT_DEFERRABLE_WORK(&br->fdb_gc, brnana_fdb_gc);
+    return brnana_fdb_core_init(&br->fdb);
+}
+
+/**
+ * brnana_fdb_destroy - Free the forwarding database of a bridge
+ * @br: The bridge, without ports nor readers left
+ */
+void brnana_fdb_destroy(struct brnana_if *br)
+{
+    brnana_fdb_core_destroy(&br->fdb);
+}
+
+/**
+ * brnana_fdb_module_init - Create the slab cache of FDB entries
+ *
+ * Entries are cache line aligned, so refreshing one host's timestamp never
+ * invalidates the line another CPU is reading a different entry from.
+ *
+ * Return: 0 on success, or -ENOMEM.
+ */
+int __init brnana_fdb_module_init(void)
+{
+    brnana_fdb_cache = kmem_cache_create("brnana_fdb_cache",
+                                         sizeof(struct brnana_fdb_entry), 0,
+                                         SLAB_HWCACHE_ALIGN, NULL);
+    return brnana_fdb_cache ? 0 : -ENOMEM;
+}
+
+/**
+ * brnana_fdb_module_exit - Destroy the slab cache of FDB entries
+ *
+ * Pending brnana_fdb_free_rcu() callbacks must have run (rcu_barrier()).
+ */
+void brnana_fdb_module_exit(void)
+{
+    kmem_cache_destroy(brnana_fdb_cache);
+}
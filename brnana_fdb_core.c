@@ -0,0 +1,816 @@
+/**
+ * @file brnana_fdb_core.c
+ * @brief Learning, eviction and ageing of the forwarding database
+ *
+ * Each bridge owns a hash table of learned (MAC, VLAN) pairs. Lookups walk
+ * a bucket under RCU only. Learning takes the hash_lock only when an
+ * address is seen for the first time or has moved to another port;
+ * refreshing an existing entry is a plain store.
+ *
+ * The number of learned entries is bounded per bridge and, optionally, per
+ * port. A full table recycles its least recently used entry instead of
+ * growing, so a host spraying source addresses can neither exhaust memory
+ * nor lengthen the hash chains every lookup walks. The hash is seeded per
+ * bridge, so the addresses that collide cannot be chosen in advance.
+ *
+ * The buckets are sized from the bounds: when the learning bound or the
+ * number of static entries grows, the table is rehashed into more buckets
+ * while lookups carry on, see brnana_fdb_resize().
+ *
+ * Static entries are configuration: they are neither aged, evicted nor
+ * moved by learning, and do not count against the learning bounds.
+ *
+ * This file is built into the module and into the userspace library under
+ * user/, see brnana_core.h. brnana_fdb.c binds it to net_devices, netlink
+ * and the workqueue.
+ */
+#ifdef __KERNEL__
+#include <linux/log2.h>
+#include <linux/overflow.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#endif
+
+#include "brnana_core.h"
+
+/** Entries given a second chance before one is evicted regardless */
+#define BRNANA_FDB_EVICT_SCAN 8
+
+/** Resolution of entry timestamps, about 1/8s */
+#define BRNANA_FDB_TICK rounddown_pow_of_two(HZ / 8)
+
+/** A full table of the largest size still has BRNANA_FDB_LOAD per bucket */
+static_assert(BRNANA_FDB_MAX_LIMIT + BRNANA_FDB_STATIC_MAX <=
+              BRNANA_FDB_LOAD << BRNANA_FDB_HASH_MAX_BITS);
+
+/** Every call of brnana_fdb_gc_slice() examines whole slices */
+static_assert((1 << BRNANA_FDB_HASH_MIN_BITS) % BRNANA_FDB_GC_PASS == 0);
+
+/**
+ * brnana_fdb_now - Current time at the resolution of entry timestamps
+ *
+ * Ageing counts in seconds, so a timestamp precise to the jiffy only costs
+ * writes: a host sending at line rate from several CPUs would bounce its
+ * entry's cache line on every jiffy. Refreshes compare against this coarse
+ * clock and only store when it has ticked.
+ *
+ * Return: jiffies rounded down to a multiple of BRNANA_FDB_TICK.
+ */
+static inline unsigned long brnana_fdb_now(void)
+{
+    return jiffies & ~(unsigned long) (BRNANA_FDB_TICK - 1);
+}
+
+/**
+ * brnana_fdb_table - Get the buckets of a table under the hash_lock
+ * @fdb: The table
+ *
+ * Return: The buckets lookups walk.
+ */
+static inline struct brnana_fdb_table *brnana_fdb_table(struct brnana_fdb *fdb)
+{
+    return rcu_dereference_protected(fdb->tbl,
+                                     lockdep_is_held(&fdb->hash_lock));
+}
+
+/**
+ * brnana_fdb_table_alloc - Allocate empty buckets
+ * @bits: log2 of their number
+ *
+ * Return: The buckets, or NULL.
+ */
+static struct brnana_fdb_table *brnana_fdb_table_alloc(unsigned int bits)
+{
+    struct brnana_fdb_table *tbl;
+
+    tbl = kvzalloc(struct_size(tbl, hash, 1U << bits), GFP_KERNEL);
+    if (tbl)
+        tbl->bits = bits;
+    return tbl;
+}
+
+/**
+ * brnana_fdb_find - Look up an address under the hash_lock
+ * @fdb:  The table
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Return: The matching entry, or NULL.
+ */
+static struct brnana_fdb_entry *brnana_fdb_find(struct brnana_fdb *fdb,
+                                                const unsigned char *addr,
+                                                u16 vid)
+{
+    struct brnana_fdb_table *tbl = brnana_fdb_table(fdb);
+    struct brnana_fdb_entry *f;
+    struct hlist_head *head;
+
+    head = brnana_fdb_bucket(tbl, brnana_mac_hash(fdb, addr, vid));
+    hlist_for_each_entry (f, head, hlist[tbl->node]) {
+        if (brnana_fdb_match(f, addr, vid))
+            return f;
+    }
+
+    return NULL;
+}
+
+/**
+ * brnana_fcache_invalidate - Drop the cached answers of every CPU
+ * @fdb: The table
+ *
+ * Called after an entry was unhashed or changed port.
+ */
+static inline void brnana_fcache_invalidate(struct brnana_fdb *fdb)
+{
+    /* Pairs with atomic_read_acquire() in __brnana_fdb_dst_rcu() */
+    smp_mb__before_atomic();
+    atomic_inc(&fdb->fcache_gen);
+}
+
+/**
+ * brnana_fdb_resized - Check whether an entry is also in the future table
+ * @fdb:  The table, being resized
+ * @tbl:  Its current buckets
+ * @hash: The entry's hash
+ *
+ * Entries of the buckets already rehashed are in both tables, the others
+ * only in @tbl until their turn comes. Called under the hash_lock.
+ *
+ * Return: true if the entry is linked in fdb->future.
+ */
+static inline bool brnana_fdb_resized(const struct brnana_fdb *fdb,
+                                      const struct brnana_fdb_table *tbl,
+                                      u32 hash)
+{
+    return (hash & ((1U << tbl->bits) - 1)) < fdb->resize_next;
+}
+
+/**
+ * brnana_fdb_hash - Link an entry in the buckets of its table
+ * @fdb: The table
+ * @f:   The entry, with its address and VLAN set
+ *
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_hash(struct brnana_fdb *fdb, struct brnana_fdb_entry *f)
+{
+    struct brnana_fdb_table *tbl = brnana_fdb_table(fdb);
+    struct brnana_fdb_table *future = fdb->future;
+    u32 hash = brnana_mac_hash(fdb, f->addr, f->vid);
+
+    hlist_add_head_rcu(&f->hlist[tbl->node], brnana_fdb_bucket(tbl, hash));
+    if (future && brnana_fdb_resized(fdb, tbl, hash))
+        hlist_add_head_rcu(&f->hlist[future->node],
+                           brnana_fdb_bucket(future, hash));
+}
+
+/**
+ * brnana_fdb_unhash - Unlink an entry from the buckets of its table
+ * @fdb: The table
+ * @f:   The entry
+ *
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_unhash(struct brnana_fdb *fdb,
+                              struct brnana_fdb_entry *f)
+{
+    struct brnana_fdb_table *tbl = brnana_fdb_table(fdb);
+    struct brnana_fdb_table *future = fdb->future;
+
+    hlist_del_rcu(&f->hlist[tbl->node]);
+    if (future &&
+        brnana_fdb_resized(fdb, tbl, brnana_mac_hash(fdb, f->addr, f->vid)))
+        hlist_del_rcu(&f->hlist[future->node]);
+}
+
+/**
+ * brnana_fdb_unlink - Take an entry off the lists and counters of its kind
+ * @fdb: The table
+ * @f:   The entry
+ *
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_unlink(struct brnana_fdb *fdb,
+                              struct brnana_fdb_entry *f)
+{
+    list_del(&f->port_lru);
+
+    if (f->is_static) {
+        --fdb->n_static;
+        return;
+    }
+
+    list_del(&f->lru);
+    --fdb->n_learned;
+    --f->dst->n_learned;
+}
+
+/**
+ * brnana_fdb_delete - Unhash an entry and free it after a grace period
+ * @fdb: The table
+ * @f:   The entry
+ *
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_delete(struct brnana_fdb *fdb,
+                              struct brnana_fdb_entry *f)
+{
+    brnana_fdb_unhash(fdb, f);
+    brnana_fdb_unlink(fdb, f);
+    brnana_fcache_invalidate(fdb);
+    brnana_fdb_host_free(f);
+}
+
+/**
+ * brnana_fdb_evict - Make room by deleting a least recently used entry
+ * @fdb: The table
+ * @p:   Evict from this port's entries, or NULL for the bridge's
+ *
+ * The LRU lists are ordered by (re)queue time, not by last use, so hits on
+ * the forwarding path never touch them. Eviction approximates LRU the way
+ * CLOCK does: an entry seen again since it was queued is requeued instead,
+ * at most BRNANA_FDB_EVICT_SCAN times, so active hosts survive a burst of
+ * one-shot addresses and eviction stays O(1). The list must not be empty.
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_evict(struct brnana_fdb *fdb, struct brnana_fdb_port *p)
+{
+    unsigned long now = brnana_fdb_now();
+    struct brnana_fdb_entry *f;
+
+    for (int i = 0;; ++i) {
+        f = p ? list_first_entry(&p->lru, struct brnana_fdb_entry, port_lru)
+              : list_first_entry(&fdb->lru, struct brnana_fdb_entry, lru);
+        if (i == BRNANA_FDB_EVICT_SCAN ||
+            !time_after(READ_ONCE(f->updated), f->queued))
+            break;
+
+        f->queued = now;
+        list_move_tail(&f->lru, &fdb->lru);
+        list_move_tail(&f->port_lru, &f->dst->lru);
+    }
+
+    brnana_fdb_delete(fdb, f);
+}
+
+/**
+ * brnana_fdb_link - Put an entry on the lists and counters of its kind
+ * @fdb: The table
+ * @f:   The entry, with its port and kind set
+ *
+ * A learned entry makes room for itself first. Called under the hash_lock.
+ */
+static void brnana_fdb_link(struct brnana_fdb *fdb, struct brnana_fdb_entry *f)
+{
+    unsigned int port_max = fdb->port_max_learned;
+    struct brnana_fdb_port *p = f->dst;
+
+    if (f->is_static) {
+        list_add_tail(&f->port_lru, &p->statics);
+        ++fdb->n_static;
+        return;
+    }
+
+    /**
+     * A port at its own bound recycles one of its own entries, which also
+     * keeps the bridge within its bound. Other ports' entries are only
+     * recycled once the whole bridge is full.
+     */
+    if (port_max && p->n_learned >= port_max)
+        brnana_fdb_evict(fdb, p);
+    else if (fdb->n_learned >= fdb->max_learned)
+        brnana_fdb_evict(fdb, NULL);
+
+    f->queued = brnana_fdb_now();
+    list_add_tail(&f->lru, &fdb->lru);
+    list_add_tail(&f->port_lru, &p->lru);
+    ++fdb->n_learned;
+    ++p->n_learned;
+}
+
+/**
+ * brnana_fdb_create - Add an entry for a new address
+ * @fdb:       The table
+ * @f:         The new entry
+ * @dst:       The port the address lives behind
+ * @addr:      The MAC address
+ * @vid:       The VLAN
+ * @is_static: The entry was configured rather than learned
+ *
+ * Called under the hash_lock.
+ */
+static void brnana_fdb_create(struct brnana_fdb *fdb,
+                              struct brnana_fdb_entry *f,
+                              struct brnana_fdb_port *dst,
+                              const unsigned char *addr,
+                              u16 vid,
+                              bool is_static)
+{
+    memcpy(f->addr, addr, ETH_ALEN);
+    f->vid = vid;
+    f->is_static = is_static;
+    f->dst = dst;
+    f->updated = brnana_fdb_now();
+    brnana_fdb_link(fdb, f);
+    brnana_fdb_hash(fdb, f);
+}
+
+/**
+ * brnana_fdb_update - Learn the source address of a received frame
+ * @fdb:    The table
+ * @source: The port the frame arrived on
+ * @addr:   The frame's source MAC address
+ * @vid:    The frame's VLAN, 0 without VLAN filtering
+ *
+ * Called from the receive path in softirq context under RCU.
+ */
+void brnana_fdb_update(struct brnana_fdb *fdb,
+                       struct brnana_fdb_port *source,
+                       const unsigned char *addr,
+                       u16 vid)
+{
+    unsigned long now = brnana_fdb_now();
+    struct brnana_fdb_entry *f;
+
+    /**
+     * Fast path: a known host on the port we already have for it.
+     * Only touch the entry's cache line when the coarse clock ticked.
+     * Static entries stay where they were configured, whatever port the
+     * address shows up on.
+     */
+    f = brnana_fdb_find_rcu(fdb, addr, vid);
+    if (likely(f)) {
+        if (likely(READ_ONCE(f->dst) == source)) {
+            if (unlikely(READ_ONCE(f->updated) != now))
+                WRITE_ONCE(f->updated, now);
+            return;
+        }
+        if (READ_ONCE(f->is_static))
+            return;
+    }
+
+    /**
+     * Slow path: new address or a host that moved to another port. A move
+     * (e.g. a migrated VM) takes effect on the first frame from the new
+     * port, not when the old entry ages out. Look again under the lock,
+     * somebody may have raced us here.
+     */
+    spin_lock(&fdb->hash_lock);
+
+    f = brnana_fdb_find(fdb, addr, vid);
+    if (!f) {
+        f = brnana_fdb_host_alloc(GFP_ATOMIC);
+        if (f)
+            brnana_fdb_create(fdb, f, source, addr, vid, false);
+    } else if (!f->is_static) {
+        if (f->dst != source) {
+            brnana_fdb_host_moved(fdb, f, source);
+
+            brnana_fdb_unlink(fdb, f);
+            WRITE_ONCE(f->dst, source);
+            brnana_fdb_link(fdb, f);
+            brnana_fcache_invalidate(fdb);
+        }
+        WRITE_ONCE(f->updated, now);
+    }
+
+    spin_unlock(&fdb->hash_lock);
+}
+
+/**
+ * brnana_fdb_hash_bits - Size the buckets of a table
+ * @entries: Number of entries the table must serve
+ *
+ * Return: log2 of the number of buckets holding BRNANA_FDB_LOAD of
+ * @entries each, within the bounds of a table.
+ */
+static unsigned int brnana_fdb_hash_bits(unsigned int entries)
+{
+    return clamp_t(unsigned int,
+                   order_base_2(DIV_ROUND_UP(entries, BRNANA_FDB_LOAD)),
+                   BRNANA_FDB_HASH_MIN_BITS, BRNANA_FDB_HASH_MAX_BITS);
+}
+
+/**
+ * brnana_fdb_resize - Rehash a table into a new number of buckets
+ * @fdb:  The table
+ * @bits: log2 of the number of buckets
+ *
+ * Lookups keep walking the old buckets while every entry is linked in the
+ * new ones through its other hlist node, BRNANA_FDB_GC_SLICE old buckets
+ * per hold of the hash_lock so learning is never held up for long. Entries
+ * added or deleted meanwhile go into or out of both, see
+ * brnana_fdb_resized(). The new buckets then replace the old ones at once.
+ *
+ * Sleeps. Resizes are serialized by the caller, RTNL in the module.
+ *
+ * Return: 0, or -ENOMEM; the table then keeps its buckets.
+ */
+static int brnana_fdb_resize(struct brnana_fdb *fdb, unsigned int bits)
+{
+    struct brnana_fdb_table *old, *new;
+    struct brnana_fdb_entry *f;
+
+    /* Only resizes change fdb->tbl */
+    old = rcu_dereference_protected(fdb->tbl, 1);
+    if (old->bits == bits)
+        return 0;
+
+    new = brnana_fdb_table_alloc(bits);
+    if (!new)
+        return -ENOMEM;
+    new->node = !old->node;
+
+    spin_lock_bh(&fdb->hash_lock);
+    fdb->future = new;
+    fdb->resize_next = 0;
+
+    for (unsigned int i = 0; i < 1U << old->bits; ++i) {
+        if (i && !(i % BRNANA_FDB_GC_SLICE)) {
+            spin_unlock_bh(&fdb->hash_lock);
+            cond_resched();
+            spin_lock_bh(&fdb->hash_lock);
+        }
+        hlist_for_each_entry (f, &old->hash[i], hlist[old->node]) {
+            hlist_add_head_rcu(
+                &f->hlist[new->node],
+                brnana_fdb_bucket(new, brnana_mac_hash(fdb, f->addr, f->vid)));
+        }
+        fdb->resize_next = i + 1;
+    }
+
+    rcu_assign_pointer(fdb->tbl, new);
+    fdb->future = NULL;
+    fdb->gc_next = 0;
+    spin_unlock_bh(&fdb->hash_lock);
+
+    /**
+     * Lookups may still walk the old buckets, through the nodes the next
+     * resize links the entries with.
+     */
+    synchronize_rcu();
+    kvfree(old);
+
+    return 0;
+}
+
+/**
+ * brnana_fdb_insert - Configure the entry of an address
+ * @fdb:       The table
+ * @new:       Preallocated entry, set to NULL if it was used
+ * @dst:       The port the address lives behind
+ * @addr:      The MAC address
+ * @vid:       The VLAN
+ * @is_static: Add a static entry rather than a learned one
+ * @flags:     BRNANA_FDB_CREATE to add a missing entry, BRNANA_FDB_EXCL to
+ *             fail on an existing one
+ *
+ * An existing entry is replaced in place: it changes port and kind in a
+ * single pass under the hash_lock, which is never held for an allocation.
+ * A new static entry may first grow the table, which sleeps.
+ *
+ * Return: 0, -EEXIST, -ENOENT, -ENOSPC if there are too many static
+ * entries, or -ENOMEM.
+ */
+int brnana_fdb_insert(struct brnana_fdb *fdb,
+                      struct brnana_fdb_entry **new,
+                      struct brnana_fdb_port *dst,
+                      const unsigned char *addr,
+                      u16 vid,
+                      bool is_static,
+                      unsigned int flags)
+{
+    struct brnana_fdb_entry *f;
+    unsigned int bits;
+    int err = 0;
+
+    if (is_static) {
+        bits = brnana_fdb_hash_bits(READ_ONCE(fdb->max_learned) +
+                                    READ_ONCE(fdb->n_static) + 1);
+        if (bits > rcu_dereference_protected(fdb->tbl, 1)->bits) {
+            err = brnana_fdb_resize(fdb, bits);
+            if (err)
+                return err;
+        }
+    }
+
+    spin_lock_bh(&fdb->hash_lock);
+
+    f = brnana_fdb_find(fdb, addr, vid);
+    if (f && (flags & BRNANA_FDB_EXCL)) {
+        err = -EEXIST;
+    } else if (!f && !(flags & BRNANA_FDB_CREATE)) {
+        err = -ENOENT;
+    } else if (is_static && !(f && f->is_static) &&
+               fdb->n_static >= BRNANA_FDB_STATIC_MAX) {
+        err = -ENOSPC;
+    } else if (!f) {
+        brnana_fdb_create(fdb, *new, dst, addr, vid, is_static);
+        *new = NULL;
+    } else {
+        brnana_fdb_unlink(fdb, f);
+        WRITE_ONCE(f->is_static, is_static);
+        WRITE_ONCE(f->dst, dst);
+        WRITE_ONCE(f->updated, brnana_fdb_now());
+        brnana_fdb_link(fdb, f);
+        brnana_fcache_invalidate(fdb);
+    }
+
+    spin_unlock_bh(&fdb->hash_lock);
+
+    return err;
+}
+
+/**
+ * brnana_fdb_remove - Forget an address if it lives behind a port
+ * @fdb:  The table
+ * @dst:  The port
+ * @addr: The MAC address
+ * @vid:  The VLAN
+ *
+ * Static and learned entries alike are forgotten.
+ *
+ * Return: 0, or -ENOENT if @addr is unknown or behind another port.
+ */
+int brnana_fdb_remove(struct brnana_fdb *fdb,
+                      struct brnana_fdb_port *dst,
+                      const unsigned char *addr,
+                      u16 vid)
+{
+    struct brnana_fdb_entry *f;
+    int err = -ENOENT;
+
+    spin_lock_bh(&fdb->hash_lock);
+
+    f = brnana_fdb_find(fdb, addr, vid);
+    if (f && f->dst == dst) {
+        brnana_fdb_delete(fdb, f);
+        err = 0;
+    }
+
+    spin_unlock_bh(&fdb->hash_lock);
+
+    return err;
+}
+
+/**
+ * brnana_fdb_delete_match - Forget the addresses matching a port and VLAN
+ * @fdb:         The table
+ * @p:           Only entries pointing to this port, or NULL for any port
+ * @vid:         Only entries of this VLAN, or -1 for any VLAN
+ * @with_static: Also forget the static entries of @p
+ *
+ * Walks the LRU list of @p, or of the bridge, rather than every bucket.
+ * Entries are unhashed immediately and freed after a grace period, so
+ * concurrent lookups never see freed memory.
+ */
+void brnana_fdb_delete_match(struct brnana_fdb *fdb,
+                             struct brnana_fdb_port *p,
+                             int vid,
+                             bool with_static)
+{
+    struct brnana_fdb_entry *f, *tmp;
+
+    spin_lock_bh(&fdb->hash_lock);
+
+    if (p) {
+        list_for_each_entry_safe (f, tmp, &p->lru, port_lru) {
+            if (vid < 0 || f->vid == vid)
+                brnana_fdb_delete(fdb, f);
+        }
+        if (with_static) {
+            list_for_each_entry_safe (f, tmp, &p->statics, port_lru) {
+                if (vid < 0 || f->vid == vid)
+                    brnana_fdb_delete(fdb, f);
+            }
+        }
+    } else {
+        list_for_each_entry_safe (f, tmp, &fdb->lru, lru) {
+            if (vid < 0 || f->vid == vid)
+                brnana_fdb_delete(fdb, f);
+        }
+    }
+
+    spin_unlock_bh(&fdb->hash_lock);
+}
+
+/**
+ * brnana_fdb_sweep - Forget the entries matching a filter, bucket by bucket
+ * @fdb:     The table
+ * @p:       Only entries pointing to this port, or NULL for any port
+ * @vid:     Only entries of this VLAN, or -1 for any VLAN
+ * @learned: Forget learned entries
+ * @statics: Forget static entries
+ *
+ * The hash_lock is taken once per bucket, so it is never held for more than
+ * a bucket's worth of entries. Must not race with a resize of the table.
+ */
+void brnana_fdb_sweep(struct brnana_fdb *fdb,
+                      struct brnana_fdb_port *p,
+                      int vid,
+                      bool learned,
+                      bool statics)
+{
+    struct brnana_fdb_table *tbl = rcu_dereference_protected(fdb->tbl, 1);
+    struct brnana_fdb_entry *f;
+    struct hlist_node *tmp;
+
+    for (unsigned int i = 0; i < 1U << tbl->bits; ++i) {
+        spin_lock_bh(&fdb->hash_lock);
+        hlist_for_each_entry_safe (f, tmp, &tbl->hash[i], hlist[tbl->node]) {
+            if ((p && f->dst != p) || (vid >= 0 && f->vid != vid) ||
+                !(f->is_static ? statics : learned))
+                continue;
+            brnana_fdb_delete(fdb, f);
+        }
+        spin_unlock_bh(&fdb->hash_lock);
+    }
+}
+
+/**
+ * brnana_fdb_trim - Evict the learned entries beyond the bounds
+ * @fdb: The table, with its new bounds set
+ *
+ * The bridge's bound is enforced from its LRU list. Ports over their own
+ * bound are found by walking the buckets, and evict from their LRU lists,
+ * so every eviction still takes a least recently queued entry. Each hold of
+ * the hash_lock evicts or examines BRNANA_FDB_GC_SLICE entries or buckets
+ * at most, so lowering a bound by half a million entries neither stalls
+ * learning nor keeps BH disabled for long. Learning meanwhile already
+ * honors the new bounds. Must not race with a resize of the table.
+ */
+static void brnana_fdb_trim(struct brnana_fdb *fdb)
+{
+    struct brnana_fdb_table *tbl;
+    struct brnana_fdb_entry *f;
+    unsigned int i = 0, n;
+    bool more;
+
+    do {
+        spin_lock_bh(&fdb->hash_lock);
+        for (n = 0; n < BRNANA_FDB_GC_SLICE &&
+                    fdb->n_learned > fdb->max_learned; ++n)
+            brnana_fdb_evict(fdb, NULL);
+        more = fdb->n_learned > fdb->max_learned;
+        spin_unlock_bh(&fdb->hash_lock);
+        cond_resched();
+    } while (more);
+
+    if (!fdb->port_max_learned)
+        return;
+
+    do {
+        spin_lock_bh(&fdb->hash_lock);
+        tbl = brnana_fdb_table(fdb);
+        for (n = 0; n < BRNANA_FDB_GC_SLICE && i < 1U << tbl->bits; ++n) {
+            hlist_for_each_entry (f, &tbl->hash[i], hlist[tbl->node]) {
+                if (!f->is_static &&
+                    f->dst->n_learned > fdb->port_max_learned)
+                    break;
+            }
+            /* The bucket is examined again after each eviction */
+            if (f)
+                brnana_fdb_evict(fdb, f->dst);
+            else
+                ++i;
+        }
+        more = i < 1U << tbl->bits;
+        spin_unlock_bh(&fdb->hash_lock);
+        cond_resched();
+    } while (more);
+}
+
+/**
+ * brnana_fdb_set_max_learned - Bound the number of learned entries
+ * @fdb:      The table
+ * @max:      Bound for the whole bridge, at least 1
+ * @port_max: Bound for each port, 0 for none
+ *
+ * Entries beyond the new bounds are evicted right away, the least recently
+ * queued ones of each port first, in slices (see brnana_fdb_trim()). The
+ * table is resized to the new bound. Sleeps.
+ *
+ * Return: 0, -EINVAL if a bound is out of range, or -ENOMEM.
+ */
+int brnana_fdb_set_max_learned(struct brnana_fdb *fdb,
+                               unsigned int max,
+                               unsigned int port_max)
+{
+    unsigned int bits, cur;
+    int err;
+
+    if (!max || max > BRNANA_FDB_MAX_LIMIT || port_max > BRNANA_FDB_MAX_LIMIT)
+        return -EINVAL;
+
+    /* Grow before more entries may come in, shrink once they are gone */
+    bits = brnana_fdb_hash_bits(max + READ_ONCE(fdb->n_static));
+    cur = rcu_dereference_protected(fdb->tbl, 1)->bits;
+    if (bits > cur) {
+        err = brnana_fdb_resize(fdb, bits);
+        if (err)
+            return err;
+    }
+
+    spin_lock_bh(&fdb->hash_lock);
+    fdb->max_learned = max;
+    fdb->port_max_learned = port_max;
+    spin_unlock_bh(&fdb->hash_lock);
+
+    brnana_fdb_trim(fdb);
+
+    /* A failure only leaves the table larger than needed */
+    if (bits < cur)
+        brnana_fdb_resize(fdb, bits);
+    return 0;
+}
+
+/**
+ * brnana_fdb_gc_slice - Forget the unseen addresses of the next slice
+ * @fdb: The table
+ *
+ * Each call examines the next 1/BRNANA_FDB_GC_PASS of the buckets, holding
+ * the hash_lock for BRNANA_FDB_GC_SLICE of them at most, so ageing a large
+ * table never holds it for long. Calls are serialized by the caller.
+ */
+void brnana_fdb_gc_slice(struct brnana_fdb *fdb)
+{
+    unsigned long ageing = READ_ONCE(fdb->ageing_time);
+    unsigned int start, slice, done = 0;
+    unsigned long now = jiffies;
+    struct brnana_fdb_table *tbl;
+    struct brnana_fdb_entry *f;
+    struct hlist_node *tmp;
+
+    if (!ageing)
+        return;
+
+    for (;;) {
+        spin_lock_bh(&fdb->hash_lock);
+
+        tbl = brnana_fdb_table(fdb);
+        slice = (1U << tbl->bits) / BRNANA_FDB_GC_PASS;
+        if (done >= slice) {
+            spin_unlock_bh(&fdb->hash_lock);
+            break;
+        }
+        slice = min_t(unsigned int, slice, BRNANA_FDB_GC_SLICE);
+
+        start = fdb->gc_next;
+        for (unsigned int i = start; i < start + slice; ++i) {
+            hlist_for_each_entry_safe (f, tmp, &tbl->hash[i],
+                                       hlist[tbl->node]) {
+                if (!f->is_static &&
+                    time_after_eq(now, READ_ONCE(f->updated) + ageing))
+                    brnana_fdb_delete(fdb, f);
+            }
+        }
+        fdb->gc_next = (start + slice) & ((1U << tbl->bits) - 1);
+        done += slice;
+
+        spin_unlock_bh(&fdb->hash_lock);
+    }
+}
+
+/**
+ * brnana_fdb_core_init - Initialize a table and allocate its buckets
+ * @fdb: The table; @fdb->fcache is left to the caller
+ *
+ * The buckets are sized for the default bounds.
+ *
+ * Return: 0, or -ENOMEM.
+ */
+int brnana_fdb_core_init(struct brnana_fdb *fdb)
+{
+    struct brnana_fdb_table *tbl;
+
+    tbl = brnana_fdb_table_alloc(brnana_fdb_hash_bits(BRNANA_FDB_MAX_DEFAULT));
+    if (!tbl)
+        return -ENOMEM;
+
+    spin_lock_init(&fdb->hash_lock);
+    fdb->hash_seed = get_random_u32();
+    RCU_INIT_POINTER(fdb->tbl, tbl);
+    fdb->future = NULL;
+    fdb->resize_next = 0;
+    atomic_set(&fdb->fcache_gen, 0);
+    INIT_LIST_HEAD(&fdb->lru);
+    fdb->n_learned = 0;
+    fdb->n_static = 0;
+    fdb->max_learned = BRNANA_FDB_MAX_DEFAULT;
+    fdb->port_max_learned = 0;
+    fdb->ageing_time = BRNANA_FDB_AGEING_DEFAULT;
+    fdb->gc_next = 0;
+
+    return 0;
+}
+
+/**
+ * brnana_fdb_core_destroy - Free the buckets of an empty table
+ * @fdb: The table, which no reader may still walk
+ */
+void brnana_fdb_core_destroy(struct brnana_fdb *fdb)
+{
+    kvfree(rcu_dereference_protected(fdb->tbl, 1));
+    RCU_INIT_POINTER(fdb->tbl, NULL);
+}
@@ -0,0 +1,801 @@
+/**
+ * @file brnana_forward.c
+ * @brief Receive handler and forwarding path of the brnana bridge
+ *
+ * Everything in this file runs per packet. It executes inside the RCU
+ * read-side section provided by the networking core (rx_handler) or by
+ * dev_queue_xmit() (bridge device transmit), and must never take a lock.
+ *
+ * Forwarded frames are not transmitted one by one as they are received.
+ * They are queued on a per-CPU batch, which a NAPI instance of the same CPU
+ * drains once the driver's poll that received them is done: a whole burst
+ * is then grouped by egress port and each group is transmitted at once.
+ */
+#include <net/sch_generic.h>
+
+#include "brnana.h"
+
+#define CREATE_TRACE_POINTS
+#include "brnana_trace.h"
+
+/**
+ * brnana_skb_drop_reason - Kernel drop reason reported for each brnana one
+ */
+static const enum skb_drop_reason brnana_skb_drop_reason[] = {
+    [BRNANA_DROP_BR_DOWN] = SKB_DROP_REASON_DEV_READY,
+    [BRNANA_DROP_INVALID_SRC] = SKB_DROP_REASON_NOT_SPECIFIED,
+    [BRNANA_DROP_SAME_PORT] = SKB_DROP_REASON_NOT_SPECIFIED,
+    [BRNANA_DROP_PORT_DOWN] = SKB_DROP_REASON_DEV_READY,
+    [BRNANA_DROP_PKT_TOO_BIG] = SKB_DROP_REASON_PKT_TOO_BIG,
+    [BRNANA_DROP_NOMEM] = SKB_DROP_REASON_NOMEM,
+    [BRNANA_DROP_VLAN_FILTERED] = SKB_DROP_REASON_NOT_SPECIFIED,
+    [BRNANA_DROP_STORM] = SKB_DROP_REASON_NOT_SPECIFIED,
+};
+
+/**
+ * brnana_drop - Drop a frame, count it and report why
+ * @br:     The bridge
+ * @p:      The port the drop is accounted to (NULL for the bridge only)
+ * @skb:    The frame; skb->dev is where it was dropped
+ * @reason: Why brnana dropped it
+ */
+static void brnana_drop(struct brnana_if *br,
+                        struct brnana_port_if *p,
+                        struct sk_buff *skb,
+                        enum brnana_drop_reason reason)
+{
+    brnana_stats_add(br->stats, BRNANA_STAT_DROP, 1);
+    if (p)
+        brnana_stats_add(p->stats, BRNANA_STAT_DROP, 1);
+
+    trace_brnana_drop(br->dev, skb->dev, skb, reason);
+    kfree_skb_reason(skb, brnana_skb_drop_reason[reason]);
+}
+
+/**
+ * brnana_storm_drop - Drop a frame over its ingress port's storm limit
+ * @br:  The bridge
+ * @p:   The ingress port
+ * @skb: The frame
+ */
+static void brnana_storm_drop(struct brnana_if *br,
+                              struct brnana_port_if *p,
+                              struct sk_buff *skb)
+{
+    brnana_stats_add(br->stats, BRNANA_STAT_STORM_DROP, 1);
+    brnana_stats_add(p->stats, BRNANA_STAT_STORM_DROP, 1);
+    brnana_drop(br, p, skb, BRNANA_DROP_STORM);
+}
+
+/**
+ * xmit_batch - Hand bursts for one port straight to its driver
+ *
+ * When set, a burst of frames for the same noqueue egress port (veth, vxlan,
+ * ...) is sent with netdev_start_xmit() under a single TX lock, with
+ * xmit_more set on all but the last frame, so the driver rings its doorbell
+ * once per burst. Like PACKET_QDISC_BYPASS this skips the egress port's
+ * packet taps and tc egress hook. Ports with a real qdisc always go through
+ * dev_queue_xmit(), where the qdisc does its own bulk dequeue.
+ */
+static bool xmit_batch;
+module_param(xmit_batch, bool, 0644);
+MODULE_PARM_DESC(xmit_batch, "Send bursts to noqueue ports with xmit_more.");
+
+/**
+ * rx_batch - Transmit forwarded frames in per-CPU batches
+ *
+ * When set, frames are queued as they are forwarded and transmitted from
+ * the CPU's brnana NAPI instance, grouped by egress port, instead of one
+ * dev_queue_xmit() per frame in the middle of the driver's receive loop.
+ */
+static bool rx_batch = true;
+module_param(rx_batch, bool, 0644);
+MODULE_PARM_DESC(rx_batch, "Transmit forwarded frames in per-CPU batches.");
+
+/** Frames a batch holds before it is transmitted right away */
+#define BRNANA_RX_BATCH_MAX 256
+/** Distinct egress devices grouped at once by brnana_xmit_grouped() */
+#define BRNANA_RX_BATCH_GROUPS 8
+
+/**
+ * struct brnana_rx_batch - Frames forwarded by one CPU, not yet transmitted
+ * @head: First queued frame, chained through skb->next
+ * @tail: Where the next frame is linked
+ * @len:  Number of queued frames
+ * @napi: Drains the batch after the receive work of the current softirq
+ *
+ * Every queued frame holds a reference on its egress device, so a port
+ * cannot finish unregistering under a pending batch.
+ */
+struct brnana_rx_batch {
+    struct sk_buff *head;
+    struct sk_buff **tail;
+    unsigned int len;
+    struct napi_struct napi;
+};
+
+static DEFINE_PER_CPU(struct brnana_rx_batch, brnana_rx_batch);
+
+/** Device the batch NAPI instances hang off, never registered */
+static struct net_device brnana_napi_dev;
+
+/**
+ * brnana_prepare_xmit - Make a frame ready for an egress port
+ * @to:  The egress port
+ * @skb: The frame, with skb->data pointing past the Ethernet header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Restores the Ethernet header, pops the VLAN tag if @to sends @vid
+ * untagged, and accounts the frame on @to. Only skb metadata and the data
+ * pointer are touched, never the (possibly shared) packet data, so clones
+ * need no copy.
+ *
+ * Return:
+ *   true if the frame can be transmitted, false if it was dropped.
+ */
+static bool brnana_prepare_xmit(struct brnana_port_if *to,
+                                struct sk_buff *skb,
+                                u16 vid)
+{
+    skb->dev = to->dev;
+    skb_push(skb, ETH_HLEN);
+    brnana_vlan_egress(&to->vlans, vid, skb);
+
+    /**
+     * Frames larger than the egress MTU (and not GSO) cannot be sent.
+     */
+    if (!is_skb_forwardable(skb->dev, skb)) {
+        brnana_drop(to->br, to, skb, BRNANA_DROP_PKT_TOO_BIG);
+        return false;
+    }
+
+    brnana_stats_pkt(to->stats, BRNANA_STAT_TX_PACKETS, skb->len);
+
+    /**
+     * A CHECKSUM_COMPLETE value computed on ingress means nothing to the
+     * egress device.
+     */
+    skb_forward_csum(skb);
+    return true;
+}
+
+/**
+ * brnana_xmit_burst - Transmit a list of prepared frames on one TX queue
+ * @txq: The queue every frame was picked for, NULL to use dev_queue_xmit()
+ * @skb: First frame of a list chained through skb->next
+ *
+ * See xmit_batch for when the list bypasses dev_queue_xmit(). Like
+ * __dev_queue_xmit(), it does not when this CPU already holds the queue's
+ * lock or nests too deep in transmit paths, e.g. a port looping back into
+ * the bridge: dev_queue_xmit() then drops the frames rather than deadlock
+ * or overflow the stack. Every frame is consumed.
+ */
+static void brnana_xmit_burst(struct netdev_queue *txq, struct sk_buff *skb)
+{
+    struct net_device *dev = skb->dev;
+    int cpu = smp_processor_id();
+    struct sk_buff *next;
+    bool again = false;
+
+    if (!txq || !skb->next)
+        goto slow;
+    if (rcu_dereference_bh(txq->qdisc)->enqueue)
+        goto slow;
+    if (unlikely(READ_ONCE(txq->xmit_lock_owner) == cpu ||
+                 dev_xmit_recursion()))
+        goto slow;
+
+    for (next = skb; next; next = next->next)
+        brnana_lat_xmit(next);
+
+    /**
+     * Software GSO/checksum for whatever the device cannot offload, as
+     * dev_queue_xmit() would have done.
+     */
+    skb = validate_xmit_skb_list(skb, dev, &again);
+
+    dev_xmit_recursion_inc();
+    HARD_TX_LOCK(dev, txq, cpu);
+    for (; skb; skb = next) {
+        next = skb->next;
+        skb_mark_not_on_list(skb);
+
+        if (unlikely(netif_xmit_frozen_or_drv_stopped(txq))) {
+            kfree_skb_reason(skb, SKB_DROP_REASON_DEV_READY);
+            continue;
+        }
+        if (unlikely(!dev_xmit_complete(
+                netdev_start_xmit(skb, dev, txq, next != NULL))))
+            kfree_skb_reason(skb, SKB_DROP_REASON_DEV_READY);
+    }
+    HARD_TX_UNLOCK(dev, txq);
+    dev_xmit_recursion_dec();
+    return;
+
+slow:
+    for (; skb; skb = next) {
+        next = skb->next;
+        skb_mark_not_on_list(skb);
+        brnana_lat_xmit(skb);
+        dev_queue_xmit(skb);
+    }
+}
+
+/**
+ * brnana_xmit_list - Transmit a list of prepared frames
+ * @skb: First frame of a list chained through skb->next
+ *
+ * With xmit_batch, each frame first gets the TX queue its device picks for
+ * it, as dev_queue_xmit() would, and consecutive frames for the same device
+ * and queue are sent as one burst. A flow thus always leaves on the queue
+ * of its own hash and is never reordered across queues. Every frame is
+ * consumed.
+ */
+static void brnana_xmit_list(struct sk_buff *skb)
+{
+    struct sk_buff *burst, **tail;
+    struct netdev_queue *txq;
+
+    if (!READ_ONCE(xmit_batch)) {
+        brnana_xmit_burst(NULL, skb);
+        return;
+    }
+
+    for (burst = skb; burst; burst = burst->next)
+        netdev_core_pick_tx(burst->dev, burst, NULL);
+
+    while (skb) {
+        burst = skb;
+        tail = &skb->next;
+        while (*tail && (*tail)->dev == burst->dev &&
+               skb_get_queue_mapping(*tail) == skb_get_queue_mapping(burst))
+            tail = &(*tail)->next;
+
+        skb = *tail;
+        *tail = NULL;
+        txq = netdev_get_tx_queue(burst->dev, skb_get_queue_mapping(burst));
+        brnana_xmit_burst(txq, burst);
+    }
+}
+
+/**
+ * brnana_xmit_group - Transmit the frames of one egress device
+ * @dev: The egress device
+ * @skb: First frame of a list chained through skb->next
+ * @n:   Number of frames, each holding a reference on @dev
+ */
+static void brnana_xmit_group(struct net_device *dev,
+                              struct sk_buff *skb,
+                              unsigned int n)
+{
+    brnana_xmit_list(skb);
+
+    while (n--)
+        dev_put(dev);
+}
+
+/**
+ * brnana_xmit_grouped - Transmit a batch, grouped by egress device
+ * @skb: First frame of a list chained through skb->next
+ *
+ * Frames keep their order within a device, so no flow is reordered. A
+ * batch spanning more than BRNANA_RX_BATCH_GROUPS devices is transmitted
+ * in several rounds. Every frame is consumed.
+ */
+static void brnana_xmit_grouped(struct sk_buff *skb)
+{
+    struct {
+        struct net_device *dev;
+        struct sk_buff *head;
+        struct sk_buff **tail;
+        unsigned int n;
+    } g[BRNANA_RX_BATCH_GROUPS];
+    unsigned int ngroups = 0, i;
+    struct sk_buff *next;
+
+    for (; skb; skb = next) {
+        next = skb->next;
+        skb->next = NULL;
+
+        for (i = 0; i < ngroups && g[i].dev != skb->dev; ++i)
+            ;
+
+        if (i == BRNANA_RX_BATCH_GROUPS) {
+            for (i = 0; i < ngroups; ++i)
+                brnana_xmit_group(g[i].dev, g[i].head, g[i].n);
+            ngroups = 0;
+            i = 0;
+        }
+        if (i == ngroups) {
+            g[i].dev = skb->dev;
+            g[i].tail = &g[i].head;
+            g[i].n = 0;
+            ++ngroups;
+        }
+
+        *g[i].tail = skb;
+        g[i].tail = &skb->next;
+        ++g[i].n;
+    }
+
+    for (i = 0; i < ngroups; ++i)
+        brnana_xmit_group(g[i].dev, g[i].head, g[i].n);
+}
+
+/**
+ * brnana_rx_batch_poll - NAPI poll of a CPU's batch
+ * @napi:   The batch's NAPI instance
+ * @budget: Maximum number of frames to transmit
+ *
+ * Return: The number of frames transmitted.
+ */
+static int brnana_rx_batch_poll(struct napi_struct *napi, int budget)
+{
+    struct brnana_rx_batch *b = container_of(napi, struct brnana_rx_batch,
+                                             napi);
+    struct sk_buff *list = b->head, *last = NULL, *skb;
+    int work = 0;
+
+    for (skb = list; skb && work < budget; skb = skb->next) {
+        last = skb;
+        ++work;
+    }
+
+    /**
+     * Detach the frames taken before transmitting them, in case sending
+     * loops back into the receive path and queues more on this batch.
+     */
+    if (last) {
+        b->head = last->next;
+        last->next = NULL;
+        if (!b->head)
+            b->tail = &b->head;
+        b->len -= work;
+
+        brnana_xmit_grouped(list);
+    }
+
+    if (work < budget && !b->head)
+        napi_complete_done(napi, work);
+    else
+        work = budget;
+
+    return work;
+}
+
+/**
+ * brnana_xmit_queue - Transmit prepared frames, batched if possible
+ * @skb: First frame of a list chained through skb->next
+ *
+ * Frames are appended to this CPU's batch and the batch's NAPI instance is
+ * scheduled, so they leave once the current receive burst is processed.
+ * Must be called with BH disabled; without it, or with rx_batch off, the
+ * frames are transmitted right away. Every frame is consumed.
+ */
+static void brnana_xmit_queue(struct sk_buff *skb)
+{
+    struct brnana_rx_batch *b;
+    struct sk_buff *list;
+
+    if (!skb)
+        return;
+
+    if (!READ_ONCE(rx_batch) || !in_softirq()) {
+        brnana_xmit_list(skb);
+        return;
+    }
+
+    b = this_cpu_ptr(&brnana_rx_batch);
+    for (; skb; skb = skb->next) {
+        dev_hold(skb->dev);
+        *b->tail = skb;
+        b->tail = &skb->next;
+        ++b->len;
+    }
+
+    if (b->len < BRNANA_RX_BATCH_MAX) {
+        napi_schedule(&b->napi);
+        return;
+    }
+
+    list = b->head;
+    b->head = NULL;
+    b->tail = &b->head;
+    b->len = 0;
+    brnana_xmit_grouped(list);
+}
+
+/**
+ * brnana_deliver - Transmit a frame on an egress port
+ * @to:  The egress port
+ * @skb: The frame, with skb->data pointing past the Ethernet header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Restores the Ethernet header and hands the frame to the port's device.
+ * The skb is always consumed.
+ */
+static void brnana_deliver(struct brnana_port_if *to,
+                           struct sk_buff *skb,
+                           u16 vid)
+{
+    if (brnana_prepare_xmit(to, skb, vid))
+        brnana_xmit_queue(skb);
+}
+
+/**
+ * brnana_pass_frame_up - Deliver a frame to the bridge device's own stack
+ * @br:  The bridge
+ * @skb: The frame, with skb->data pointing past the Ethernet header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * A frame kept tagged reaches the VLAN device stacked on the bridge (e.g.
+ * brnana0.10), an untagged one the bridge device itself. The caller checked
+ * that the bridge is a member of @vid.
+ *
+ * Frames go through this CPU's GRO cell rather than straight into the
+ * stack, so a TCP flow terminating on the bridge's own address is
+ * coalesced like on a physical NIC and climbs the stack once per batch
+ * instead of once per segment. Shared frames (a flood replica kept for the
+ * bridge) and bridges with GRO turned off (`ethtool -K brnana0 gro off`)
+ * fall back to netif_rx().
+ */
+static void brnana_pass_frame_up(struct brnana_if *br,
+                                 struct sk_buff *skb,
+                                 u16 vid)
+{
+    trace_brnana_local_deliver(br->dev, skb->dev, skb);
+    brnana_stats_pkt(br->stats, BRNANA_STAT_RX_PACKETS, skb->len + ETH_HLEN);
+
+    brnana_vlan_egress(&br->vlans, vid, skb);
+    skb->dev = br->dev;
+    brnana_lat_local(br, skb);
+    gro_cells_receive(&br->gro_cells, skb);
+}
+
+/**
+ * brnana_flood_one - Queue one replica of a flooded frame
+ * @br:    The bridge
+ * @to:    The egress port
+ * @skb:   The flooded frame
+ * @vid:   The frame's VLAN, 0 without VLAN filtering
+ * @clone: Send a clone of @skb rather than @skb itself
+ * @tail:  Tail pointer of the list of replicas to transmit
+ */
+static void brnana_flood_one(struct brnana_if *br,
+                             struct brnana_port_if *to,
+                             struct sk_buff *skb,
+                             u16 vid,
+                             bool clone,
+                             struct sk_buff ***tail)
+{
+    struct sk_buff *nskb = skb;
+
+    if (clone) {
+        nskb = skb_clone(skb, GFP_ATOMIC);
+        if (!nskb) {
+            brnana_stats_add(br->stats, BRNANA_STAT_DROP, 1);
+            brnana_stats_add(to->stats, BRNANA_STAT_DROP, 1);
+            trace_brnana_drop(br->dev, to->dev, skb, BRNANA_DROP_NOMEM);
+            return;
+        }
+    }
+
+    if (!brnana_prepare_xmit(to, nskb, vid))
+        return;
+
+    **tail = nskb;
+    *tail = &nskb->next;
+}
+
+/**
+ * brnana_flood - Replicate a frame to every eligible port of a bridge
+ * @br:        The bridge
+ * @skb:       The frame, with skb->data pointing past the Ethernet header
+ * @from:      Ingress port, skipped during replication (NULL if none)
+ * @vid:       The frame's VLAN, 0 without VLAN filtering
+ * @local_rcv: Also deliver a copy to the bridge device itself
+ * @mdst:      Multicast group restricting the egress ports, NULL if none
+ *
+ * Egress ports come from the bridge's active port array, so replication is
+ * a walk over contiguous memory. Ports outside @vid, and ports without
+ * listeners of @mdst, are skipped before any clone is made, so a VLAN's
+ * flood domain is only its own members and a snooped group only reaches its
+ * listeners and multicast routers. Replicas are clones sharing the packet
+ * data: N egress ports cost N - 1 clones, the last port gets the original
+ * skb unless the bridge device needs it too. All replicas are built first
+ * and then handed to brnana_xmit_list() in one pass. The skb is always
+ * consumed.
+ */
+static void brnana_flood(struct brnana_if *br,
+                         struct sk_buff *skb,
+                         struct brnana_port_if *from,
+                         u16 vid,
+                         bool local_rcv,
+                         const struct brnana_mdb_entry *mdst)
+{
+    struct brnana_port_array *arr = rcu_dereference(br->ports);
+    struct brnana_port_if *p, *prev = NULL;
+    struct sk_buff *list = NULL, **tail = &list;
+
+    trace_brnana_flood(br->dev, from ? from->dev : br->dev, skb);
+    brnana_lat_mark(skb, BRNANA_LAT_FLOOD);
+    brnana_stats_add(br->stats, BRNANA_STAT_FLOOD, 1);
+    if (from)
+        brnana_stats_add(from->stats, BRNANA_STAT_FLOOD, 1);
+
+    for (unsigned int i = 0; arr && i < arr->count; ++i) {
+        p = arr->ports[i];
+        if (p == from || !brnana_vlan_allowed_egress(&p->vlans, vid) ||
+            !brnana_mcast_wants(mdst, p))
+            continue;
+
+        if (prev)
+            brnana_flood_one(br, prev, skb, vid, true, &tail);
+        prev = p;
+    }
+
+    if (local_rcv && !brnana_vlan_allowed_egress(&br->vlans, vid))
+        local_rcv = false;
+
+    if (prev)
+        brnana_flood_one(br, prev, skb, vid, local_rcv, &tail);
+    *tail = NULL;
+
+    brnana_xmit_queue(list);
+
+    if (local_rcv)
+        brnana_pass_frame_up(br, skb, vid);
+    else if (!prev)
+        consume_skb(skb);
+}
+
+/**
+ * brnana_forward_unicast - Send a unicast frame where the FDB says it lives
+ * @br:   The bridge
+ * @skb:  The frame, with skb->data pointing past the Ethernet header
+ * @from: Ingress port (NULL for locally originated frames)
+ * @vid:  The frame's VLAN, 0 without VLAN filtering
+ *
+ * Unknown destinations are flooded, subject to the ingress port's storm
+ * control. The skb is always consumed.
+ */
+static void brnana_forward_unicast(struct brnana_if *br,
+                                   struct sk_buff *skb,
+                                   struct brnana_port_if *from,
+                                   u16 vid)
+{
+    struct brnana_port_if *to;
+
+    to = brnana_fdb_dst_rcu(br, eth_hdr(skb)->h_dest, vid);
+    if (!to) {
+        if (from && brnana_storm_exceeded(from, BRNANA_STORM_UNKNOWN_UCAST,
+                                          skb->len + ETH_HLEN)) {
+            brnana_storm_drop(br, from, skb);
+            return;
+        }
+        brnana_flood(br, skb, from, vid, false, NULL);
+        return;
+    }
+
+    /**
+     * A host reachable through the ingress port already received the frame
+     * on that segment; never send it back out.
+     */
+    if (to == from) {
+        brnana_drop(br, from, skb, BRNANA_DROP_SAME_PORT);
+        return;
+    }
+    if (!brnana_port_can_xmit(to)) {
+        brnana_drop(br, to, skb, BRNANA_DROP_PORT_DOWN);
+        return;
+    }
+    if (!brnana_vlan_allowed_egress(&to->vlans, vid)) {
+        brnana_drop(br, to, skb, BRNANA_DROP_VLAN_FILTERED);
+        return;
+    }
+
+    trace_brnana_forward(br->dev, to->dev, skb);
+    brnana_stats_add(br->stats, BRNANA_STAT_FORWARD, 1);
+    if (from)
+        brnana_stats_add(from->stats, BRNANA_STAT_FORWARD, 1);
+    brnana_deliver(to, skb, vid);
+}
+
+/**
+ * brnana_handle_frame - rx_handler installed on every enslaved port
+ * @pskb: Pointer to the received socket buffer
+ *
+ * Called by __netif_receive_skb_core() for each frame arriving on a brnana
+ * port, after eth_type_trans() has pulled the Ethernet header. The frame is
+ * assigned a VLAN and its source address is learned in that VLAN, ARP/NDISC
+ * requests for known hosts are answered, IGMP/MLD messages are snooped, then
+ * it is either handed to the bridge device (addressed to the bridge), sent
+ * to the port its destination was learned on, flooded to the other ports,
+ * or both (broadcast/multicast). Flooded frames are subject to the port's
+ * storm control. Every frame is given its egress priority by the bridge's
+ * QoS maps, see brnana_qos.c.
+ *
+ * Return:
+ *   RX_HANDLER_PASS for frames the port's own stack should see (link-local
+ *   control protocols), RX_HANDLER_CONSUMED otherwise.
+ */
+rx_handler_result_t brnana_handle_frame(struct sk_buff **pskb)
+{
+    struct sk_buff *skb = *pskb;
+    const unsigned char *dest = eth_hdr(skb)->h_dest;
+    const struct brnana_mdb_entry *mdst;
+    struct brnana_port_if *p;
+    struct brnana_if *br;
+    enum brnana_fwd fwd;
+    u16 vid;
+
+    /**
+     * Frames we transmitted ourselves are looped back to taps only.
+     */
+    if (unlikely(skb->pkt_type == PACKET_LOOPBACK))
+        return RX_HANDLER_PASS;
+
+    /**
+     * 01:80:c2:00:00:0X (STP, LACP, LLDP, PAUSE) must never be bridged.
+     */
+    if (unlikely(is_link_local_ether_addr(dest)))
+        return RX_HANDLER_PASS;
+
+    p = brnana_port_get_rcu(skb->dev);
+    br = p->br;
+
+    trace_brnana_rx(br->dev, skb->dev, skb);
+    brnana_stats_pkt(p->stats, BRNANA_STAT_RX_PACKETS, skb->len + ETH_HLEN);
+
+    if (unlikely(!netif_running(br->dev))) {
+        brnana_drop(br, p, skb, BRNANA_DROP_BR_DOWN);
+        return RX_HANDLER_CONSUMED;
+    }
+    if (unlikely(!is_valid_ether_addr(eth_hdr(skb)->h_source))) {
+        brnana_drop(br, p, skb, BRNANA_DROP_INVALID_SRC);
+        return RX_HANDLER_CONSUMED;
+    }
+
+    skb = skb_share_check(skb, GFP_ATOMIC);
+    if (!skb)
+        return RX_HANDLER_CONSUMED;
+    brnana_lat_stamp(skb);
+
+    if (!brnana_vlan_ingress(br, &p->vlans, &skb, &vid)) {
+        if (skb)
+            brnana_drop(br, p, skb, BRNANA_DROP_VLAN_FILTERED);
+        return RX_HANDLER_CONSUMED;
+    }
+
+    /**
+     * Moving a tag in or out of the packet may have moved the header.
+     */
+    dest = eth_hdr(skb)->h_dest;
+
+    brnana_fdb_update(&br->fdb, &p->fdb, eth_hdr(skb)->h_source, vid);
+
+    /**
+     * ARP requests and neighbor solicitations for hosts the bridge already
+     * knows were answered on @p, nobody else needs to see them.
+     */
+    if (brnana_neigh_rcv(br, p, skb, vid)) {
+        consume_skb(skb);
+        return RX_HANDLER_CONSUMED;
+    }
+
+    /**
+     * Before flooding clones it, so every replica leaves with the same
+     * priority.
+     */
+    brnana_qos_classify(br, skb);
+
+    fwd = brnana_fwd_classify(dest, br->dev->dev_addr);
+    switch (fwd) {
+    case BRNANA_FWD_BCAST:
+    case BRNANA_FWD_MCAST:
+        if (brnana_storm_exceeded(p,
+                                  fwd == BRNANA_FWD_BCAST ?
+                                      BRNANA_STORM_BCAST :
+                                      BRNANA_STORM_MCAST,
+                                  skb->len + ETH_HLEN)) {
+            brnana_storm_drop(br, p, skb);
+            return RX_HANDLER_CONSUMED;
+        }
+        mdst = brnana_mcast_rcv(br, p, skb, vid);
+        brnana_flood(br, skb, p, vid, true, mdst);
+        break;
+    case BRNANA_FWD_LOCAL:
+        if (!brnana_vlan_allowed_egress(&br->vlans, vid)) {
+            brnana_drop(br, p, skb, BRNANA_DROP_VLAN_FILTERED);
+            return RX_HANDLER_CONSUMED;
+        }
+        skb->pkt_type = PACKET_HOST;
+        brnana_pass_frame_up(br, skb, vid);
+        break;
+    case BRNANA_FWD_UNICAST:
+        brnana_forward_unicast(br, skb, p, vid);
+        break;
+    }
+
+    return RX_HANDLER_CONSUMED;
+}
+
+/**
+ * brnana_dev_forward - Forward a frame originated on the bridge device
+ * @br:  The bridge the frame was transmitted on
+ * @skb: The frame, with skb->data pointing past the Ethernet header
+ *
+ * The bridge device is a VLAN member like any port. Unicast frames go to the
+ * port their destination was learned on, everything else is replicated to
+ * every port. The skb is always consumed.
+ */
+void brnana_dev_forward(struct brnana_if *br, struct sk_buff *skb)
+{
+    const struct brnana_mdb_entry *mdst;
+    u16 vid;
+
+    brnana_lat_stamp(skb);
+
+    if (!brnana_vlan_ingress(br, &br->vlans, &skb, &vid)) {
+        if (skb)
+            brnana_drop(br, NULL, skb, BRNANA_DROP_VLAN_FILTERED);
+        return;
+    }
+
+    if (is_multicast_ether_addr(eth_hdr(skb)->h_dest)) {
+        mdst = brnana_mcast_rcv(br, NULL, skb, vid);
+        brnana_flood(br, skb, NULL, vid, false, mdst);
+    } else
+        brnana_forward_unicast(br, skb, NULL, vid);
+}
+
+/**
+ * brnana_forward_init - Set up the per-CPU transmit batches
+ */
+void __init brnana_forward_init(void)
+{
+    struct brnana_rx_batch *b;
+    int cpu;
+
+    init_dummy_netdev(&brnana_napi_dev);
+
+    for_each_possible_cpu (cpu) {
+        b = per_cpu_ptr(&brnana_rx_batch, cpu);
+        b->tail = &b->head;
+        netif_napi_add(&brnana_napi_dev, &b->napi, brnana_rx_batch_poll);
+        napi_enable(&b->napi);
+    }
+}
+
+/**
+ * brnana_forward_exit - Tear down the per-CPU transmit batches
+ *
+ * Called once no bridge is left. napi_disable() waits for a poll in
+ * progress, but frames a batch still holds once its NAPI instance is
+ * disabled would never be sent: they are freed, and the references they
+ * hold on their devices dropped, so no device waits for them forever.
+ */
+void brnana_forward_exit(void)
+{
+    struct brnana_rx_batch *b;
+    struct sk_buff *skb, *next;
+    struct net_device *dev;
+    int cpu;
+
+    for_each_possible_cpu (cpu) {
+        b = per_cpu_ptr(&brnana_rx_batch, cpu);
+        napi_disable(&b->napi);
+        netif_napi_del(&b->napi);
+
+        for (skb = b->head; skb; skb = next) {
+            next = skb->next;
+            skb_mark_not_on_list(skb);
+            dev = skb->dev;
+            kfree_skb(skb);
+            dev_put(dev);
+        }
+        b->head = NULL;
+        b->tail = &b->head;
+        b->len = 0;
+    }
+}
@@ -0,0 +1,233 @@
+/**
+ * @file brnana_lat.c
+ * @brief Forwarding latency histograms in debugfs
+ *
+ * When throughput drops, these tell whether the time goes into the bridge
+ * (lookup, replication, the transmit batch) or into the egress driver. A
+ * frame is stamped when it enters the bridge and accounted when it is
+ * handed to its egress device, or to the bridge's own stack. Latencies go
+ * into per-CPU log2 histograms of each bridge, one per enum
+ * brnana_lat_path:
+ *
+ *   echo 1 > /sys/kernel/debug/brnana/latency_enabled
+ *   cat /sys/kernel/debug/brnana/brnana0/latency
+ *   echo 1 > /sys/kernel/debug/brnana/brnana0/latency_reset
+ *
+ * Recording sits behind a static key: while it is off, the forwarding path
+ * only runs a few no-ops where the jumps were patched out. While it is on,
+ * a frame costs two reads of the fast monotonic clock and two additions to
+ * its CPU's histogram, without any lock or shared cache line.
+ */
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+#include "brnana.h"
+
+DEFINE_STATIC_KEY_FALSE(brnana_lat_key);
+
+/** /sys/kernel/debug/brnana/, holding a directory per bridge */
+static struct dentry *brnana_debugfs_root;
+
+static const char *const brnana_lat_path_names[] = {
+    [BRNANA_LAT_FORWARD] = "forward",
+    [BRNANA_LAT_FLOOD] = "flood",
+    [BRNANA_LAT_LOCAL] = "local",
+};
+
+/**
+ * __brnana_lat_record - Account a stamped frame handed off by a bridge
+ * @br:   The bridge
+ * @skb:  The frame
+ * @path: How it left the bridge
+ *
+ * Frames already in flight when recording was turned on carry no stamp and
+ * are skipped. The stamp is consumed, so a frame looping back into the
+ * bridge is never counted twice for one pass.
+ */
+void __brnana_lat_record(struct brnana_if *br,
+                         struct sk_buff *skb,
+                         enum brnana_lat_path path)
+{
+    struct brnana_skb_cb *cb = BRNANA_SKB_CB(skb);
+    struct brnana_lat_pcpu *lat;
+    u64 now, delta = 0;
+
+    if (cb->cookie != BRNANA_LAT_COOKIE)
+        return;
+    cb->cookie = 0;
+
+    now = ktime_get_mono_fast_ns();
+    if (now > cb->rx_ns)
+        delta = now - cb->rx_ns;
+
+    lat = this_cpu_ptr(br->lat);
+    ++lat->count[path][min_t(unsigned int, fls64(delta),
+                             BRNANA_LAT_BUCKETS - 1)];
+    lat->sum[path] += delta;
+}
+
+/**
+ * __brnana_lat_xmit - Account a stamped frame handed to its egress port
+ * @skb: The frame, skb->dev being the egress port
+ *
+ * The port may have been released while the frame sat in a transmit batch.
+ * Its rx_handler is then no longer brnana's and the frame is skipped.
+ */
+void __brnana_lat_xmit(struct sk_buff *skb)
+{
+    struct net_device *dev = skb->dev;
+    struct brnana_port_if *p;
+
+    if (BRNANA_SKB_CB(skb)->cookie != BRNANA_LAT_COOKIE)
+        return;
+    if (rcu_access_pointer(dev->rx_handler) != brnana_handle_frame)
+        return;
+
+    p = rcu_dereference_bh(dev->rx_handler_data);
+    if (p)
+        __brnana_lat_record(p->br, skb, BRNANA_SKB_CB(skb)->path);
+}
+
+/**
+ * brnana_lat_show - Print the histograms of a bridge
+ * @m: The seq_file, m->private being the bridge
+ * @v: Unused
+ *
+ * Per path: the number of frames and their mean latency, then every
+ * non-empty bucket as its range in ns and its number of frames.
+ *
+ * Return: 0.
+ */
+static int brnana_lat_show(struct seq_file *m, void *v)
+{
+    const struct brnana_if *br = m->private;
+    const struct brnana_lat_pcpu *lat;
+    u64 count[BRNANA_LAT_BUCKETS];
+    u64 sum, total;
+    int cpu;
+
+    for (int path = 0; path < BRNANA_LAT_NUM; ++path) {
+        memset(count, 0, sizeof(count));
+        sum = 0;
+        for_each_possible_cpu (cpu) {
+            lat = per_cpu_ptr(br->lat, cpu);
+            for (int b = 0; b < BRNANA_LAT_BUCKETS; ++b)
+                count[b] += READ_ONCE(lat->count[path][b]);
+            sum += READ_ONCE(lat->sum[path]);
+        }
+
+        total = 0;
+        for (int b = 0; b < BRNANA_LAT_BUCKETS; ++b)
+            total += count[b];
+        seq_printf(m, "%s: %llu frames, mean %llu ns\n",
+                   brnana_lat_path_names[path], total,
+                   total ? div64_u64(sum, total) : 0);
+
+        for (int b = 0; b < BRNANA_LAT_BUCKETS; ++b) {
+            if (!count[b])
+                continue;
+            seq_printf(m, "  %10llu - ", b ? BIT_ULL(b - 1) : 0);
+            if (b == BRNANA_LAT_BUCKETS - 1)
+                seq_printf(m, "%10s ns: %llu\n", "inf", count[b]);
+            else
+                seq_printf(m, "%10llu ns: %llu\n", BIT_ULL(b) - 1, count[b]);
+        }
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(brnana_lat);
+
+/**
+ * brnana_lat_reset - Empty the histograms of a bridge
+ * @data: The bridge
+ * @val:  Unused, any write resets
+ *
+ * CPUs keep recording meanwhile, so a frame or two counted during the reset
+ * may survive it.
+ *
+ * Return: 0.
+ */
+static int brnana_lat_reset(void *data, u64 val)
+{
+    struct brnana_if *br = data;
+    int cpu;
+
+    for_each_possible_cpu (cpu)
+        memset(per_cpu_ptr(br->lat, cpu), 0, sizeof(struct brnana_lat_pcpu));
+
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(brnana_lat_reset_fops, NULL, brnana_lat_reset,
+                         "%llu\n");
+
+static int brnana_lat_enabled_get(void *data, u64 *val)
+{
+    *val = static_key_enabled(&brnana_lat_key);
+    return 0;
+}
+
+static int brnana_lat_enabled_set(void *data, u64 val)
+{
+    if (val)
+        static_branch_enable(&brnana_lat_key);
+    else
+        static_branch_disable(&brnana_lat_key);
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(brnana_lat_enabled_fops, brnana_lat_enabled_get,
+                         brnana_lat_enabled_set, "%llu\n");
+
+/**
+ * brnana_lat_init - Create /sys/kernel/debug/brnana/
+ *
+ * Recording starts off, for every bridge at once.
+ */
+void __init brnana_lat_init(void)
+{
+    BUILD_BUG_ON(sizeof(struct brnana_skb_cb) >
+                 sizeof_field(struct sk_buff, cb));
+
+    brnana_debugfs_root = debugfs_create_dir("brnana", NULL);
+    debugfs_create_file_unsafe("latency_enabled", 0600, brnana_debugfs_root,
+                               NULL, &brnana_lat_enabled_fops);
+}
+
+/**
+ * brnana_lat_exit - Remove /sys/kernel/debug/brnana/
+ *
+ * Called once no bridge is left.
+ */
+void brnana_lat_exit(void)
+{
+    debugfs_remove(brnana_debugfs_root);
+}
+
+/**
+ * brnana_lat_add - Create the debugfs directory of a bridge
+ * @br: The bridge, with its histograms allocated
+ *
+ * The directory is named after the bridge device. debugfs is not
+ * namespaced, so a bridge whose name is already used by one in another
+ * namespace goes without; like any debugfs failure, this is not an error.
+ */
+void brnana_lat_add(struct brnana_if *br)
+{
+    br->debugfs = debugfs_create_dir(br->dev->name, brnana_debugfs_root);
+    debugfs_create_file("latency", 0400, br->debugfs, br, &brnana_lat_fops);
+    debugfs_create_file_unsafe("latency_reset", 0200, br->debugfs, br,
+                               &brnana_lat_reset_fops);
+}
+
+/**
+ * brnana_lat_del - Remove the debugfs directory of a bridge
+ * @br: The bridge
+ *
+ * Waits for readers and writers of its files to be done with @br.
+ */
+void brnana_lat_del(struct brnana_if *br)
+{
+    debugfs_remove(br->debugfs);
+    br->debugfs = NULL;
+}
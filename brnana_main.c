@@ -0,0 +1,1211 @@
+/**
+ * @file brnana_main.c
+ * @brief Core implementation of the brnana bridge module
+ */
+#include "brnana.h"
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Elian");
+MODULE_DESCRIPTION(
+    "C(  o  .  o  ) ╯ brnana - the minimal bridge with extra potassium!🍌 ");
+MODULE_VERSION(BRNANA_VERSION);
+
+MODULE_ALIAS_RTNL_LINK("brnana");
+
+/**
+ * num_bridge - Module parameter to control the number of bridges created
+ * Default: 1. Can be set via insmod: insmod brnana.ko num_bridge=2
+ *
+ * These bridges are created in the initial network namespace at load time.
+ * Any number of further bridges can be added later with
+ * `ip link add <name> type brnana`.
+ */
+static int num_bridge = 1;
+module_param(num_bridge, int, 0444);
+MODULE_PARM_DESC(num_bridge, "Number of bridges created at load time.");
+
+/**
+ * max_tx_queues - Upper bound on the TX queues of a new bridge
+ *
+ * Every TX queue costs memory and sysfs objects when the bridge is created,
+ * which adds up with one queue per possible CPU on large machines hosting
+ * many bridges. Beyond this many, CPUs share queues.
+ */
+static unsigned int max_tx_queues = 16;
+module_param(max_tx_queues, uint, 0644);
+MODULE_PARM_DESC(max_tx_queues, "Maximum number of TX queues per bridge.");
+
+static struct rtnl_link_ops brnana_link_ops;
+
+/**
+ * brnana_dev_open - ndo_open callback for bridge device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * This function is called when the bridge interface is brought up using:
+ *   ip link set dev brnana0 up
+ *
+ * It starts the transmission queue and updates the interface's feature flags.
+ *
+ * Return:
+ *   0 on success.
+ */
+static int brnana_dev_open(struct net_device *dev)
+{
+    pr_debug("C( o . o ) ╯ brnana: bridge %s open\n", dev->name);
+
+    brnana_fdb_open(dev_get_brnana_if(dev));
+    brnana_mcast_open(dev_get_brnana_if(dev));
+    brnana_neigh_open(dev_get_brnana_if(dev));
+
+    /* Refresh the device's feature flags based on current configuration */
+    netdev_update_features(dev);
+
+    /* Start every transmit queue of the interface */
+    netif_tx_start_all_queues(dev);
+
+    return 0;
+}
+
+/**
+ * brnana_dev_stop - ndo_stop callback for bridge device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * This function is called when the bridge interface is brought down using:
+ *   ip link set dev brnana0 down
+ *
+ * It stops the transmission queue to prevent packet output.
+ *
+ * Return:
+ *   0 on success.
+ */
+static int brnana_dev_stop(struct net_device *dev)
+{
+    pr_debug("C( o . o ) ╯ brnana: bridge %s stop\n", dev->name);
+
+    /* Stop every transmit queue of the interface */
+    netif_tx_stop_all_queues(dev);
+
+    brnana_fdb_stop(dev_get_brnana_if(dev));
+    brnana_mcast_stop(dev_get_brnana_if(dev));
+    brnana_neigh_stop(dev_get_brnana_if(dev));
+
+    return 0;
+}
+
+/**
+ * brnana_dev_init - ndo_init callback for bridge device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * This function is called during net_device registration. It is used
+ * for driver-specific one-time initialization. In this implementation,
+ * it allocates the bridge's per-CPU counters, forwarding database and
+ * cache, and GRO cells.
+ *
+ * Return:
+ *   0 on success, negative error code on failure.
+ */
+static int brnana_dev_init(struct net_device *dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    pr_debug("C( o . o ) ╯ brnana: bridge %s init\n", dev->name);
+
+    br->stats = netdev_alloc_pcpu_stats(struct brnana_pcpu_stats);
+    if (!br->stats)
+        return -ENOMEM;
+
+    if (brnana_fdb_init(br))
+        goto err_stats;
+
+    br->fdb.fcache = alloc_percpu(struct brnana_fcache);
+    if (!br->fdb.fcache)
+        goto err_fdb;
+
+    br->lat = alloc_percpu(struct brnana_lat_pcpu);
+    if (!br->lat)
+        goto err_fcache;
+
+    if (gro_cells_init(&br->gro_cells, dev))
+        goto err_lat;
+
+    brnana_lat_add(br);
+    return 0;
+
+err_lat:
+    free_percpu(br->lat);
+    br->lat = NULL;
+err_fcache:
+    free_percpu(br->fdb.fcache);
+    br->fdb.fcache = NULL;
+err_fdb:
+    brnana_fdb_destroy(br);
+err_stats:
+    free_percpu(br->stats);
+    br->stats = NULL;
+    return -ENOMEM;
+}
+
+/**
+ * brnana_dev_uninit - ndo_uninit callback for bridge device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * This function is called during net_device unregistration. It allows the
+ * driver to clean up any resources that were initialized in ndo_init.
+ * Any port still attached is released here, since the core refuses to
+ * unregister a device that still has lower devices linked to it. Frames
+ * still held by the GRO cells are dropped with them.
+ */
+static void brnana_dev_uninit(struct net_device *dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_port_if *p, *safe;
+
+    pr_debug("C( o . o ) ╯ brnana: bridge %s uninit\n", dev->name);
+
+    list_for_each_entry_safe (p, safe, &br->port_list, link)
+        brnana_del_port(br, p->dev);
+
+    gro_cells_destroy(&br->gro_cells);
+    brnana_lat_del(br);
+}
+
+/**
+ * brnana_dev_free - priv_destructor of the bridge device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * Called once the device is unregistered and no reader (including
+ * ndo_get_stats64 and the forwarding path) can reach it anymore, or when
+ * registration fails.
+ */
+static void brnana_dev_free(struct net_device *dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    free_percpu(br->stats);
+    br->stats = NULL;
+    free_percpu(br->fdb.fcache);
+    br->fdb.fcache = NULL;
+    brnana_fdb_destroy(br);
+    free_percpu(br->lat);
+    br->lat = NULL;
+
+    kfree(rcu_dereference_protected(br->ports, 1));
+    RCU_INIT_POINTER(br->ports, NULL);
+}
+
+/**
+ * brnana_dev_xmit - ndo_start_xmit callback for bridge device
+ * @skb: The socket buffer containing the packet to transmit
+ * @dev: The net_device representing the brnana bridge
+ *
+ * This function is called when the kernel attempts to transmit a packet
+ * through the brnana bridge interface. It is the primary data transmission
+ * hook for net_device drivers.
+ *
+ * The Ethernet header is pulled so that locally originated frames enter the
+ * same forwarding code as frames received on a port. Frames too short to
+ * hold one (packet sockets may send them) are dropped.
+ *
+ * Note:
+ *   - This function is always called with bottom halves (BH) disabled and
+ *     inside an RCU read-side section.
+ *
+ * Return:
+ *   NETDEV_TX_OK, the skb is always consumed.
+ */
+static netdev_tx_t brnana_dev_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    if (unlikely(!pskb_may_pull(skb, ETH_HLEN))) {
+        brnana_stats_add(br->stats, BRNANA_STAT_DROP, 1);
+        kfree_skb_reason(skb, SKB_DROP_REASON_PKT_TOO_SMALL);
+        return NETDEV_TX_OK;
+    }
+
+    /**
+     * No per-packet logging here: use the brnana tracepoints instead.
+     */
+    brnana_stats_pkt(br->stats, BRNANA_STAT_TX_PACKETS, skb->len);
+
+    skb_reset_mac_header(skb);
+    skb_pull(skb, ETH_HLEN);
+
+    rcu_read_lock();
+    brnana_dev_forward(br, skb);
+    rcu_read_unlock();
+
+    return NETDEV_TX_OK;
+}
+
+/**
+ * brnana_fix_features - ndo_fix_features callback for bridge device
+ * @dev:      The net_device representing the brnana bridge
+ * @features: Features requested for the bridge
+ *
+ * The bridge can only offer an offload if every port can handle it, or if
+ * the core can emulate it in software on the way out (e.g. GSO): the
+ * features are the intersection of the ports' features, computed the same
+ * way bonding and the Linux bridge do with netdev_increment_features().
+ * Called under RTNL through netdev_update_features().
+ *
+ * Return:
+ *   The feature set the bridge should use.
+ */
+static netdev_features_t brnana_fix_features(struct net_device *dev,
+                                             netdev_features_t features)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_port_if *p;
+    netdev_features_t mask;
+
+    if (list_empty(&br->port_list))
+        return features;
+
+    mask = features;
+    features &= ~NETIF_F_ONE_FOR_ALL;
+
+    list_for_each_entry (p, &br->port_list, link)
+        features = netdev_increment_features(features, p->dev->features, mask);
+
+    return netdev_add_tso_features(features, mask);
+}
+
+/**
+ * brnana_change_mtu - ndo_change_mtu callback for bridge device
+ * @dev:     The net_device representing the brnana bridge
+ * @new_mtu: The requested MTU
+ *
+ * An MTU set from user space sticks; it is no longer derived from the ports.
+ *
+ * Return:
+ *   0.
+ */
+static int brnana_change_mtu(struct net_device *dev, int new_mtu)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    WRITE_ONCE(dev->mtu, new_mtu);
+    br->mtu_set_by_user = true;
+
+    return 0;
+}
+
+/**
+ * brnana_select_queue - ndo_select_queue callback for bridge device
+ * @dev:    The net_device representing the brnana bridge
+ * @skb:    The packet being transmitted
+ * @sb_dev: Subordinate device (unused)
+ *
+ * Each CPU transmits on its own queue, so queue state is not shared
+ * between CPUs, unless there are more CPUs than queues (max_tx_queues).
+ *
+ * Return:
+ *   The TX queue index of the current CPU.
+ */
+static u16 brnana_select_queue(struct net_device *dev,
+                               struct sk_buff *skb,
+                               struct net_device *sb_dev)
+{
+    return smp_processor_id() % dev->real_num_tx_queues;
+}
+
+/**
+ * brnana_set_mac_address - Set the MAC address of a brnana bridge
+ * @dev: The net_device representing the bridge
+ * @p: Pointer to a struct sockaddr containing the new MAC address
+ *
+ * This function is invoked when a user attempts to change the MAC address
+ * of the bridge interface, for example using:
+ *   ip link set dev brnana0 address XX:XX:XX:XX:XX:XX
+ *
+ * It validates the new MAC address and applies it if appropriate.
+ *
+ * Return:
+ *   0 on success, or a negative errno on failure.
+ */
+static int brnana_set_mac_address(struct net_device *dev, void *p)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct sockaddr *addr = p;
+
+    /**
+     * Validate that the provided address is a valid unicast Ethernet MAC.
+     * Reject multicast or all-zero addresses.
+     */
+    if (!is_valid_ether_addr(addr->sa_data))
+        return -EADDRNOTAVAIL;
+
+    /**
+     * Ensure that the interface is already registered before allowing changes.
+     * Prevents MAC changes during device setup stages.
+     */
+    if (dev->reg_state != NETREG_REGISTERED)
+        return -EBUSY;
+
+    /**
+     * Protect concurrent access to the MAC address with a spinlock.
+     * This ensures safe modification even in softirq context.
+     */
+    spin_lock_bh(&br->lock);
+
+    /**
+     * Only update the address if it is different from the current one.
+     */
+    if (!ether_addr_equal(dev->dev_addr, addr->sa_data)) {
+        pr_info("C( o . o ) ╯ brnana: bridge %s set mac : %pM\n", dev->name,
+                addr->sa_data);
+        memcpy(br->mac_addr, addr->sa_data, ETH_ALEN);
+        eth_hw_addr_set(dev, addr->sa_data);
+    }
+
+    spin_unlock_bh(&br->lock);
+
+    return 0;
+}
+
+/**
+ * brnana_add_slave - ndo_add_slave callback to add a slave device
+ * @dev: The brnana bridge net_device (i.e., master)
+ * @slave_dev: The net_device to be enslaved (i.e., slave)
+ * @extack: Extended netlink acknowledgment structure
+ *
+ * This function is called by the kernel when a user runs:
+ *   ip link set <slave_dev> master <brnana>
+ *
+ * It converts the bridge's net_device to its internal brnana_if structure
+ * and calls brnana_add_port() to perform the actual linking.
+ *
+ * Return:
+ *   0 on success, or a negative errno on failure.
+ */
+static int brnana_add_slave(struct net_device *dev,
+                            struct net_device *slave_dev,
+                            struct netlink_ext_ack *extack)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    return brnana_add_port(br, slave_dev, extack);
+}
+
+/**
+ * brnana_del_slave - ndo_del_slave callback to remove a slave device
+ * @dev: The brnana bridge net_device (i.e., master)
+ * @slave_dev: The net_device to be removed from the bridge
+ *
+ * This function is called by the kernel when a user runs:
+ *   ip link set <slave_dev> nomaster
+ *
+ * It converts the bridge's net_device to its internal brnana_if structure
+ * and calls brnana_del_port() to handle port unlinking and cleanup.
+ *
+ * Return:
+ *   0 on success, or a negative errno on failure.
+ */
+static int brnana_del_slave(struct net_device *dev,
+                            struct net_device *slave_dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    return brnana_del_port(br, slave_dev);
+}
+
+/**
+ * brnana_netdev_ops - Network device operations for brnana bridge
+ *
+ * This structure defines the set of callback functions that implement
+ * the core behavior of the brnana bridge net_device. These callbacks
+ * are invoked by the kernel networking subsystem for standard operations
+ * such as interface bring-up/down, packet transmission, slave management, etc.
+ */
+static const struct net_device_ops brnana_netdev_ops = {
+    /** Called when the interface is brought up (e.g., `ip link set up`) */
+    .ndo_open = brnana_dev_open,
+    /** Called when the interface is brought down */
+    .ndo_stop = brnana_dev_stop,
+    /** Called during device registration for one-time setup */
+    .ndo_init = brnana_dev_init,
+    /** Called during device unregistration for cleanup */
+    .ndo_uninit = brnana_dev_uninit,
+    /** Called to transmit a packet (called from upper layers) */
+    .ndo_start_xmit = brnana_dev_xmit,
+    /** Picks the calling CPU's own TX queue */
+    .ndo_select_queue = brnana_select_queue,
+    /** Restricts the bridge's offloads to what all ports support */
+    .ndo_fix_features = brnana_fix_features,
+    /** Called to set a new MTU (e.g., `ip link set brnana0 mtu 9000`) */
+    .ndo_change_mtu = brnana_change_mtu,
+    /** Sums the bridge's per-CPU counters (`ip -s link show brnana0`) */
+    .ndo_get_stats64 = brnana_get_stats64,
+    /** Called to set a new MAC address on the bridge */
+    .ndo_set_mac_address = brnana_set_mac_address,
+    /** Called when a slave is attached (e.g., `ip link set dev dummy0 master
+       brnana0`) */
+    .ndo_add_slave = brnana_add_slave,
+    /** Called when a slave is detached (e.g., `ip link set dev dummy0
+       nomaster`) */
+    .ndo_del_slave = brnana_del_slave,
+    /** VLAN membership of ports and bridge (`bridge vlan add/del/show`) */
+    .ndo_bridge_setlink = brnana_bridge_setlink,
+    .ndo_bridge_dellink = brnana_bridge_dellink,
+    .ndo_bridge_getlink = brnana_bridge_getlink,
+    /** Learned and static addresses (`bridge fdb add/del/flush/show`) */
+    .ndo_fdb_add = brnana_fdb_add,
+    .ndo_fdb_del = brnana_fdb_del,
+    .ndo_fdb_del_bulk = brnana_fdb_del_bulk,
+    .ndo_fdb_dump = brnana_fdb_dump,
+    /** Snooped multicast groups and router ports (`bridge mdb show`) */
+    .ndo_mdb_dump = brnana_mdb_dump,
+};
+
+/**
+ * brnana_dev_is_bridge - Check whether a device is a brnana bridge
+ * @dev: The device
+ *
+ * Return:
+ *   true if @dev is a brnana bridge device.
+ */
+bool brnana_dev_is_bridge(const struct net_device *dev)
+{
+    return dev->netdev_ops == &brnana_netdev_ops;
+}
+
+/**
+ * brnana_port_get_rtnl - Get the brnana port behind a device under RTNL
+ * @dev: The candidate port device
+ *
+ * Return:
+ *   The brnana_port_if if @dev is enslaved to a brnana bridge, else NULL.
+ */
+struct brnana_port_if *brnana_port_get_rtnl(const struct net_device *dev)
+{
+    if (rcu_access_pointer(dev->rx_handler) != brnana_handle_frame)
+        return NULL;
+
+    return rtnl_dereference(dev->rx_handler_data);
+}
+
+/**
+ * brnana_mtu_auto_adjust - Derive the bridge MTU from its ports
+ * @br: The bridge
+ *
+ * The bridge takes the smallest MTU of its ports, so that nothing it sends
+ * is too big for any of them; with all ports at 9000 the bridge runs jumbo
+ * frames too. Does nothing once an MTU was set explicitly. Called under
+ * RTNL.
+ */
+static void brnana_mtu_auto_adjust(struct brnana_if *br)
+{
+    struct brnana_port_if *p;
+    unsigned int mtu = 0;
+
+    ASSERT_RTNL();
+
+    if (br->mtu_set_by_user)
+        return;
+
+    list_for_each_entry (p, &br->port_list, link) {
+        if (!mtu || p->dev->mtu < mtu)
+            mtu = p->dev->mtu;
+    }
+
+    if (!mtu)
+        mtu = ETH_DATA_LEN;
+
+    /**
+     * dev_set_mtu() goes through brnana_change_mtu(), which assumes the
+     * request came from the user.
+     */
+    dev_set_mtu(br->dev, mtu);
+    br->mtu_set_by_user = false;
+}
+
+/**
+ * brnana_set_gso_limits - Derive the bridge's TSO limits from its ports
+ * @br: The bridge
+ *
+ * GSO packets pass through the bridge unsegmented, so they must not be
+ * larger than what the most limited port accepts. Called under RTNL.
+ */
+static void brnana_set_gso_limits(struct brnana_if *br)
+{
+    unsigned int tso_max_size = TSO_MAX_SIZE;
+    unsigned int tso_max_segs = TSO_MAX_SEGS;
+    struct brnana_port_if *p;
+
+    list_for_each_entry (p, &br->port_list, link) {
+        tso_max_size = min_t(unsigned int, tso_max_size, p->dev->tso_max_size);
+        tso_max_segs = min_t(unsigned int, tso_max_segs, p->dev->tso_max_segs);
+    }
+
+    netif_set_tso_max_size(br->dev, tso_max_size);
+    netif_set_tso_max_segs(br->dev, tso_max_segs);
+}
+
+/**
+ * brnana_port_array_rebuild - Publish a new snapshot of the active ports
+ * @br: The bridge
+ *
+ * Called under RTNL whenever a port is added or removed, or changes link
+ * state. The old snapshot is freed after a grace period. The array is tiny
+ * and must be rebuilt even on the removal path, hence __GFP_NOFAIL.
+ */
+static void brnana_port_array_rebuild(struct brnana_if *br)
+{
+    struct brnana_port_array *arr, *old;
+    struct brnana_port_if *p;
+    unsigned int n = 0;
+
+    ASSERT_RTNL();
+
+    list_for_each_entry (p, &br->port_list, link)
+        ++n;
+
+    arr = kmalloc(struct_size(arr, ports, n), GFP_KERNEL | __GFP_NOFAIL);
+    arr->count = 0;
+    list_for_each_entry (p, &br->port_list, link) {
+        if (brnana_port_can_xmit(p))
+            arr->ports[arr->count++] = p;
+    }
+
+    old = rtnl_dereference(br->ports);
+    rcu_assign_pointer(br->ports, arr);
+    if (old)
+        kfree_rcu(old, rcu);
+}
+
+/**
+ * brnana_ports_changed - Recompute everything derived from the port set
+ * @br: The bridge
+ *
+ * Called under RTNL whenever a port is added or removed.
+ */
+static void brnana_ports_changed(struct brnana_if *br)
+{
+    brnana_mtu_auto_adjust(br);
+    brnana_set_gso_limits(br);
+    netdev_update_features(br->dev);
+}
+
+/**
+ * brnana_add_port - Enslave a device to the brnana bridge
+ * @br: Pointer to the bridge (brnana_if) structure
+ * @dev: The net_device to be enslaved as a port
+ * @extack: Netlink extended acknowledgment structure
+ *
+ * This function is called when a user attempts to attach a network interface
+ * (e.g., dummy0, eth1) to the brnana bridge (e.g., brnana0) using
+ * `ip link set dev <ifname> master brnana0`.
+ *
+ * It dynamically allocates a port structure, links it into the bridge's port
+ * list, and sets up the appropriate kernel relationships via netlink.
+ *
+ * The function must be called with the RTNL lock held.
+ *
+ * Return:
+ *   0 on success, or a negative errno on failure.
+ */
+int brnana_add_port(struct brnana_if *br,
+                    struct net_device *dev,
+                    struct netlink_ext_ack *extack)
+{
+    struct brnana_port_if *p;
+    unsigned int port_no;
+    int err;
+
+    /**
+     * Validate input: ensure slave device pointer is not NULL.
+     */
+    if (!dev) {
+        pr_warn("C( o . o ) ╯ brnana: slave device is NULL\n");
+        return -EINVAL;
+    }
+
+    /**
+     * Prevent recursive bridging: disallow enslaving another brnana bridge.
+     */
+    if (brnana_dev_is_bridge(dev)) {
+        pr_warn("C( o . o ) ╯ brnana: refusing to enslave a brnana bridge\n");
+        return -ELOOP;
+    }
+
+    /**
+     * Only Ethernet devices can be bridged, and loopback never can.
+     */
+    if ((dev->flags & IFF_LOOPBACK) || dev->type != ARPHRD_ETHER ||
+        dev->addr_len != ETH_ALEN || !is_valid_ether_addr(dev->dev_addr)) {
+        NL_SET_ERR_MSG(extack, "brnana: device is not an Ethernet device");
+        return -EINVAL;
+    }
+
+    /**
+     * Port numbers index per-group bitmaps of the multicast database.
+     */
+    port_no = find_first_zero_bit(br->port_nos, BRNANA_MAX_PORTS);
+    if (port_no >= BRNANA_MAX_PORTS) {
+        NL_SET_ERR_MSG(extack, "brnana: too many ports");
+        return -EXFULL;
+    }
+
+    /**
+     * Allocate and zero-initialize a new brnana_port_if structure for this
+     * slave.
+     */
+    p = kzalloc(sizeof(*p), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+
+    /**
+     * Initialize the port's list node and store a back-reference to the device.
+     */
+    INIT_LIST_HEAD(&p->link);
+    brnana_fdb_port_init(&p->fdb);
+    p->dev = dev;
+    p->br = br;
+    p->port_no = port_no;
+    brnana_vlan_init(&p->vlans);
+
+    p->stats = netdev_alloc_pcpu_stats(struct brnana_pcpu_stats);
+    p->storm_pcpu = alloc_percpu(struct brnana_storm_pcpu);
+    if (!p->stats || !p->storm_pcpu) {
+        err = -ENOMEM;
+        goto err_free;
+    }
+
+    /**
+     * A port must see frames addressed to every host behind it, not only
+     * to its own MAC address.
+     */
+    err = dev_set_promiscuity(dev, 1);
+    if (err)
+        goto err_free;
+
+    /**
+     * Install brnana_handle_frame() as the port's receive handler. This also
+     * publishes the port structure in dev->rx_handler_data. It fails with
+     * -EBUSY if another master (bond, macvlan, ...) already owns the device.
+     */
+    err = netdev_rx_handler_register(dev, brnana_handle_frame, p);
+    if (err)
+        goto err_unset_promisc;
+
+    /**
+     * Inform the kernel's net_device core that this device now has a master
+     * (the bridge). This ensures that `ip link` and sysfs reflect the correct
+     * relationship.
+     */
+    err = netdev_master_upper_dev_link(dev, br->dev, NULL, NULL, extack);
+    if (err) {
+        pr_warn("brnana: failed to link %s to %s as master: %d\n", dev->name,
+                br->dev->name, err);
+        goto err_unregister_handler;
+    }
+
+    /**
+     * Per-port parameters live in /sys/class/net/<port>/brnana_port/ for as
+     * long as the device is enslaved.
+     */
+    err = sysfs_create_group(&dev->dev.kobj, &brnana_port_group);
+    if (err)
+        goto err_unlink;
+
+    /**
+     * Mark the device as part of a bridge. This is optional but helps in
+     * diagnostics.
+     */
+    dev->priv_flags |= IFF_BRIDGE_PORT;
+    set_bit(port_no, br->port_nos);
+
+    /**
+     * Add the new port to the bridge's list of ports (RCU-safe insertion).
+     * From here on the port is used as an egress by the forwarding path.
+     */
+    list_add_rcu(&p->link, &br->port_list);
+    brnana_port_array_rebuild(br);
+    brnana_ports_changed(br);
+
+    pr_info("C( o . o ) ╯ brnana: enslaved %s to %s\n", dev->name,
+            br->dev->name);
+
+    return 0;
+
+err_unlink:
+    netdev_upper_dev_unlink(dev, br->dev);
+err_unregister_handler:
+    /**
+     * netdev_rx_handler_unregister() waits for in-flight receive handlers,
+     * and the port was never visible anywhere else, so it can be freed
+     * right away.
+     */
+    netdev_rx_handler_unregister(dev);
+err_unset_promisc:
+    dev_set_promiscuity(dev, -1);
+err_free:
+    free_percpu(p->storm_pcpu);
+    free_percpu(p->stats);
+    kfree(p);
+    return err;
+}
+
+/**
+ * brnana_port_free_rcu - Free a port after an RCU grace period
+ * @head: The port's rcu_head
+ */
+static void brnana_port_free_rcu(struct rcu_head *head)
+{
+    struct brnana_port_if *p = container_of(head, struct brnana_port_if, rcu);
+
+    free_percpu(p->storm_pcpu);
+    free_percpu(p->stats);
+    kfree(p);
+}
+
+/**
+ * brnana_del_port - Detach and clean up a slave device from a brnana bridge
+ * @br: Pointer to the brnana bridge structure
+ * @dev: The slave net_device to be removed from the bridge
+ *
+ * This function is called when a device is being removed from the bridge
+ * (e.g., via `ip link set <dev> nomaster`). It unlinks the upper device
+ * relationship, removes the port from the bridge's list, unregisters the RX
+ * handler (if used), and releases associated memory.
+ *
+ * The function must be called with RTNL lock held.
+ *
+ * Return:
+ *   0 on success, or a negative error code if the operation fails.
+ */
+int brnana_del_port(struct brnana_if *br, struct net_device *dev)
+{
+    struct brnana_port_if *p;
+
+    /**
+     * Sanity check: ensure the device pointer is valid.
+     */
+    if (!dev) {
+        pr_warn("C( o . o ) ╯ brnana: attempt to del NULL device\n");
+        return -EINVAL;
+    }
+
+    /**
+     * Retrieve the brnana port interface data under RTNL.
+     * If the port wasn't previously registered, abort safely.
+     */
+    p = brnana_port_get_rtnl(dev);
+    if (!p || p->br != br) {
+        pr_warn("C( o . o ) ╯ brnana: device %s is not a brnana port\n",
+                dev->name);
+        return -ENODEV;
+    }
+
+    pr_info("C( o . o ) ╯ brnana: removing port %s from %s\n", dev->name,
+            br->dev->name);
+
+    /**
+     * Remove the port entry from the bridge’s port list using RCU-safe removal,
+     * so that no new frame picks it as an egress.
+     */
+    list_del_rcu(&p->link);
+    dev->priv_flags &= ~IFF_BRIDGE_PORT;
+    brnana_port_array_rebuild(br);
+
+    /**
+     * Nothing to recompute for a bridge that is itself going away.
+     */
+    if (br->dev->reg_state == NETREG_REGISTERED)
+        brnana_ports_changed(br);
+
+    /**
+     * Removing the group waits for readers and writers of the port's sysfs
+     * files, which rely on rx_handler_data until then.
+     */
+    sysfs_remove_group(&dev->dev.kobj, &brnana_port_group);
+
+    /**
+     * Unregister the RX handler to restore default network stack behavior.
+     * This also clears dev->rx_handler_data. It waits for in-flight
+     * handlers with synchronize_net(), which is expedited under RTNL.
+     */
+    netdev_rx_handler_unregister(dev);
+
+    /**
+     * Unlink the master-upper relationship from the kernel's networking core.
+     * This removes `br->dev` as the upper (master) of `dev`.
+     */
+    netdev_upper_dev_unlink(dev, br->dev);
+    dev_set_promiscuity(dev, -1);
+
+    /**
+     * Forget the hosts learned behind this port, and its multicast
+     * listeners, before its port number can be reused.
+     */
+    brnana_fdb_delete_by_port(br, p);
+    brnana_mcast_del_port(br, p);
+    clear_bit(p->port_no, br->port_nos);
+
+    /**
+     * Frames being forwarded on other CPUs may still hold @p as their
+     * egress port. Free it once they are done instead of waiting for a
+     * grace period here, with RTNL held, for every removed port.
+     */
+    call_rcu(&p->rcu, brnana_port_free_rcu);
+
+    return 0;
+}
+
+/**
+ * brnana_device_event - netdevice notifier for enslaved ports and bridges
+ * @unused: The notifier block
+ * @event:  The NETDEV_* event
+ * @ptr:    Notifier info wrapping the net_device the event is about
+ *
+ * A port that is unregistered (e.g. `ip link delete dummy0`) while still
+ * enslaved must be released first, otherwise the core would be left with a
+ * dangling upper link and rx_handler. Link state, MTU and offload changes on
+ * a port are reflected on the bridge. A renamed bridge gets its debugfs
+ * directory recreated under the new name; the histograms are kept.
+ *
+ * Return:
+ *   NOTIFY_DONE.
+ */
+static int brnana_device_event(struct notifier_block *unused,
+                               unsigned long event,
+                               void *ptr)
+{
+    struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+    struct brnana_port_if *p;
+
+    if (event == NETDEV_CHANGENAME && dev->rtnl_link_ops == &brnana_link_ops) {
+        brnana_lat_del(dev_get_brnana_if(dev));
+        brnana_lat_add(dev_get_brnana_if(dev));
+        return NOTIFY_DONE;
+    }
+
+    p = brnana_port_get_rtnl(dev);
+    if (!p)
+        return NOTIFY_DONE;
+
+    switch (event) {
+    case NETDEV_UP:
+    case NETDEV_DOWN:
+    case NETDEV_CHANGE:
+        brnana_port_array_rebuild(p->br);
+        break;
+    case NETDEV_CHANGEMTU:
+        brnana_mtu_auto_adjust(p->br);
+        break;
+    case NETDEV_FEAT_CHANGE:
+        netdev_update_features(p->br->dev);
+        break;
+    case NETDEV_UNREGISTER:
+        brnana_del_port(p->br, dev);
+        break;
+    }
+
+    return NOTIFY_DONE;
+}
+
+/**
+ * brnana_notifier - Notifier block receiving netdevice events
+ */
+static struct notifier_block brnana_notifier = {
+    .notifier_call = brnana_device_event,
+};
+
+/**
+ * brnana_setup - Initialize a freshly allocated bridge net_device
+ * @dev: The net_device representing the brnana bridge
+ *
+ * Besides the usual Ethernet defaults, the bridge is made qdisc-free
+ * (IFF_NO_QUEUE attaches noqueue to every TX queue) and lockless on transmit
+ * (NETIF_F_LLTX skips the per-queue xmit lock), since brnana_dev_xmit() only
+ * touches per-CPU and RCU-protected state. Locally originated traffic then
+ * scales with the number of CPUs instead of serializing on one queue.
+ *
+ * Used both for bridges created at load time and through rtnl_link_ops, so
+ * the bridge's private state is initialized here, before ndo_init and
+ * ndo_uninit can run. The core frees the device once it is unregistered.
+ */
+static void brnana_setup(struct net_device *dev)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+
+    ether_setup(dev);
+
+    /**
+     * Assign the custom net_device_ops implementation to this bridge device.
+     */
+    dev->netdev_ops = &brnana_netdev_ops;
+    dev->ethtool_ops = &brnana_ethtool_ops;
+    dev->priv_destructor = brnana_dev_free;
+    dev->needs_free_netdev = true;
+    dev->sysfs_groups[0] = &brnana_group;
+
+    dev->priv_flags |= IFF_NO_QUEUE;
+    dev->features |= NETIF_F_LLTX;
+
+    /**
+     * Ports must live in the bridge's namespace, so the bridge stays there.
+     */
+    dev->features |= NETIF_F_NETNS_LOCAL;
+
+    /**
+     * Advertise every offload brnana can pass through untouched;
+     * brnana_fix_features() narrows this down to what the ports support.
+     * GSO packets are then forwarded unsegmented and only segmented by the
+     * core if an egress port cannot take them as they are.
+     */
+    dev->features |= BRNANA_FEATURES | NETIF_F_HW_VLAN_CTAG_TX |
+                     NETIF_F_HW_VLAN_STAG_TX;
+    dev->hw_features = BRNANA_FEATURES | NETIF_F_HW_VLAN_CTAG_TX |
+                       NETIF_F_HW_VLAN_STAG_TX;
+    dev->vlan_features = BRNANA_FEATURES;
+
+    /**
+     * The MTU follows the ports (brnana_mtu_auto_adjust()), jumbo included.
+     */
+    dev->min_mtu = ETH_MIN_MTU;
+    dev->max_mtu = ETH_MAX_MTU;
+
+    /**
+     * Frames for the bridge itself need an address to be recognized by. The
+     * core applies IFLA_ADDRESS after setup, so `ip link add ... address`
+     * still overrides this one.
+     */
+    eth_hw_addr_random(dev);
+
+    /**
+     * Initialize the bridge-specific context:
+     * - Store the device pointer
+     * - Initialize spinlock for concurrent access
+     * - Initialize list of ports connected to this bridge
+     * - Make the bridge device a member of the default VLAN
+     * - Initialize the multicast database
+     * - Initialize the ARP/ND suppression table
+     * - Set the default QoS maps
+     */
+    br->dev = dev;
+    INIT_LIST_HEAD(&br->port_list);
+    spin_lock_init(&br->lock);
+    brnana_vlan_init(&br->vlans);
+    brnana_mcast_init(br);
+    brnana_neigh_init(br);
+    brnana_qos_init(br);
+}
+
+/**
+ * brnana_get_num_tx_queues - Number of TX queues of a new bridge
+ *
+ * Return:
+ *   One TX queue per online CPU, see brnana_select_queue(), at most
+ *   max_tx_queues and at least one.
+ */
+static unsigned int brnana_get_num_tx_queues(void)
+{
+    return max(min(num_online_cpus(), READ_ONCE(max_tx_queues)), 1U);
+}
+
+/**
+ * brnana_validate - Check the attributes of `ip link add type brnana`
+ * @tb:     Generic IFLA_* attributes
+ * @data:   brnana-specific attributes (none yet)
+ * @extack: Netlink extended acknowledgment structure
+ *
+ * Return:
+ *   0 if the bridge can be created, or a negative errno.
+ */
+static int brnana_validate(struct nlattr *tb[],
+                           struct nlattr *data[],
+                           struct netlink_ext_ack *extack)
+{
+    if (tb[IFLA_ADDRESS]) {
+        if (nla_len(tb[IFLA_ADDRESS]) != ETH_ALEN) {
+            NL_SET_ERR_MSG_MOD(extack, "Invalid link address");
+            return -EINVAL;
+        }
+        if (!is_valid_ether_addr(nla_data(tb[IFLA_ADDRESS]))) {
+            NL_SET_ERR_MSG_MOD(extack, "Invalid link address");
+            return -EADDRNOTAVAIL;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * brnana_newlink - Register a bridge created with `ip link add type brnana`
+ * @src_net: Namespace of the requesting process
+ * @dev:     The bridge, already allocated by the core through brnana_setup()
+ * @tb:      Generic IFLA_* attributes
+ * @data:    brnana-specific attributes
+ * @extack:  Netlink extended acknowledgment structure
+ *
+ * The device is created in the namespace given to `ip link add` (e.g. with
+ * `ip -n tenant1 link add ...`). Called under RTNL.
+ *
+ * Return:
+ *   0 on success, negative error code on failure.
+ */
+static int brnana_newlink(struct net *src_net,
+                          struct net_device *dev,
+                          struct nlattr *tb[],
+                          struct nlattr *data[],
+                          struct netlink_ext_ack *extack)
+{
+    return register_netdevice(dev);
+}
+
+/**
+ * brnana_link_ops - rtnetlink operations of the "brnana" link kind
+ *
+ * The core keeps track of every brnana device through these ops: bridges
+ * are looked up by ifindex in their namespace's device table, deleted with
+ * `ip link del` (dellink defaults to unregister_netdevice_queue()), torn
+ * down with their namespace, and all removed in one batch per namespace by
+ * rtnl_link_unregister() at module unload.
+ */
+static struct rtnl_link_ops brnana_link_ops __read_mostly = {
+    .kind = "brnana",
+    .priv_size = sizeof(struct brnana_if),
+    .setup = brnana_setup,
+    .validate = brnana_validate,
+    .newlink = brnana_newlink,
+    .get_num_tx_queues = brnana_get_num_tx_queues,
+};
+
+/**
+ * brnana_add_br - Construct and register a bridge at load time
+ *
+ * This function allocates a net_device representing a software bridge in
+ * the initial network namespace and registers it with the kernel. The
+ * bridge is bound to brnana_link_ops, so it can be deleted with `ip link
+ * del` like the bridges created through rtnetlink.
+ *
+ * Return:
+ *   0 on success, negative error code on failure.
+ */
+static int brnana_add_br(void)
+{
+    struct net_device *dev = NULL;
+    int err;
+
+    /**
+     * Allocate a new Ethernet device with private data of type struct
+     * brnana_if and one TX queue per possible CPU. The device name format is
+     * defined by BR_NAME ("brnana%d").
+     */
+    dev = alloc_netdev_mqs(sizeof(struct brnana_if), BR_NAME, NET_NAME_ENUM,
+                           brnana_setup, brnana_get_num_tx_queues(), 1);
+    if (!dev) {
+        pr_err("C( o . o ) ╯ brnana: Couldn't allocate space for nedv");
+        return -ENOMEM;
+    }
+
+    dev->rtnl_link_ops = &brnana_link_ops;
+
+    /**
+     * Register the device with the kernel networking subsystem.
+     * This makes the interface visible to tools like `ip link`.
+     */
+    err = register_netdev(dev);
+    if (err) {
+        pr_err("C( o . o ) ╯ brnana: Failed to register net device\n");
+        free_netdev(dev);
+        return err;
+    }
+
+    return 0;
+}
+
+/**
+ * brnana_init - Module initialization function
+ *
+ * This function is called when the brnana module is loaded into the kernel.
+ * It registers the "brnana" link kind and creates the bridges requested by
+ * `num_bridge`.
+ *
+ * Return:
+ *   0 on success, negative error code on failure.
+ */
+static int __init brnana_init(void)
+{
+    int err;
+
+    pr_info("C( o . o ) ╯ brnana: %d bridge loaded\n", num_bridge);
+
+    err = brnana_fdb_module_init();
+    if (err)
+        return err;
+    brnana_forward_init();
+    brnana_lat_init();
+
+    /**
+     * Watch for enslaved devices going away underneath us.
+     */
+    err = register_netdevice_notifier(&brnana_notifier);
+    if (err)
+        goto err_fdb;
+
+    err = rtnl_link_register(&brnana_link_ops);
+    if (err)
+        goto err_notifier;
+
+    /**
+     * Let XDP programs on brnana ports use the MAC table.
+     */
+    brnana_xdp_init();
+
+    /**
+     * Create and register each bridge interface according to the
+     * `num_bridge` module parameter.
+     */
+    for (int i = 0; i < num_bridge; ++i) {
+        err = brnana_add_br();
+        if (err)
+            goto err_link;
+    }
+
+    return 0;
+
+err_link:
+    rtnl_link_unregister(&brnana_link_ops);
+err_notifier:
+    unregister_netdevice_notifier(&brnana_notifier);
+    rcu_barrier();
+err_fdb:
+    brnana_forward_exit();
+    brnana_lat_exit();
+    brnana_fdb_module_exit();
+    return err;
+}
+
+/**
+ * brnana_exit - Module cleanup function
+ *
+ * This function is invoked when the brnana module is removed from the kernel.
+ * rtnl_link_unregister() deletes every brnana bridge in every namespace,
+ * including those created at load time. Their ports are released by
+ * brnana_dev_uninit() on the way, and the core frees the net_devices.
+ *
+ * The bridges of a namespace are unregistered in one batch, so the core waits
+ * for a single grace period no matter how many bridges and ports there are.
+ */
+static void __exit brnana_exit(void)
+{
+    pr_info("C( o . o ) ╯ brnana: unloaded\n");
+
+    rtnl_link_unregister(&brnana_link_ops);
+    unregister_netdevice_notifier(&brnana_notifier);
+
+    /**
+     * Wait for pending brnana_port_free_rcu() callbacks and FDB entries
+     * before the module's code and slabs go away.
+     */
+    brnana_forward_exit();
+    brnana_lat_exit();
+    rcu_barrier();
+    brnana_fdb_module_exit();
+}
+
+module_init(brnana_init);
+module_exit(brnana_exit);
\ No newline at end of file
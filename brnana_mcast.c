@@ -0,0 +1,841 @@
+/**
+ * @file brnana_mcast.c
+ * @brief IGMP/MLD snooping and multicast database of the brnana bridge
+ *
+ * IGMPv1-3 and MLDv1-2 reports seen on a port make it a listener of the
+ * reported groups in the bridge's multicast database (mdb); queries mark the
+ * port as leading to a multicast router. Traffic to a group with listeners
+ * is then only replicated to those ports and to router ports, instead of
+ * being flooded. Groups nobody reported, and link-local groups such as
+ * 224.0.0.1 or ff02::1, are still flooded.
+ *
+ * Source lists of IGMPv3/MLDv2 are not tracked: a port listens to a group
+ * for any source, as with the Linux bridge in IGMPv2/MLDv1 mode. brnana is
+ * never a querier, memberships are refreshed by the hosts' answers to the
+ * network's querier and time out otherwise.
+ *
+ * The forwarding path only reads the mdb under RCU; reports and expiry
+ * update it under br->mdb_lock.
+ */
+#include <linux/if_bridge.h>
+#include <linux/igmp.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <net/addrconf.h>
+#include <net/ip.h>
+#include <net/mld.h>
+
+#include "brnana.h"
+
+/** Listener timeout: robustness (2) * query interval (125s) + 10s */
+#define BRNANA_MCAST_MEMBERSHIP_INTERVAL (260 * HZ)
+/** Router port timeout, the "other querier present" interval */
+#define BRNANA_MCAST_ROUTER_INTERVAL (255 * HZ)
+/** Grace period after a leave, for other listeners to answer the query */
+#define BRNANA_MCAST_LAST_MEMBER_INTERVAL (2 * HZ)
+/** Period of the membership expiry work */
+#define BRNANA_MCAST_GC_INTERVAL HZ
+
+/**
+ * brnana_mdb_routers_only - Destination of reports: router ports only
+ *
+ * Reports must reach the querier but no other listener, otherwise IGMPv2
+ * hosts suppress their own reports and go unnoticed. An entry with no
+ * listeners restricts a frame to router ports.
+ */
+static const struct brnana_mdb_entry brnana_mdb_routers_only;
+
+/**
+ * brnana_mdb_hash - Hash a multicast group into a bucket index
+ * @group: The group, zero-padded
+ *
+ * Return: A bucket index in [0, BRNANA_MDB_HASH_SIZE).
+ */
+static inline u32 brnana_mdb_hash(const struct brnana_ip *group)
+{
+    return jhash(group, sizeof(*group), 0) & (BRNANA_MDB_HASH_SIZE - 1);
+}
+
+/**
+ * brnana_mdb_find_rcu - Look up a multicast group
+ * @br:    The bridge
+ * @group: The group
+ *
+ * Must be called under rcu_read_lock() or br->mdb_lock.
+ *
+ * Return: The matching entry, or NULL.
+ */
+static struct brnana_mdb_entry *brnana_mdb_find_rcu(
+    struct brnana_if *br, const struct brnana_ip *group)
+{
+    struct hlist_head *head = &br->mdb_hash[brnana_mdb_hash(group)];
+    struct brnana_mdb_entry *mp;
+
+    hlist_for_each_entry_rcu (mp, head, hlist,
+                              lockdep_is_held(&br->mdb_lock)) {
+        if (!memcmp(&mp->group, group, sizeof(*group)))
+            return mp;
+    }
+
+    return NULL;
+}
+
+/**
+ * brnana_mdb_del_member - Remove a listener from a group
+ * @br: The bridge
+ * @mp: The group
+ * @m:  The listener
+ *
+ * The group itself goes away with its last listener. Called under
+ * br->mdb_lock.
+ */
+static void brnana_mdb_del_member(struct brnana_if *br,
+                                  struct brnana_mdb_entry *mp,
+                                  struct brnana_mdb_member *m)
+{
+    clear_bit(m->port->port_no, mp->ports);
+    list_del_rcu(&m->list);
+    kfree_rcu(m, rcu);
+
+    if (list_empty(&mp->members)) {
+        hlist_del_rcu(&mp->hlist);
+        kfree_rcu(mp, rcu);
+        --br->mdb_count;
+    }
+}
+
+/**
+ * brnana_mcast_join - Make a port a listener of a group, or refresh it
+ * @br:    The bridge
+ * @p:     The port a report was received on
+ * @group: The reported group
+ *
+ * Called from the receive path in softirq context.
+ */
+static void brnana_mcast_join(struct brnana_if *br,
+                              struct brnana_port_if *p,
+                              const struct brnana_ip *group)
+{
+    unsigned long expires = jiffies + BRNANA_MCAST_MEMBERSHIP_INTERVAL;
+    struct brnana_mdb_member *m;
+    struct brnana_mdb_entry *mp;
+
+    spin_lock(&br->mdb_lock);
+
+    mp = brnana_mdb_find_rcu(br, group);
+    if (!mp) {
+        if (br->mdb_count >= BRNANA_MDB_MAX) {
+            net_warn_ratelimited("brnana: %s: multicast database full\n",
+                                 br->dev->name);
+            goto out;
+        }
+
+        mp = kzalloc(sizeof(*mp), GFP_ATOMIC);
+        if (!mp)
+            goto out;
+        mp->group = *group;
+        INIT_LIST_HEAD(&mp->members);
+        hlist_add_head_rcu(&mp->hlist,
+                           &br->mdb_hash[brnana_mdb_hash(group)]);
+        ++br->mdb_count;
+    }
+
+    list_for_each_entry (m, &mp->members, list) {
+        if (m->port == p) {
+            WRITE_ONCE(m->expires, expires);
+            goto out;
+        }
+    }
+
+    m = kmalloc(sizeof(*m), GFP_ATOMIC);
+    if (!m) {
+        if (list_empty(&mp->members)) {
+            hlist_del_rcu(&mp->hlist);
+            kfree_rcu(mp, rcu);
+            --br->mdb_count;
+        }
+        goto out;
+    }
+    m->port = p;
+    m->expires = expires;
+    list_add_tail_rcu(&m->list, &mp->members);
+    set_bit(p->port_no, mp->ports);
+
+out:
+    spin_unlock(&br->mdb_lock);
+}
+
+/**
+ * brnana_mcast_leave - Handle a leave/done message for a group
+ * @br:    The bridge
+ * @p:     The port the message was received on
+ * @group: The group being left
+ *
+ * Other hosts behind @p may still listen. The querier answers a leave with
+ * a group-specific query, so the membership is only shortened to the time
+ * those hosts have to report again.
+ */
+static void brnana_mcast_leave(struct brnana_if *br,
+                               struct brnana_port_if *p,
+                               const struct brnana_ip *group)
+{
+    unsigned long expires = jiffies + BRNANA_MCAST_LAST_MEMBER_INTERVAL;
+    struct brnana_mdb_member *m;
+    struct brnana_mdb_entry *mp;
+
+    spin_lock(&br->mdb_lock);
+
+    mp = brnana_mdb_find_rcu(br, group);
+    if (!mp)
+        goto out;
+
+    list_for_each_entry (m, &mp->members, list) {
+        if (m->port == p && time_after(m->expires, expires)) {
+            WRITE_ONCE(m->expires, expires);
+            break;
+        }
+    }
+
+out:
+    spin_unlock(&br->mdb_lock);
+}
+
+/**
+ * brnana_mcast_mark_router - Note that a query was received on a port
+ * @p: The port
+ */
+static void brnana_mcast_mark_router(struct brnana_port_if *p)
+{
+    /* 0 means "no router", keep a valid deadline away from it */
+    WRITE_ONCE(p->mrouter_expires,
+               (jiffies + BRNANA_MCAST_ROUTER_INTERVAL) | 1);
+}
+
+/**
+ * brnana_mcast_group_ip4 - Build the key of an IPv4 group
+ * @group: Output key
+ * @addr:  The group address
+ * @vid:   The VLAN
+ */
+static void brnana_mcast_group_ip4(struct brnana_ip *group,
+                                   __be32 addr,
+                                   u16 vid)
+{
+    memset(group, 0, sizeof(*group));
+    group->addr.ip4 = addr;
+    group->proto = htons(ETH_P_IP);
+    group->vid = vid;
+}
+
+/**
+ * brnana_mcast_report_ip4 - Apply one group of an IGMP report
+ * @br:   The bridge
+ * @p:    The port the report was received on
+ * @addr: The reported group
+ * @vid:  The VLAN
+ * @join: Whether the port joins or leaves the group
+ */
+static void brnana_mcast_report_ip4(struct brnana_if *br,
+                                    struct brnana_port_if *p,
+                                    __be32 addr,
+                                    u16 vid,
+                                    bool join)
+{
+    struct brnana_ip group;
+
+    if (ipv4_is_local_multicast(addr))
+        return;
+
+    brnana_mcast_group_ip4(&group, addr, vid);
+    if (join)
+        brnana_mcast_join(br, p, &group);
+    else
+        brnana_mcast_leave(br, p, &group);
+}
+
+/**
+ * brnana_mcast_igmp3_report - Apply the group records of an IGMPv3 report
+ * @br:  The bridge
+ * @p:   The port the report was received on
+ * @skb: The report, validated by ip_mc_check_igmp()
+ * @vid: The VLAN
+ *
+ * The report is made linear once and its records are walked by
+ * brnana_grec_next(), which the userspace fuzz target exercises too.
+ */
+static void brnana_mcast_igmp3_report(struct brnana_if *br,
+                                      struct brnana_port_if *p,
+                                      struct sk_buff *skb,
+                                      u16 vid)
+{
+    unsigned int off = skb_transport_offset(skb) + sizeof(struct igmpv3_report);
+    unsigned int end = skb_transport_offset(skb) + ip_transport_len(skb);
+    struct brnana_grec rec;
+    size_t pos = 0;
+    __be32 addr;
+    int ngrec;
+
+    if (!ip_mc_may_pull(skb, end))
+        return;
+
+    ngrec = ntohs(igmpv3_report_hdr(skb)->ngrec);
+
+    for (int i = 0; i < ngrec; ++i) {
+        if (!brnana_grec_next(skb->data + off, end - off, &pos,
+                              sizeof(__be32), &rec))
+            return;
+
+        addr = get_unaligned((const __be32 *) rec.group);
+
+        switch (rec.type) {
+        case IGMPV3_MODE_IS_INCLUDE:
+        case IGMPV3_CHANGE_TO_INCLUDE:
+            /* INCLUDE with no source is a leave */
+            brnana_mcast_report_ip4(br, p, addr, vid, rec.nsrcs != 0);
+            break;
+        case IGMPV3_MODE_IS_EXCLUDE:
+        case IGMPV3_CHANGE_TO_EXCLUDE:
+        case IGMPV3_ALLOW_NEW_SOURCES:
+            brnana_mcast_report_ip4(br, p, addr, vid, true);
+            break;
+        }
+    }
+}
+
+/**
+ * brnana_mcast_ip4_rcv - Snoop an IPv4 multicast frame
+ * @br:  The bridge
+ * @p:   Ingress port, NULL for frames sent by the bridge device
+ * @skb: The frame, with skb->data pointing at the IPv4 header
+ * @vid: The frame's VLAN
+ *
+ * Return: Where the frame must go, see brnana_mcast_rcv().
+ */
+static const struct brnana_mdb_entry *brnana_mcast_ip4_rcv(
+    struct brnana_if *br, struct brnana_port_if *p, struct sk_buff *skb,
+    u16 vid)
+{
+    struct brnana_ip group;
+    struct igmphdr *ih;
+    __be32 daddr;
+    int err;
+
+    err = ip_mc_check_igmp(skb);
+    if (err == -ENOMSG) {
+        /**
+         * Plain multicast data, the IPv4 header has been validated.
+         */
+        daddr = ip_hdr(skb)->daddr;
+        if (ipv4_is_local_multicast(daddr))
+            return NULL;
+
+        brnana_mcast_group_ip4(&group, daddr, vid);
+        return brnana_mdb_find_rcu(br, &group);
+    }
+    if (err)
+        return NULL;
+
+    ih = igmp_hdr(skb);
+    switch (ih->type) {
+    case IGMP_HOST_MEMBERSHIP_REPORT:
+    case IGMPV2_HOST_MEMBERSHIP_REPORT:
+        if (p)
+            brnana_mcast_report_ip4(br, p, ih->group, vid, true);
+        return &brnana_mdb_routers_only;
+    case IGMPV3_HOST_MEMBERSHIP_REPORT:
+        if (p)
+            brnana_mcast_igmp3_report(br, p, skb, vid);
+        return &brnana_mdb_routers_only;
+    case IGMP_HOST_LEAVE_MESSAGE:
+        if (p)
+            brnana_mcast_report_ip4(br, p, ih->group, vid, false);
+        break;
+    case IGMP_HOST_MEMBERSHIP_QUERY:
+        if (p)
+            brnana_mcast_mark_router(p);
+        break;
+    }
+
+    return NULL;
+}
+
+#if IS_ENABLED(CONFIG_IPV6)
+/**
+ * brnana_mcast_group_ip6 - Build the key of an IPv6 group
+ * @group: Output key
+ * @addr:  The group address
+ * @vid:   The VLAN
+ */
+static void brnana_mcast_group_ip6(struct brnana_ip *group,
+                                   const struct in6_addr *addr,
+                                   u16 vid)
+{
+    memset(group, 0, sizeof(*group));
+    group->addr.ip6 = *addr;
+    group->proto = htons(ETH_P_IPV6);
+    group->vid = vid;
+}
+
+/**
+ * brnana_mcast_report_ip6 - Apply one group of an MLD report
+ * @br:   The bridge
+ * @p:    The port the report was received on
+ * @addr: The reported group
+ * @vid:  The VLAN
+ * @join: Whether the port joins or leaves the group
+ */
+static void brnana_mcast_report_ip6(struct brnana_if *br,
+                                    struct brnana_port_if *p,
+                                    const struct in6_addr *addr,
+                                    u16 vid,
+                                    bool join)
+{
+    struct brnana_ip group;
+
+    if (ipv6_addr_is_ll_all_nodes(addr))
+        return;
+
+    brnana_mcast_group_ip6(&group, addr, vid);
+    if (join)
+        brnana_mcast_join(br, p, &group);
+    else
+        brnana_mcast_leave(br, p, &group);
+}
+
+/**
+ * brnana_mcast_mld2_report - Apply the group records of an MLDv2 report
+ * @br:  The bridge
+ * @p:   The port the report was received on
+ * @skb: The report, validated by ipv6_mc_check_mld()
+ * @vid: The VLAN
+ *
+ * Walked like brnana_mcast_igmp3_report().
+ */
+static void brnana_mcast_mld2_report(struct brnana_if *br,
+                                     struct brnana_port_if *p,
+                                     struct sk_buff *skb,
+                                     u16 vid)
+{
+    unsigned int off = skb_transport_offset(skb) + sizeof(struct icmp6hdr);
+    unsigned int end = skb_transport_offset(skb) + ipv6_transport_len(skb);
+    struct mld2_report *mld2r;
+    struct brnana_grec rec;
+    struct in6_addr addr;
+    size_t pos = 0;
+    int ngrec;
+
+    if (!ipv6_mc_may_pull(skb, end))
+        return;
+
+    mld2r = (struct mld2_report *) skb_transport_header(skb);
+    ngrec = ntohs(mld2r->mld2r_ngrec);
+
+    for (int i = 0; i < ngrec; ++i) {
+        if (!brnana_grec_next(skb->data + off, end - off, &pos,
+                              sizeof(struct in6_addr), &rec))
+            return;
+
+        memcpy(&addr, rec.group, sizeof(addr));
+
+        switch (rec.type) {
+        case MLD2_MODE_IS_INCLUDE:
+        case MLD2_CHANGE_TO_INCLUDE:
+            /* INCLUDE with no source is a done */
+            brnana_mcast_report_ip6(br, p, &addr, vid, rec.nsrcs != 0);
+            break;
+        case MLD2_MODE_IS_EXCLUDE:
+        case MLD2_CHANGE_TO_EXCLUDE:
+        case MLD2_ALLOW_NEW_SOURCES:
+            brnana_mcast_report_ip6(br, p, &addr, vid, true);
+            break;
+        }
+    }
+}
+
+/**
+ * brnana_mcast_ip6_rcv - Snoop an IPv6 multicast frame
+ * @br:  The bridge
+ * @p:   Ingress port, NULL for frames sent by the bridge device
+ * @skb: The frame, with skb->data pointing at the IPv6 header
+ * @vid: The frame's VLAN
+ *
+ * Return: Where the frame must go, see brnana_mcast_rcv().
+ */
+static const struct brnana_mdb_entry *brnana_mcast_ip6_rcv(
+    struct brnana_if *br, struct brnana_port_if *p, struct sk_buff *skb,
+    u16 vid)
+{
+    struct brnana_ip group;
+    const struct in6_addr *daddr;
+    struct mld_msg *mld;
+    int err;
+
+    err = ipv6_mc_check_mld(skb);
+    if (err == -ENOMSG || err == -ENODATA) {
+        /**
+         * Plain multicast data, the IPv6 header has been validated.
+         */
+        daddr = &ipv6_hdr(skb)->daddr;
+        if (ipv6_addr_is_ll_all_nodes(daddr))
+            return NULL;
+
+        brnana_mcast_group_ip6(&group, daddr, vid);
+        return brnana_mdb_find_rcu(br, &group);
+    }
+    if (err)
+        return NULL;
+
+    mld = (struct mld_msg *) skb_transport_header(skb);
+    switch (mld->mld_type) {
+    case ICMPV6_MGM_REPORT:
+        if (p)
+            brnana_mcast_report_ip6(br, p, &mld->mld_mca, vid, true);
+        return &brnana_mdb_routers_only;
+    case ICMPV6_MLD2_REPORT:
+        if (p)
+            brnana_mcast_mld2_report(br, p, skb, vid);
+        return &brnana_mdb_routers_only;
+    case ICMPV6_MGM_REDUCTION:
+        if (p)
+            brnana_mcast_report_ip6(br, p, &mld->mld_mca, vid, false);
+        break;
+    case ICMPV6_MGM_QUERY:
+        if (p)
+            brnana_mcast_mark_router(p);
+        break;
+    }
+
+    return NULL;
+}
+#endif
+
+/**
+ * brnana_mcast_rcv - Snoop a multicast frame and find where it must go
+ * @br:  The bridge
+ * @p:   Ingress port, NULL for frames sent by the bridge device
+ * @skb: The frame, with skb->data pointing at the network header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Reports and queries received on a port update the mdb. Frames sent by the
+ * bridge device are not snooped, but still restricted to listeners.
+ * Called under RCU; the returned entry is valid until it ends.
+ *
+ * Return:
+ *   The entry restricting the ports the frame goes to (listeners and
+ *   router ports), or NULL if it must be flooded: snooping off, broadcast,
+ *   non-IP, link-local group or group without listeners.
+ */
+const struct brnana_mdb_entry *brnana_mcast_rcv(struct brnana_if *br,
+                                                struct brnana_port_if *p,
+                                                struct sk_buff *skb,
+                                                u16 vid)
+{
+    if (!READ_ONCE(br->mcast_snooping) ||
+        is_broadcast_ether_addr(eth_hdr(skb)->h_dest))
+        return NULL;
+
+    switch (skb->protocol) {
+    case htons(ETH_P_IP):
+        return brnana_mcast_ip4_rcv(br, p, skb, vid);
+#if IS_ENABLED(CONFIG_IPV6)
+    case htons(ETH_P_IPV6):
+        return brnana_mcast_ip6_rcv(br, p, skb, vid);
+#endif
+    }
+
+    return NULL;
+}
+
+/**
+ * brnana_mcast_gc - Expire memberships that were not refreshed
+ * @work: The bridge's mcast_gc work
+ *
+ * Runs every BRNANA_MCAST_GC_INTERVAL while the bridge is up.
+ */
+static void brnana_mcast_gc(struct work_struct *work)
+{
+    struct brnana_if *br = container_of(to_delayed_work(work),
+                                        struct brnana_if, mcast_gc);
+    struct brnana_mdb_member *m, *tmp;
+    struct brnana_mdb_entry *mp;
+    struct hlist_node *next;
+    unsigned long now = jiffies;
+
+    spin_lock_bh(&br->mdb_lock);
+
+    for (int i = 0; i < BRNANA_MDB_HASH_SIZE; ++i) {
+        hlist_for_each_entry_safe (mp, next, &br->mdb_hash[i], hlist) {
+            list_for_each_entry_safe (m, tmp, &mp->members, list) {
+                if (time_after_eq(now, m->expires))
+                    brnana_mdb_del_member(br, mp, m);
+            }
+        }
+    }
+
+    spin_unlock_bh(&br->mdb_lock);
+
+    queue_delayed_work(system_power_efficient_wq, &br->mcast_gc,
+                       round_jiffies_relative(BRNANA_MCAST_GC_INTERVAL));
+}
+
+/**
+ * brnana_mcast_del_match - Remove the listeners on one port or on all
+ * @br: The bridge
+ * @p:  The port, or NULL for every port
+ */
+static void brnana_mcast_del_match(struct brnana_if *br,
+                                   struct brnana_port_if *p)
+{
+    struct brnana_mdb_member *m, *tmp;
+    struct brnana_mdb_entry *mp;
+    struct hlist_node *next;
+
+    spin_lock_bh(&br->mdb_lock);
+
+    for (int i = 0; i < BRNANA_MDB_HASH_SIZE; ++i) {
+        hlist_for_each_entry_safe (mp, next, &br->mdb_hash[i], hlist) {
+            list_for_each_entry_safe (m, tmp, &mp->members, list) {
+                if (!p || m->port == p)
+                    brnana_mdb_del_member(br, mp, m);
+            }
+        }
+    }
+
+    spin_unlock_bh(&br->mdb_lock);
+}
+
+/**
+ * brnana_mcast_del_port - Forget the memberships of a port being removed
+ * @br: The bridge
+ * @p:  The port
+ *
+ * Must be called before @p's port number is reused or @p is freed.
+ */
+void brnana_mcast_del_port(struct brnana_if *br, struct brnana_port_if *p)
+{
+    brnana_mcast_del_match(br, p);
+}
+
+/**
+ * brnana_mcast_flush - Forget every multicast membership of a bridge
+ * @br: The bridge
+ *
+ * Multicast is flooded again until hosts report anew.
+ */
+void brnana_mcast_flush(struct brnana_if *br)
+{
+    brnana_mcast_del_match(br, NULL);
+}
+
+/**
+ * brnana_mcast_snooping_set - Turn IGMP/MLD snooping on or off
+ * @br: The bridge
+ * @on: The new state
+ *
+ * Turning snooping off floods all multicast again and drops the mdb.
+ * Called under RTNL.
+ */
+void brnana_mcast_snooping_set(struct brnana_if *br, bool on)
+{
+    ASSERT_RTNL();
+
+    if (br->mcast_snooping == on)
+        return;
+
+    WRITE_ONCE(br->mcast_snooping, on);
+    if (!on)
+        brnana_mcast_flush(br);
+}
+
+/**
+ * brnana_mcast_open - Start expiring memberships of a bridge
+ * @br: The bridge
+ */
+void brnana_mcast_open(struct brnana_if *br)
+{
+    queue_delayed_work(system_power_efficient_wq, &br->mcast_gc,
+                       round_jiffies_relative(BRNANA_MCAST_GC_INTERVAL));
+}
+
+/**
+ * brnana_mcast_stop - Stop expiring memberships of a bridge
+ * @br: The bridge
+ *
+ * No report is snooped while the bridge is down, so memberships are
+ * dropped rather than left to expire later.
+ */
+void brnana_mcast_stop(struct brnana_if *br)
+{
+    cancel_delayed_work_sync(&br->mcast_gc);
+    brnana_mcast_flush(br);
+}
+
+/**
+ * brnana_mcast_init - Initialize the multicast state of a bridge
+ * @br: The bridge
+ *
+ * Snooping is on by default, as with the Linux bridge.
+ */
+void brnana_mcast_init(struct brnana_if *br)
+{
+    br->mcast_snooping = true;
+    spin_lock_init(&br->mdb_lock);
+    INIT_DELAYED_WORK(&br->mcast_gc, brnana_mcast_gc);
+
+    for (int i = 0; i < BRNANA_MDB_HASH_SIZE; ++i)
+        INIT_HLIST_HEAD(&br->mdb_hash[i]);
+}
+
+/**
+ * brnana_mdb_fill_entry - Emit one group and its listeners
+ * @skb: The dump being filled
+ * @mp:  The group
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_mdb_fill_entry(struct sk_buff *skb,
+                                 const struct brnana_mdb_entry *mp)
+{
+    struct brnana_mdb_member *m;
+    struct nlattr *nest;
+
+    list_for_each_entry_rcu (m, &mp->members, list) {
+        struct br_mdb_entry e = {
+            .ifindex = m->port->dev->ifindex,
+            .state = MDB_TEMPORARY,
+            .vid = mp->group.vid,
+            .addr.proto = mp->group.proto,
+        };
+
+        memcpy(&e.addr.u, &mp->group.addr, sizeof(mp->group.addr));
+
+        nest = nla_nest_start_noflag(skb, MDBA_MDB_ENTRY_INFO);
+        if (!nest)
+            return -EMSGSIZE;
+        if (nla_put_nohdr(skb, sizeof(e), &e) ||
+            nla_put_u32(skb, MDBA_MDB_EATTR_TIMER,
+                        jiffies_delta_to_clock_t(READ_ONCE(m->expires) -
+                                                 jiffies))) {
+            nla_nest_cancel(skb, nest);
+            return -EMSGSIZE;
+        }
+        nla_nest_end(skb, nest);
+    }
+
+    return 0;
+}
+
+/**
+ * brnana_mdb_fill - Emit the groups of a bridge, resuming a partial dump
+ * @br:  The bridge
+ * @skb: The dump being filled
+ * @cb:  Dump state; cb->args[1] counts the groups already emitted
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_mdb_fill(struct brnana_if *br,
+                           struct sk_buff *skb,
+                           struct netlink_callback *cb)
+{
+    struct nlattr *nest, *nest_entry;
+    struct brnana_mdb_entry *mp;
+    long idx = 0, s_idx = cb->args[1];
+    int err = 0;
+
+    nest = nla_nest_start_noflag(skb, MDBA_MDB);
+    if (!nest)
+        return -EMSGSIZE;
+
+    for (int i = 0; i < BRNANA_MDB_HASH_SIZE && !err; ++i) {
+        hlist_for_each_entry_rcu (mp, &br->mdb_hash[i], hlist) {
+            if (idx < s_idx)
+                goto skip;
+
+            nest_entry = nla_nest_start_noflag(skb, MDBA_MDB_ENTRY);
+            if (!nest_entry) {
+                err = -EMSGSIZE;
+                break;
+            }
+            err = brnana_mdb_fill_entry(skb, mp);
+            if (err) {
+                nla_nest_cancel(skb, nest_entry);
+                break;
+            }
+            nla_nest_end(skb, nest_entry);
+skip:
+            ++idx;
+        }
+    }
+
+    cb->args[1] = idx;
+    nla_nest_end(skb, nest);
+    return err;
+}
+
+/**
+ * brnana_mdb_fill_routers - Emit the ports currently leading to a router
+ * @br:  The bridge
+ * @skb: The dump being filled
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_mdb_fill_routers(struct brnana_if *br, struct sk_buff *skb)
+{
+    struct brnana_port_if *p;
+    unsigned long mrouter;
+    struct nlattr *nest;
+
+    nest = nla_nest_start_noflag(skb, MDBA_ROUTER);
+    if (!nest)
+        return -EMSGSIZE;
+
+    list_for_each_entry_rcu (p, &br->port_list, link) {
+        mrouter = READ_ONCE(p->mrouter_expires);
+        if (!mrouter || !time_before(jiffies, mrouter))
+            continue;
+        if (nla_put_u32(skb, MDBA_ROUTER_PORT, p->dev->ifindex)) {
+            nla_nest_cancel(skb, nest);
+            return -EMSGSIZE;
+        }
+    }
+
+    nla_nest_end(skb, nest);
+    return 0;
+}
+
+/**
+ * brnana_mdb_dump - ndo_mdb_dump callback (`bridge mdb show`)
+ * @dev: The bridge
+ * @skb: The dump being filled
+ * @cb:  Dump state; cb->args[1] is the next entry to emit
+ *
+ * Return: 0 when done with @dev, -EMSGSIZE to be called again.
+ */
+int brnana_mdb_dump(struct net_device *dev,
+                    struct sk_buff *skb,
+                    struct netlink_callback *cb)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct br_port_msg *bpm;
+    struct nlmsghdr *nlh;
+    int err;
+
+    nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+                    RTM_GETMDB, sizeof(*bpm), NLM_F_MULTI);
+    if (!nlh)
+        return -EMSGSIZE;
+
+    bpm = nlmsg_data(nlh);
+    memset(bpm, 0, sizeof(*bpm));
+    bpm->family = AF_BRIDGE;
+    bpm->ifindex = dev->ifindex;
+
+    rcu_read_lock();
+    err = brnana_mdb_fill(br, skb, cb);
+    if (!err)
+        err = brnana_mdb_fill_routers(br, skb);
+    rcu_read_unlock();
+
+    nlmsg_end(skb, nlh);
+    return err;
+}
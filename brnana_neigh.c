@@ -0,0 +1,550 @@
+/**
+ * @file brnana_neigh.c
+ * @brief ARP and IPv6 neighbor discovery suppression of the brnana bridge
+ *
+ * With neigh_suppress on, the bridge snoops the IP to MAC bindings hosts
+ * announce in ARP packets and neighbor solicitations/advertisements, and
+ * keeps them in a per-bridge table keyed by (IP, VLAN) next to the FDB. An
+ * ARP request or neighbor solicitation (NS) for an address in the table is
+ * answered by the bridge on the ingress port, on behalf of the target,
+ * instead of being flooded to every port. Requests for unknown addresses,
+ * ARP probes, gratuitous ARP and duplicate address detection are forwarded
+ * as usual.
+ *
+ * A binding is only used while its MAC address is in the FDB behind another
+ * port than the requester's: a host on the requester's own segment answers
+ * for itself, and a host whose FDB entry is gone is asked again.
+ *
+ * The forwarding path reads the table under RCU; learning and expiry update
+ * it under br->neigh_lock.
+ */
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <net/arp.h>
+#include <net/ip6_checksum.h>
+#include <net/ipv6.h>
+#include <net/ndisc.h>
+
+#include "brnana.h"
+
+static_assert(BRNANA_ARP_LEN ==
+              sizeof(struct arphdr) + 2 * (ETH_ALEN + sizeof(__be32)));
+static_assert(BRNANA_ND_LEN == sizeof(struct ipv6hdr) + sizeof(struct nd_msg));
+
+/** Lifetime of a binding that is not announced again */
+#define BRNANA_NEIGH_TIMEOUT (300 * HZ)
+/** Period of the expiry work */
+#define BRNANA_NEIGH_GC_INTERVAL (10 * HZ)
+
+/**
+ * brnana_neigh_hash - Hash an IP address into a bucket index
+ * @ip: The address, zero-padded
+ *
+ * Return: A bucket index in [0, BRNANA_NEIGH_HASH_SIZE).
+ */
+static inline u32 brnana_neigh_hash(const struct brnana_ip *ip)
+{
+    return jhash(ip, sizeof(*ip), 0) & (BRNANA_NEIGH_HASH_SIZE - 1);
+}
+
+/**
+ * brnana_neigh_find_rcu - Look up an IP address
+ * @br: The bridge
+ * @ip: The address
+ *
+ * Must be called under rcu_read_lock() or br->neigh_lock.
+ *
+ * Return: The matching entry, or NULL.
+ */
+static struct brnana_neigh_entry *brnana_neigh_find_rcu(
+    struct brnana_if *br, const struct brnana_ip *ip)
+{
+    struct hlist_head *head = &br->neigh_hash[brnana_neigh_hash(ip)];
+    struct brnana_neigh_entry *n;
+
+    hlist_for_each_entry_rcu (n, head, hlist,
+                              lockdep_is_held(&br->neigh_lock)) {
+        if (!memcmp(&n->ip, ip, sizeof(*ip)))
+            return n;
+    }
+
+    return NULL;
+}
+
+/**
+ * brnana_neigh_del - Remove an entry
+ * @br: The bridge
+ * @n:  The entry
+ *
+ * Called under br->neigh_lock.
+ */
+static void brnana_neigh_del(struct brnana_if *br, struct brnana_neigh_entry *n)
+{
+    hlist_del_rcu(&n->hlist);
+    kfree_rcu(n, rcu);
+    --br->neigh_count;
+}
+
+/**
+ * brnana_neigh_learn - Record the MAC address a host announced for an IP
+ * @br:  The bridge
+ * @ip:  The announced address
+ * @mac: The host's MAC address
+ *
+ * Refreshing a known binding takes no lock, as in brnana_fdb_update(). A
+ * binding to a new MAC address replaces the entry. Called from the receive
+ * path in softirq context.
+ */
+static void brnana_neigh_learn(struct brnana_if *br,
+                               const struct brnana_ip *ip,
+                               const unsigned char *mac)
+{
+    struct brnana_neigh_entry *n, *old;
+    unsigned long now = jiffies;
+
+    if (!is_valid_ether_addr(mac))
+        return;
+
+    n = brnana_neigh_find_rcu(br, ip);
+    if (likely(n && ether_addr_equal(n->mac, mac))) {
+        if (READ_ONCE(n->updated) != now)
+            WRITE_ONCE(n->updated, now);
+        return;
+    }
+
+    spin_lock(&br->neigh_lock);
+
+    old = brnana_neigh_find_rcu(br, ip);
+    if (old && ether_addr_equal(old->mac, mac)) {
+        WRITE_ONCE(old->updated, now);
+        goto out;
+    }
+    if (!old && br->neigh_count >= BRNANA_NEIGH_MAX) {
+        net_warn_ratelimited("brnana: %s: neighbor table full\n",
+                             br->dev->name);
+        goto out;
+    }
+
+    n = kmalloc(sizeof(*n), GFP_ATOMIC);
+    if (!n)
+        goto out;
+    n->ip = *ip;
+    ether_addr_copy(n->mac, mac);
+    n->updated = now;
+
+    if (old) {
+        hlist_replace_rcu(&old->hlist, &n->hlist);
+        kfree_rcu(old, rcu);
+    } else {
+        hlist_add_head_rcu(&n->hlist, &br->neigh_hash[brnana_neigh_hash(ip)]);
+        ++br->neigh_count;
+    }
+
+out:
+    spin_unlock(&br->neigh_lock);
+}
+
+/**
+ * brnana_neigh_target_rcu - Find a binding the bridge may answer with
+ * @br: The bridge
+ * @p:  The port the request was received on
+ * @ip: The requested address
+ *
+ * Return: The entry, or NULL if the request must be forwarded.
+ */
+static const struct brnana_neigh_entry *brnana_neigh_target_rcu(
+    struct brnana_if *br, struct brnana_port_if *p, const struct brnana_ip *ip)
+{
+    const struct brnana_neigh_entry *n;
+    struct brnana_fdb_entry *f;
+    struct brnana_port_if *dst;
+
+    n = brnana_neigh_find_rcu(br, ip);
+    if (!n || time_after_eq(jiffies,
+                            READ_ONCE(n->updated) + BRNANA_NEIGH_TIMEOUT))
+        return NULL;
+
+    f = brnana_fdb_find_rcu(&br->fdb, n->mac, ip->vid);
+    if (!f)
+        return NULL;
+
+    dst = brnana_fdb_port(READ_ONCE(f->dst));
+    if (dst == p || !brnana_port_can_xmit(dst))
+        return NULL;
+
+    return n;
+}
+
+/**
+ * brnana_neigh_xmit - Send a reply out of the port a request came from
+ * @p:       The ingress port of the request
+ * @request: The request
+ * @reply:   The reply, with its Ethernet header
+ * @vid:     The request's VLAN, 0 without VLAN filtering
+ */
+static void brnana_neigh_xmit(struct brnana_port_if *p,
+                              const struct sk_buff *request,
+                              struct sk_buff *reply,
+                              u16 vid)
+{
+    /**
+     * Answer in the request's VLAN, tagged unless the port sends it
+     * untagged.
+     */
+    if (skb_vlan_tag_present(request))
+        __vlan_hwaccel_put_tag(reply, request->vlan_proto,
+                               skb_vlan_tag_get(request));
+    brnana_vlan_egress(&p->vlans, vid, reply);
+
+    brnana_stats_add(p->br->stats, BRNANA_STAT_NEIGH_SUPPRESS, 1);
+    brnana_stats_add(p->stats, BRNANA_STAT_NEIGH_SUPPRESS, 1);
+    brnana_stats_pkt(p->stats, BRNANA_STAT_TX_PACKETS, reply->len);
+
+    dev_queue_xmit(reply);
+}
+
+/**
+ * brnana_neigh_ip4 - Build the key of an IPv4 address
+ * @ip:   Output key
+ * @addr: The address
+ * @vid:  The VLAN
+ */
+static void brnana_neigh_ip4(struct brnana_ip *ip, __be32 addr, u16 vid)
+{
+    memset(ip, 0, sizeof(*ip));
+    ip->addr.ip4 = addr;
+    ip->proto = htons(ETH_P_IP);
+    ip->vid = vid;
+}
+
+/**
+ * brnana_neigh_arp_rcv - Learn from an ARP packet and answer a request
+ * @br:  The bridge
+ * @p:   The ingress port
+ * @skb: The frame, with skb->data pointing at the ARP header
+ * @vid: The frame's VLAN
+ *
+ * Return: true if a reply was sent.
+ */
+static bool brnana_neigh_arp_rcv(struct brnana_if *br,
+                                 struct brnana_port_if *p,
+                                 struct sk_buff *skb,
+                                 u16 vid)
+{
+    const struct brnana_neigh_entry *n;
+    struct brnana_arp arp;
+    struct sk_buff *reply;
+    struct brnana_ip ip;
+
+    if (!pskb_may_pull(skb, BRNANA_ARP_LEN) ||
+        !brnana_arp_parse(skb->data, BRNANA_ARP_LEN, &arp))
+        return false;
+
+    if (ipv4_is_multicast(arp.tip) || ipv4_is_loopback(arp.tip))
+        return false;
+
+    /* ARP probes (RFC 5227) carry no sender address yet */
+    if (arp.sip) {
+        brnana_neigh_ip4(&ip, arp.sip, vid);
+        brnana_neigh_learn(br, &ip, arp.sha);
+    }
+
+    /**
+     * Gratuitous ARP and probes are meant for every host, or for the one
+     * that might already own the address.
+     */
+    if (arp.op != ARPOP_REQUEST || !arp.sip || arp.sip == arp.tip)
+        return false;
+
+    brnana_neigh_ip4(&ip, arp.tip, vid);
+    n = brnana_neigh_target_rcu(br, p, &ip);
+    if (!n)
+        return false;
+
+    reply = arp_create(ARPOP_REPLY, ETH_P_ARP, arp.sip, p->dev, arp.tip,
+                       arp.sha, n->mac, arp.sha);
+    if (!reply)
+        return false;
+
+    brnana_neigh_xmit(p, skb, reply, vid);
+    return true;
+}
+
+#if IS_ENABLED(CONFIG_IPV6)
+/**
+ * brnana_neigh_ip6 - Build the key of an IPv6 address
+ * @ip:   Output key
+ * @addr: The address
+ * @vid:  The VLAN
+ */
+static void brnana_neigh_ip6(struct brnana_ip *ip,
+                             const struct in6_addr *addr,
+                             u16 vid)
+{
+    memset(ip, 0, sizeof(*ip));
+    ip->addr.ip6 = *addr;
+    ip->proto = htons(ETH_P_IPV6);
+    ip->vid = vid;
+}
+
+/**
+ * brnana_neigh_build_na - Build a neighbor advertisement answering an NS
+ * @p:       The port the NS was received on
+ * @request: The NS
+ * @target:  The address the NS solicits, inside @request
+ * @mac:     The target's MAC address
+ *
+ * The advertisement is solicited but does not override: it comes from a
+ * proxy, the target's own advertisements take precedence (RFC 4861 7.2.8).
+ *
+ * Return: The advertisement with its Ethernet header, or NULL.
+ */
+static struct sk_buff *brnana_neigh_build_na(struct brnana_port_if *p,
+                                             const struct sk_buff *request,
+                                             const struct in6_addr *target,
+                                             const unsigned char *mac)
+{
+    unsigned int len = sizeof(struct nd_msg) + NDISC_OPT_SPACE(ETH_ALEN);
+    struct net_device *dev = p->dev;
+    struct sk_buff *reply;
+    struct ipv6hdr *ip6h;
+    struct nd_msg *na;
+
+    reply = alloc_skb(LL_RESERVED_SPACE(dev) + sizeof(*ip6h) + len +
+                          dev->needed_tailroom,
+                      GFP_ATOMIC);
+    if (!reply)
+        return NULL;
+
+    skb_reserve(reply, LL_RESERVED_SPACE(dev));
+    reply->dev = dev;
+    reply->protocol = htons(ETH_P_IPV6);
+
+    skb_reset_network_header(reply);
+    ip6h = skb_put(reply, sizeof(*ip6h));
+    ip6_flow_hdr(ip6h, 0, 0);
+    ip6h->payload_len = htons(len);
+    ip6h->nexthdr = IPPROTO_ICMPV6;
+    ip6h->hop_limit = 255;
+    ip6h->saddr = *target;
+    ip6h->daddr = ipv6_hdr(request)->saddr;
+
+    skb_set_transport_header(reply, sizeof(*ip6h));
+    na = skb_put_zero(reply, len);
+    na->icmph.icmp6_type = NDISC_NEIGHBOUR_ADVERTISEMENT;
+    na->icmph.icmp6_solicited = 1;
+    na->target = *target;
+    na->opt[0] = ND_OPT_TARGET_LL_ADDR;
+    na->opt[1] = NDISC_OPT_SPACE(ETH_ALEN) >> 3;
+    ether_addr_copy(&na->opt[2], mac);
+    na->icmph.icmp6_cksum = csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr, len,
+                                            IPPROTO_ICMPV6,
+                                            csum_partial(na, len, 0));
+
+    if (dev_hard_header(reply, dev, ETH_P_IPV6, eth_hdr(request)->h_source,
+                        mac, reply->len) < 0) {
+        kfree_skb(reply);
+        return NULL;
+    }
+
+    return reply;
+}
+
+/**
+ * brnana_neigh_nd_rcv - Learn from NDISC and answer a neighbor solicitation
+ * @br:  The bridge
+ * @p:   The ingress port
+ * @skb: The frame, with skb->data pointing at the IPv6 header
+ * @vid: The frame's VLAN
+ *
+ * Return: true if a reply was sent.
+ */
+static bool brnana_neigh_nd_rcv(struct brnana_if *br,
+                                struct brnana_port_if *p,
+                                struct sk_buff *skb,
+                                u16 vid)
+{
+    const struct in6_addr *saddr, *target;
+    const struct brnana_neigh_entry *n;
+    struct sk_buff *reply;
+    struct brnana_ip ip;
+    struct brnana_nd nd;
+
+    /* Only pull the rest of ICMPv6 packets */
+    if (!pskb_may_pull(skb, sizeof(struct ipv6hdr)) ||
+        ipv6_hdr(skb)->nexthdr != IPPROTO_ICMPV6 ||
+        !pskb_may_pull(skb, BRNANA_ND_LEN) ||
+        !brnana_nd_parse(skb->data, BRNANA_ND_LEN, &nd))
+        return false;
+
+    saddr = (const struct in6_addr *) nd.saddr;
+    target = (const struct in6_addr *) nd.target;
+
+    if (nd.type == NDISC_NEIGHBOUR_ADVERTISEMENT) {
+        brnana_neigh_ip6(&ip, target, vid);
+        brnana_neigh_learn(br, &ip, eth_hdr(skb)->h_source);
+        return false;
+    }
+
+    /* Duplicate address detection must reach the address's owner */
+    if (ipv6_addr_any(saddr))
+        return false;
+
+    brnana_neigh_ip6(&ip, saddr, vid);
+    brnana_neigh_learn(br, &ip, eth_hdr(skb)->h_source);
+
+    brnana_neigh_ip6(&ip, target, vid);
+    n = brnana_neigh_target_rcu(br, p, &ip);
+    if (!n)
+        return false;
+
+    reply = brnana_neigh_build_na(p, skb, target, n->mac);
+    if (!reply)
+        return false;
+
+    brnana_neigh_xmit(p, skb, reply, vid);
+    return true;
+}
+#endif
+
+/**
+ * brnana_neigh_rcv - Learn from ARP/NDISC and answer requests for known hosts
+ * @br:  The bridge
+ * @p:   The ingress port
+ * @skb: The frame, with skb->data pointing at the network header
+ * @vid: The frame's VLAN, 0 without VLAN filtering
+ *
+ * Every ARP packet and NS/NA received on a port refreshes the table, whatever
+ * its destination. Called under RCU.
+ *
+ * Return: true if a reply was sent on @p and @skb must not be flooded.
+ */
+bool brnana_neigh_rcv(struct brnana_if *br,
+                      struct brnana_port_if *p,
+                      struct sk_buff *skb,
+                      u16 vid)
+{
+    if (!READ_ONCE(br->neigh_suppress))
+        return false;
+
+    switch (skb->protocol) {
+    case htons(ETH_P_ARP):
+        return brnana_neigh_arp_rcv(br, p, skb, vid);
+#if IS_ENABLED(CONFIG_IPV6)
+    case htons(ETH_P_IPV6):
+        return brnana_neigh_nd_rcv(br, p, skb, vid);
+#endif
+    }
+
+    return false;
+}
+
+/**
+ * brnana_neigh_gc - Expire bindings that were not announced again
+ * @work: The bridge's neigh_gc work
+ *
+ * Runs every BRNANA_NEIGH_GC_INTERVAL while the bridge is up.
+ */
+static void brnana_neigh_gc(struct work_struct *work)
+{
+    struct brnana_if *br = container_of(to_delayed_work(work),
+                                        struct brnana_if, neigh_gc);
+    struct brnana_neigh_entry *n;
+    struct hlist_node *next;
+    unsigned long now = jiffies;
+
+    spin_lock_bh(&br->neigh_lock);
+
+    for (int i = 0; i < BRNANA_NEIGH_HASH_SIZE; ++i) {
+        hlist_for_each_entry_safe (n, next, &br->neigh_hash[i], hlist) {
+            if (time_after_eq(now, n->updated + BRNANA_NEIGH_TIMEOUT))
+                brnana_neigh_del(br, n);
+        }
+    }
+
+    spin_unlock_bh(&br->neigh_lock);
+
+    queue_delayed_work(system_power_efficient_wq, &br->neigh_gc,
+                       round_jiffies_relative(BRNANA_NEIGH_GC_INTERVAL));
+}
+
+/**
+ * brnana_neigh_flush - Forget every neighbor entry of a bridge
+ * @br: The bridge
+ *
+ * Requests are flooded again until hosts announce themselves anew.
+ */
+void brnana_neigh_flush(struct brnana_if *br)
+{
+    struct brnana_neigh_entry *n;
+    struct hlist_node *next;
+
+    spin_lock_bh(&br->neigh_lock);
+
+    for (int i = 0; i < BRNANA_NEIGH_HASH_SIZE; ++i) {
+        hlist_for_each_entry_safe (n, next, &br->neigh_hash[i], hlist)
+            brnana_neigh_del(br, n);
+    }
+
+    spin_unlock_bh(&br->neigh_lock);
+}
+
+/**
+ * brnana_neigh_suppress_set - Turn ARP/ND suppression on or off
+ * @br: The bridge
+ * @on: The new state
+ *
+ * Turning suppression off floods every request again and drops the table.
+ * Called under RTNL.
+ */
+void brnana_neigh_suppress_set(struct brnana_if *br, bool on)
+{
+    ASSERT_RTNL();
+
+    if (br->neigh_suppress == on)
+        return;
+
+    WRITE_ONCE(br->neigh_suppress, on);
+    if (!on)
+        brnana_neigh_flush(br);
+}
+
+/**
+ * brnana_neigh_open - Start expiring neighbor entries of a bridge
+ * @br: The bridge
+ */
+void brnana_neigh_open(struct brnana_if *br)
+{
+    queue_delayed_work(system_power_efficient_wq, &br->neigh_gc,
+                       round_jiffies_relative(BRNANA_NEIGH_GC_INTERVAL));
+}
+
+/**
+ * brnana_neigh_stop - Stop expiring neighbor entries of a bridge
+ * @br: The bridge
+ *
+ * Nothing is learned while the bridge is down, so the table is dropped
+ * rather than left to expire later.
+ */
+void brnana_neigh_stop(struct brnana_if *br)
+{
+    cancel_delayed_work_sync(&br->neigh_gc);
+    brnana_neigh_flush(br);
+}
+
+/**
+ * brnana_neigh_init - Initialize the ARP/ND suppression state of a bridge
+ * @br: The bridge
+ *
+ * Suppression is off by default: answering for other hosts hides them from
+ * their own ARP/NDISC traffic, which has to be asked for.
+ */
+void brnana_neigh_init(struct brnana_if *br)
+{
+    br->neigh_suppress = false;
+    spin_lock_init(&br->neigh_lock);
+    INIT_DELAYED_WORK(&br->neigh_gc, brnana_neigh_gc);
+
+    for (int i = 0; i < BRNANA_NEIGH_HASH_SIZE; ++i)
+        INIT_HLIST_HEAD(&br->neigh_hash[i]);
+}
@@ -0,0 +1,133 @@
+/**
+ * @file brnana_qos.c
+ * @brief Egress priority of forwarded frames from their PCP or DSCP
+ *
+ * Without it, every forwarded frame leaves with skb->priority 0 and lands
+ * on whatever TX queue the egress device hashes its flow to, so control
+ * traffic waits behind bulk transfers in the same ring. A bridge may trust
+ * the 802.1p PCP of the VLAN tag, the DSCP of IP packets, or both, and
+ * translate them to skb->priority through per-bridge maps set under
+ * /sys/class/net/<bridge>/brnana/. The egress device's queue selection
+ * (its prio_tc_map with mqprio or DCB) and qdisc (prio, ets, ...) then
+ * take it from there.
+ *
+ * Frames are classified once on ingress, before flooding clones them, so
+ * every replica inherits the priority and no packet data is copied or
+ * written. Frames sent by the bridge device itself keep the priority their
+ * socket gave them.
+ */
+#include "brnana.h"
+
+/**
+ * brnana_qos_init - Set a bridge's default QoS maps
+ * @br: The bridge
+ *
+ * PCP n maps to priority n, and a DSCP to the priority of its class
+ * selector (the three high bits), the usual 802.1p/DiffServ alignment.
+ * Neither is trusted until configured.
+ */
+void brnana_qos_init(struct brnana_if *br)
+{
+    br->qos.trust = 0;
+
+    for (int i = 0; i < BRNANA_QOS_PCP_NUM; ++i)
+        br->qos.pcp[i] = i;
+    for (int i = 0; i < BRNANA_QOS_DSCP_NUM; ++i)
+        br->qos.dscp[i] = i >> 3;
+}
+
+/**
+ * brnana_qos_trust_set - Prioritize forwarded frames by a marking, or stop
+ * @br:    The bridge
+ * @trust: The marking
+ * @on:    Whether it is used
+ *
+ * Frames already classified keep their priority. Called under RTNL.
+ */
+void brnana_qos_trust_set(struct brnana_if *br,
+                          enum brnana_qos_trust trust,
+                          bool on)
+{
+    ASSERT_RTNL();
+
+    if (on)
+        set_bit(trust, &br->qos.trust);
+    else
+        clear_bit(trust, &br->qos.trust);
+}
+
+/**
+ * brnana_qos_map_set - Change entries of a QoS map
+ * @br:    The bridge
+ * @trust: The marking whose map changes
+ * @map:   New priority per value, BRNANA_QOS_KEEP for entries left as is;
+ *         BRNANA_QOS_PCP_NUM or BRNANA_QOS_DSCP_NUM entries
+ *
+ * Called under RTNL.
+ */
+void brnana_qos_map_set(struct brnana_if *br,
+                        enum brnana_qos_trust trust,
+                        const u8 *map)
+{
+    u8 *dst = br->qos.pcp;
+    int n = BRNANA_QOS_PCP_NUM;
+
+    ASSERT_RTNL();
+
+    if (trust == BRNANA_QOS_TRUST_DSCP) {
+        dst = br->qos.dscp;
+        n = BRNANA_QOS_DSCP_NUM;
+    }
+
+    for (int i = 0; i < n; ++i)
+        if (map[i] != BRNANA_QOS_KEEP)
+            WRITE_ONCE(dst[i], map[i]);
+}
+
+/**
+ * brnana_qos_dscp - Read the DSCP of an IP packet
+ * @skb: The frame, with skb->data pointing at the network header
+ *
+ * Only the first two bytes of the header are read, wherever they are, so
+ * the skb is neither pulled nor unshared.
+ *
+ * Return: The DSCP, or -1 if @skb is not IPv4 or IPv6.
+ */
+static int brnana_qos_dscp(const struct sk_buff *skb)
+{
+    const u8 *hdr;
+    u8 _hdr[2];
+
+    hdr = skb_header_pointer(skb, 0, sizeof(_hdr), _hdr);
+    if (!hdr)
+        return -1;
+
+    return brnana_dscp(ntohs(skb->protocol), hdr);
+}
+
+/**
+ * __brnana_qos_classify - Set a frame's priority from its marking
+ * @br:    The bridge
+ * @skb:   The frame, with skb->data pointing at the network header
+ * @trust: Bit per enum brnana_qos_trust in use, not 0
+ *
+ * An IP packet is classified by its DSCP if that is trusted, anything else
+ * by its PCP if that is. Frames left unclassified keep their priority.
+ */
+void __brnana_qos_classify(const struct brnana_if *br,
+                           struct sk_buff *skb,
+                           unsigned long trust)
+{
+    int dscp;
+
+    if (trust & BIT(BRNANA_QOS_TRUST_DSCP)) {
+        dscp = brnana_qos_dscp(skb);
+        if (dscp >= 0) {
+            skb->priority = READ_ONCE(br->qos.dscp[dscp]);
+            return;
+        }
+    }
+
+    if (trust & BIT(BRNANA_QOS_TRUST_PCP))
+        skb->priority = READ_ONCE(br->qos.pcp[skb_vlan_tag_get_prio(skb)]);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file brnana_stats.c
+ * @brief Per-CPU counters of brnana bridges and ports, and their readers
+ *
+ * Counters are only ever written by the CPU that owns them, so the
+ * forwarding path updates them without any lock or atomic operation.
+ * Readers sum all CPUs, using u64_stats_sync to get consistent 64-bit
+ * values on 32-bit hosts.
+ */
+#include <linux/ethtool.h>
+
+#include "brnana.h"
+
+/**
+ * brnana_stat_names - ethtool names of the counters, indexed by brnana_stat
+ */
+static const char brnana_stat_names[BRNANA_STAT_NUM][ETH_GSTRING_LEN] = {
+    [BRNANA_STAT_RX_PACKETS] = "rx_packets",
+    [BRNANA_STAT_RX_BYTES] = "rx_bytes",
+    [BRNANA_STAT_TX_PACKETS] = "tx_packets",
+    [BRNANA_STAT_TX_BYTES] = "tx_bytes",
+    [BRNANA_STAT_FORWARD] = "forward_packets",
+    [BRNANA_STAT_FLOOD] = "flood_packets",
+    [BRNANA_STAT_DROP] = "drop_packets",
+    [BRNANA_STAT_NEIGH_SUPPRESS] = "neigh_suppressed",
+    [BRNANA_STAT_FCACHE_HIT] = "fcache_hits",
+    [BRNANA_STAT_FCACHE_MISS] = "fcache_misses",
+    [BRNANA_STAT_STORM_DROP] = "storm_drops",
+};
+
+/**
+ * brnana_stats_fetch - Sum per-CPU counters
+ * @pcpu: The per-CPU counters of a bridge or a port
+ * @sum:  Output array of BRNANA_STAT_NUM totals
+ */
+void brnana_stats_fetch(const struct brnana_pcpu_stats __percpu *pcpu,
+                        u64 *sum)
+{
+    u64 val[BRNANA_STAT_NUM];
+    unsigned int start;
+    int cpu, i;
+
+    memset(sum, 0, sizeof(u64) * BRNANA_STAT_NUM);
+
+    for_each_possible_cpu (cpu) {
+        const struct brnana_pcpu_stats *s = per_cpu_ptr(pcpu, cpu);
+
+        do {
+            start = u64_stats_fetch_begin(&s->syncp);
+            for (i = 0; i < BRNANA_STAT_NUM; ++i)
+                val[i] = u64_stats_read(&s->cnt[i]);
+        } while (u64_stats_fetch_retry(&s->syncp, start));
+
+        for (i = 0; i < BRNANA_STAT_NUM; ++i)
+            sum[i] += val[i];
+    }
+}
+
+/**
+ * brnana_get_stats64 - ndo_get_stats64 callback for bridge device
+ * @dev:   The net_device representing the brnana bridge
+ * @stats: Output statistics
+ *
+ * rx counts frames handed to the bridge device's own stack, tx counts frames
+ * transmitted by the bridge device, and rx_dropped counts every frame the
+ * bridge dropped while forwarding.
+ */
+void brnana_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    u64 sum[BRNANA_STAT_NUM];
+
+    brnana_stats_fetch(br->stats, sum);
+
+    stats->rx_packets = sum[BRNANA_STAT_RX_PACKETS];
+    stats->rx_bytes = sum[BRNANA_STAT_RX_BYTES];
+    stats->tx_packets = sum[BRNANA_STAT_TX_PACKETS];
+    stats->tx_bytes = sum[BRNANA_STAT_TX_BYTES];
+    stats->rx_dropped = sum[BRNANA_STAT_DROP];
+}
+
+/**
+ * brnana_get_drvinfo - ethtool get_drvinfo callback
+ * @dev:  The bridge device
+ * @info: Output driver information
+ */
+static void brnana_get_drvinfo(struct net_device *dev,
+                               struct ethtool_drvinfo *info)
+{
+    strscpy(info->driver, KBUILD_MODNAME, sizeof(info->driver));
+    strscpy(info->version, BRNANA_VERSION, sizeof(info->version));
+    strscpy(info->bus_info, "N/A", sizeof(info->bus_info));
+}
+
+/**
+ * brnana_get_sset_count - ethtool get_sset_count callback
+ * @dev: The bridge device
+ * @sset: The string set being queried
+ *
+ * The bridge's own counters come first, followed by one block per port.
+ * ethtool holds RTNL across this call and the two below, so the port list
+ * cannot change in between.
+ *
+ * Return:
+ *   The number of counters, or -EOPNOTSUPP.
+ */
+static int brnana_get_sset_count(struct net_device *dev, int sset)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_port_if *p;
+    int n = BRNANA_STAT_NUM;
+
+    if (sset != ETH_SS_STATS)
+        return -EOPNOTSUPP;
+
+    list_for_each_entry (p, &br->port_list, link)
+        n += BRNANA_STAT_NUM;
+
+    return n;
+}
+
+/**
+ * brnana_get_strings - ethtool get_strings callback
+ * @dev:  The bridge device
+ * @sset: The string set being queried
+ * @data: Output buffer of ETH_GSTRING_LEN-sized names
+ */
+static void brnana_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_port_if *p;
+    int i;
+
+    if (sset != ETH_SS_STATS)
+        return;
+
+    for (i = 0; i < BRNANA_STAT_NUM; ++i)
+        ethtool_sprintf(&data, "%s", brnana_stat_names[i]);
+
+    list_for_each_entry (p, &br->port_list, link) {
+        for (i = 0; i < BRNANA_STAT_NUM; ++i)
+            ethtool_sprintf(&data, "%s.%s", p->dev->name,
+                            brnana_stat_names[i]);
+    }
+}
+
+/**
+ * brnana_get_ethtool_stats - ethtool get_ethtool_stats callback
+ * @dev:   The bridge device
+ * @stats: Unused
+ * @data:  Output counters, in the order of brnana_get_strings()
+ */
+static void brnana_get_ethtool_stats(struct net_device *dev,
+                                     struct ethtool_stats *stats,
+                                     u64 *data)
+{
+    struct brnana_if *br = dev_get_brnana_if(dev);
+    struct brnana_port_if *p;
+
+    brnana_stats_fetch(br->stats, data);
+    data += BRNANA_STAT_NUM;
+
+    list_for_each_entry (p, &br->port_list, link) {
+        brnana_stats_fetch(p->stats, data);
+        data += BRNANA_STAT_NUM;
+    }
+}
+
+/**
+ * brnana_ethtool_ops - ethtool operations of the bridge device
+ */
+const struct ethtool_ops brnana_ethtool_ops = {
+    .get_drvinfo = brnana_get_drvinfo,
+    .get_link = ethtool_op_get_link,
+    .get_sset_count = brnana_get_sset_count,
+    .get_strings = brnana_get_strings,
+    .get_ethtool_stats = brnana_get_ethtool_stats,
+};
@@ -0,0 +1,174 @@
+/**
+ * @file brnana_storm.c
+ * @brief Storm control of broadcast, multicast and unknown unicast traffic
+ *
+ * Such frames are replicated to every other port of the bridge, so a single
+ * misbehaving host can saturate all of them. Each port may limit each class
+ * of flooded traffic it receives in packets and in bits per second, set
+ * under /sys/class/net/<port>/brnana_port/.
+ *
+ * Limits are enforced with a token bucket per port and class, which fills
+ * at the configured rate. A frame is charged to a per-CPU share of it,
+ * which takes no lock and touches no shared cache line; a CPU whose share
+ * runs out takes the next BRNANA_STORM_CHUNK_NS of credit from the port's
+ * pool with a single atomic operation. However the traffic spreads over
+ * the CPUs, the port is held to its configured rate: at most a chunk per
+ * CPU can be in flight above it.
+ */
+#include <linux/math64.h>
+#include <linux/timekeeping.h>
+
+#include "brnana.h"
+
+/**
+ * brnana_storm_set - Set the storm control limit of a port
+ * @p:     The port
+ * @class: The class of flooded traffic
+ * @pps:   Packets per second, 0 for no limit
+ * @bps:   Bits per second, 0 for no limit
+ *
+ * The port starts with a full burst of credit, and every CPU's share with
+ * neither credit nor debt: a CPU left in debt by a low limit must not keep
+ * dropping under a higher one. Called under RTNL. The forwarding path may
+ * see the old and new costs mixed for a frame or two, which is harmless.
+ */
+void brnana_storm_set(struct brnana_port_if *p,
+                      enum brnana_storm_class class,
+                      u64 pps,
+                      u64 bps)
+{
+    struct brnana_storm_limit *lim = &p->storm[class];
+    u64 pkt_cost = 0, byte_cost = 0;
+
+    ASSERT_RTNL();
+
+    if (pps)
+        pkt_cost = max_t(u64, div64_u64(NSEC_PER_SEC, pps), 1);
+    if (bps)
+        byte_cost = max_t(u64,
+                          div64_u64((BITS_PER_BYTE * NSEC_PER_SEC)
+                                        << BRNANA_STORM_SHIFT,
+                                    bps),
+                          1);
+
+    WRITE_ONCE(lim->pps, pps);
+    WRITE_ONCE(lim->bps, bps);
+    WRITE_ONCE(lim->pkt_cost, pkt_cost);
+    WRITE_ONCE(lim->byte_cost, byte_cost);
+    atomic64_set(&lim->last, ktime_get_mono_fast_ns());
+    atomic64_set(&lim->pkt_pool, BRNANA_STORM_BURST_NS);
+    atomic64_set(&lim->bit_pool, BRNANA_STORM_BURST_NS);
+
+    /**
+     * The buckets are only written by their own CPU, which empties its
+     * bucket on seeing the new generation.
+     */
+    smp_store_release(&lim->gen, lim->gen + 1);
+
+    if (pps || bps)
+        set_bit(class, &p->storm_mask);
+    else
+        clear_bit(class, &p->storm_mask);
+}
+
+/**
+ * brnana_storm_credit - Add credit to a pool of a port
+ * @pool:    The pool
+ * @elapsed: Time earned, in ns
+ *
+ * The pool never holds more than BRNANA_STORM_BURST_NS, however long the
+ * port was idle.
+ */
+static void brnana_storm_credit(atomic64_t *pool, s64 elapsed)
+{
+    s64 old = atomic64_read(pool), new;
+
+    do {
+        new = min_t(s64, old + elapsed, BRNANA_STORM_BURST_NS);
+    } while (!atomic64_try_cmpxchg(pool, &old, new));
+}
+
+/**
+ * brnana_storm_refill - Credit the pools of a port with the time elapsed
+ * @lim: The limit of the class
+ *
+ * At most once per BRNANA_STORM_CHUNK_NS, by whichever CPU gets there
+ * first; the others go on with the pools as they are.
+ */
+static void brnana_storm_refill(struct brnana_storm_limit *lim)
+{
+    s64 now = ktime_get_mono_fast_ns();
+    s64 last = atomic64_read(&lim->last);
+    s64 elapsed = now - last;
+
+    if (elapsed < BRNANA_STORM_CHUNK_NS ||
+        !atomic64_try_cmpxchg(&lim->last, &last, now))
+        return;
+
+    elapsed = min_t(s64, elapsed, BRNANA_STORM_BURST_NS);
+    brnana_storm_credit(&lim->pkt_pool, elapsed);
+    brnana_storm_credit(&lim->bit_pool, elapsed);
+}
+
+/**
+ * brnana_storm_take - Take a chunk of credit from a pool of a port
+ * @pool: The pool
+ *
+ * CPUs racing for the last credit may all get a chunk and leave the pool
+ * in debt, which later refills pay back first.
+ *
+ * Return: The credit taken, in ns, 0 if the pool is empty.
+ */
+static s64 brnana_storm_take(atomic64_t *pool)
+{
+    if (atomic64_read(pool) <= 0)
+        return 0;
+
+    atomic64_sub(BRNANA_STORM_CHUNK_NS, pool);
+    return BRNANA_STORM_CHUNK_NS;
+}
+
+/**
+ * __brnana_storm_exceeded - Charge a frame to this CPU's storm control bucket
+ * @p:     The ingress port
+ * @class: The class of the frame
+ * @len:   Length of the frame, with its Ethernet header
+ *
+ * A frame is admitted as long as this CPU's share has credit left for both
+ * frames and bytes, topped up from the port's pools once it runs out, and
+ * then takes its cost from both. A frame larger than a chunk still gets
+ * through once the previous one was paid for. A share taken under an older
+ * limit is emptied first.
+ *
+ * Return: true if the frame is above the port's limit and must be dropped.
+ */
+bool __brnana_storm_exceeded(struct brnana_port_if *p,
+                             enum brnana_storm_class class,
+                             unsigned int len)
+{
+    struct brnana_storm_limit *lim = &p->storm[class];
+    struct brnana_storm_bucket *b;
+    unsigned int gen;
+
+    gen = smp_load_acquire(&lim->gen);
+    b = &this_cpu_ptr(p->storm_pcpu)->bucket[class];
+    if (unlikely(b->gen != gen)) {
+        b->pkt_tokens = 0;
+        b->bit_tokens = 0;
+        b->gen = gen;
+    }
+    if (unlikely(b->pkt_tokens <= 0 || b->bit_tokens <= 0)) {
+        brnana_storm_refill(lim);
+        if (b->pkt_tokens <= 0)
+            b->pkt_tokens += brnana_storm_take(&lim->pkt_pool);
+        if (b->bit_tokens <= 0)
+            b->bit_tokens += brnana_storm_take(&lim->bit_pool);
+        if (b->pkt_tokens <= 0 || b->bit_tokens <= 0)
+            return true;
+    }
+
+    b->pkt_tokens -= READ_ONCE(lim->pkt_cost);
+    b->bit_tokens -= mul_u64_u32_shr(READ_ONCE(lim->byte_cost), len,
+                                     BRNANA_STORM_SHIFT);
+    return false;
+}
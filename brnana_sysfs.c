@@ -0,0 +1,509 @@
+/**
+ * @file brnana_sysfs.c
+ * @brief Bridge and port parameters in sysfs
+ *
+ * brnana is not a kind iproute2 knows how to configure with
+ * `ip link set ... type`, so bridge-wide parameters are plain sysfs files:
+ *   echo 1 > /sys/class/net/brnana0/brnana/vlan_filtering
+ *   echo "46:6 48:7" > /sys/class/net/brnana0/brnana/qos_dscp_map
+ * and so are per-port parameters, under each enslaved device:
+ *   echo 1000 > /sys/class/net/eth0/brnana_port/storm_bcast_pps
+ */
+#include <linux/capability.h>
+#include <linux/pkt_sched.h>
+
+#include "brnana.h"
+
+#define to_brnana_if(d) dev_get_brnana_if(to_net_dev(d))
+
+/**
+ * brnana_store_parm - Parse and apply a numeric bridge parameter
+ * @d:   The bridge's device
+ * @buf: The value written by the user
+ * @len: Length of @buf
+ * @set: Applies the parsed value under RTNL
+ *
+ * Return: @len on success, or a negative errno.
+ */
+static ssize_t brnana_store_parm(struct device *d,
+                                 const char *buf,
+                                 size_t len,
+                                 int (*set)(struct brnana_if *br,
+                                            unsigned long val))
+{
+    struct brnana_if *br = to_brnana_if(d);
+    unsigned long val;
+    int err;
+
+    if (!ns_capable(dev_net(br->dev)->user_ns, CAP_NET_ADMIN))
+        return -EPERM;
+
+    err = kstrtoul(buf, 0, &val);
+    if (err)
+        return err;
+
+    if (!rtnl_trylock())
+        return restart_syscall();
+
+    err = set(br, val);
+    rtnl_unlock();
+
+    return err ? err : len;
+}
+
+static ssize_t vlan_filtering_show(struct device *d,
+                                   struct device_attribute *attr,
+                                   char *buf)
+{
+    return sysfs_emit(buf, "%d\n", READ_ONCE(to_brnana_if(d)->vlan_enabled));
+}
+
+static int set_vlan_filtering(struct brnana_if *br, unsigned long val)
+{
+    return brnana_vlan_filtering_set(br, !!val, NULL);
+}
+
+static ssize_t vlan_filtering_store(struct device *d,
+                                    struct device_attribute *attr,
+                                    const char *buf,
+                                    size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_vlan_filtering);
+}
+static DEVICE_ATTR_RW(vlan_filtering);
+
+static ssize_t multicast_snooping_show(struct device *d,
+                                       struct device_attribute *attr,
+                                       char *buf)
+{
+    return sysfs_emit(buf, "%d\n",
+                      READ_ONCE(to_brnana_if(d)->mcast_snooping));
+}
+
+static int set_multicast_snooping(struct brnana_if *br, unsigned long val)
+{
+    brnana_mcast_snooping_set(br, !!val);
+    return 0;
+}
+
+static ssize_t multicast_snooping_store(struct device *d,
+                                        struct device_attribute *attr,
+                                        const char *buf,
+                                        size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_multicast_snooping);
+}
+static DEVICE_ATTR_RW(multicast_snooping);
+
+static ssize_t neigh_suppress_show(struct device *d,
+                                   struct device_attribute *attr,
+                                   char *buf)
+{
+    return sysfs_emit(buf, "%d\n",
+                      READ_ONCE(to_brnana_if(d)->neigh_suppress));
+}
+
+static int set_neigh_suppress(struct brnana_if *br, unsigned long val)
+{
+    brnana_neigh_suppress_set(br, !!val);
+    return 0;
+}
+
+static ssize_t neigh_suppress_store(struct device *d,
+                                    struct device_attribute *attr,
+                                    const char *buf,
+                                    size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_neigh_suppress);
+}
+static DEVICE_ATTR_RW(neigh_suppress);
+
+static ssize_t fdb_max_learned_show(struct device *d,
+                                    struct device_attribute *attr,
+                                    char *buf)
+{
+    return sysfs_emit(buf, "%u\n",
+                      READ_ONCE(to_brnana_if(d)->fdb.max_learned));
+}
+
+static int set_fdb_max_learned(struct brnana_if *br, unsigned long val)
+{
+    if (val > UINT_MAX)
+        return -EINVAL;
+    return brnana_fdb_set_max_learned(&br->fdb, val,
+                                      br->fdb.port_max_learned);
+}
+
+static ssize_t fdb_max_learned_store(struct device *d,
+                                     struct device_attribute *attr,
+                                     const char *buf,
+                                     size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_fdb_max_learned);
+}
+static DEVICE_ATTR_RW(fdb_max_learned);
+
+static ssize_t fdb_port_max_learned_show(struct device *d,
+                                         struct device_attribute *attr,
+                                         char *buf)
+{
+    return sysfs_emit(buf, "%u\n",
+                      READ_ONCE(to_brnana_if(d)->fdb.port_max_learned));
+}
+
+static int set_fdb_port_max_learned(struct brnana_if *br, unsigned long val)
+{
+    if (val > UINT_MAX)
+        return -EINVAL;
+    return brnana_fdb_set_max_learned(&br->fdb, br->fdb.max_learned, val);
+}
+
+static ssize_t fdb_port_max_learned_store(struct device *d,
+                                          struct device_attribute *attr,
+                                          const char *buf,
+                                          size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_fdb_port_max_learned);
+}
+static DEVICE_ATTR_RW(fdb_port_max_learned);
+
+static ssize_t fdb_n_learned_show(struct device *d,
+                                  struct device_attribute *attr,
+                                  char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(to_brnana_if(d)->fdb.n_learned));
+}
+static DEVICE_ATTR_RO(fdb_n_learned);
+
+static ssize_t ageing_time_show(struct device *d,
+                                struct device_attribute *attr,
+                                char *buf)
+{
+    unsigned long ageing = READ_ONCE(to_brnana_if(d)->fdb.ageing_time);
+
+    return sysfs_emit(buf, "%ld\n", jiffies_to_clock_t(ageing));
+}
+
+static int set_ageing_time(struct brnana_if *br, unsigned long val)
+{
+    unsigned long ageing = clock_t_to_jiffies(val);
+
+    if (ageing > BRNANA_FDB_AGEING_MAX)
+        return -EINVAL;
+
+    WRITE_ONCE(br->fdb.ageing_time, ageing);
+    return 0;
+}
+
+static ssize_t ageing_time_store(struct device *d,
+                                 struct device_attribute *attr,
+                                 const char *buf,
+                                 size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_ageing_time);
+}
+static DEVICE_ATTR_RW(ageing_time);
+
+static ssize_t qos_trust_pcp_show(struct device *d,
+                                  struct device_attribute *attr,
+                                  char *buf)
+{
+    return sysfs_emit(buf, "%d\n",
+                      test_bit(BRNANA_QOS_TRUST_PCP,
+                               &to_brnana_if(d)->qos.trust));
+}
+
+static int set_qos_trust_pcp(struct brnana_if *br, unsigned long val)
+{
+    brnana_qos_trust_set(br, BRNANA_QOS_TRUST_PCP, !!val);
+    return 0;
+}
+
+static ssize_t qos_trust_pcp_store(struct device *d,
+                                   struct device_attribute *attr,
+                                   const char *buf,
+                                   size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_qos_trust_pcp);
+}
+static DEVICE_ATTR_RW(qos_trust_pcp);
+
+static ssize_t qos_trust_dscp_show(struct device *d,
+                                   struct device_attribute *attr,
+                                   char *buf)
+{
+    return sysfs_emit(buf, "%d\n",
+                      test_bit(BRNANA_QOS_TRUST_DSCP,
+                               &to_brnana_if(d)->qos.trust));
+}
+
+static int set_qos_trust_dscp(struct brnana_if *br, unsigned long val)
+{
+    brnana_qos_trust_set(br, BRNANA_QOS_TRUST_DSCP, !!val);
+    return 0;
+}
+
+static ssize_t qos_trust_dscp_store(struct device *d,
+                                    struct device_attribute *attr,
+                                    const char *buf,
+                                    size_t len)
+{
+    return brnana_store_parm(d, buf, len, set_qos_trust_dscp);
+}
+static DEVICE_ATTR_RW(qos_trust_dscp);
+
+/**
+ * struct brnana_qos_attr - A QoS map under brnana/
+ * @attr:  The sysfs attribute
+ * @trust: The marking the map translates
+ * @n:     Number of entries of the map
+ */
+struct brnana_qos_attr {
+    struct device_attribute attr;
+    enum brnana_qos_trust trust;
+    unsigned int n;
+};
+
+#define to_brnana_qos_attr(a) container_of(a, struct brnana_qos_attr, attr)
+
+/**
+ * brnana_qos_map - Find the map a QoS attribute is about
+ * @br: The bridge
+ * @qa: The attribute
+ *
+ * Return: The map, with @qa->n entries.
+ */
+static const u8 *brnana_qos_map(const struct brnana_if *br,
+                                const struct brnana_qos_attr *qa)
+{
+    if (qa->trust == BRNANA_QOS_TRUST_DSCP)
+        return br->qos.dscp;
+    return br->qos.pcp;
+}
+
+/**
+ * qos_map_show - Show a QoS map
+ * @d:    The bridge's device
+ * @attr: The attribute, embedded in a struct brnana_qos_attr
+ * @buf:  Output buffer
+ *
+ * Every entry is listed, as FROM:TO pairs in the format the file accepts.
+ *
+ * Return: Number of bytes written to @buf.
+ */
+static ssize_t qos_map_show(struct device *d,
+                            struct device_attribute *attr,
+                            char *buf)
+{
+    const struct brnana_qos_attr *qa = to_brnana_qos_attr(attr);
+    const u8 *map = brnana_qos_map(to_brnana_if(d), qa);
+    int len = 0;
+
+    for (unsigned int i = 0; i < qa->n; ++i)
+        len += sysfs_emit_at(buf, len, "%s%u:%u", i ? " " : "", i,
+                             READ_ONCE(map[i]));
+
+    return len + sysfs_emit_at(buf, len, "\n");
+}
+
+/**
+ * qos_map_store - Change entries of a QoS map
+ * @d:    The bridge's device
+ * @attr: The attribute, embedded in a struct brnana_qos_attr
+ * @buf:  Whitespace separated FROM:TO pairs, TO up to TC_PRIO_MAX
+ * @len:  Length of @buf
+ *
+ * Entries not named keep their priority. Nothing changes unless every pair
+ * is valid.
+ *
+ * Return: @len on success, or a negative errno.
+ */
+static ssize_t qos_map_store(struct device *d,
+                             struct device_attribute *attr,
+                             const char *buf,
+                             size_t len)
+{
+    const struct brnana_qos_attr *qa = to_brnana_qos_attr(attr);
+    struct brnana_if *br = to_brnana_if(d);
+    u8 map[BRNANA_QOS_DSCP_NUM];
+    unsigned int from, to;
+    int used;
+
+    if (!ns_capable(dev_net(br->dev)->user_ns, CAP_NET_ADMIN))
+        return -EPERM;
+
+    memset(map, BRNANA_QOS_KEEP, sizeof(map));
+    for (buf = skip_spaces(buf); *buf; buf = skip_spaces(buf + used)) {
+        if (sscanf(buf, "%u:%u%n", &from, &to, &used) != 2 ||
+            from >= qa->n || to > TC_PRIO_MAX)
+            return -EINVAL;
+        map[from] = to;
+    }
+
+    if (!rtnl_trylock())
+        return restart_syscall();
+
+    brnana_qos_map_set(br, qa->trust, map);
+    rtnl_unlock();
+
+    return len;
+}
+
+#define BRNANA_QOS_ATTR(_name, _trust, _n)                            \
+    static struct brnana_qos_attr brnana_qos_attr_##_name = {         \
+        .attr = __ATTR(_name, 0644, qos_map_show, qos_map_store),     \
+        .trust = _trust,                                              \
+        .n = _n,                                                      \
+    }
+
+BRNANA_QOS_ATTR(qos_pcp_map, BRNANA_QOS_TRUST_PCP, BRNANA_QOS_PCP_NUM);
+BRNANA_QOS_ATTR(qos_dscp_map, BRNANA_QOS_TRUST_DSCP, BRNANA_QOS_DSCP_NUM);
+
+static struct attribute *brnana_attrs[] = {
+    &dev_attr_vlan_filtering.attr,
+    &dev_attr_multicast_snooping.attr,
+    &dev_attr_neigh_suppress.attr,
+    &dev_attr_fdb_max_learned.attr,
+    &dev_attr_fdb_port_max_learned.attr,
+    &dev_attr_fdb_n_learned.attr,
+    &dev_attr_ageing_time.attr,
+    &dev_attr_qos_trust_pcp.attr,
+    &dev_attr_qos_trust_dscp.attr,
+    &brnana_qos_attr_qos_pcp_map.attr.attr,
+    &brnana_qos_attr_qos_dscp_map.attr.attr,
+    NULL,
+};
+
+/**
+ * brnana_group - Attributes under /sys/class/net/<bridge>/brnana/
+ *
+ * Installed as the bridge device's sysfs_groups[0], so the files come and go
+ * with the device, in whatever namespace it lives.
+ */
+const struct attribute_group brnana_group = {
+    .name = "brnana",
+    .attrs = brnana_attrs,
+};
+
+/**
+ * struct brnana_storm_attr - A storm control limit under brnana_port/
+ * @attr:  The sysfs attribute
+ * @class: The class of flooded traffic it limits
+ * @bits:  The file holds the bits per second rather than the packets
+ */
+struct brnana_storm_attr {
+    struct device_attribute attr;
+    enum brnana_storm_class class;
+    bool bits;
+};
+
+#define to_brnana_storm_attr(a) container_of(a, struct brnana_storm_attr, attr)
+
+/**
+ * storm_show - Show a port's storm control limit
+ * @d:    The port's device
+ * @attr: The attribute, embedded in a struct brnana_storm_attr
+ * @buf:  Output buffer
+ *
+ * The group is removed before the port's rx_handler_data is cleared, so
+ * the port is there for as long as the file can be read.
+ *
+ * Return: Number of bytes written to @buf.
+ */
+static ssize_t storm_show(struct device *d,
+                          struct device_attribute *attr,
+                          char *buf)
+{
+    const struct brnana_storm_attr *sa = to_brnana_storm_attr(attr);
+    const struct brnana_storm_limit *lim;
+    struct brnana_port_if *p;
+    u64 val;
+
+    rcu_read_lock();
+    p = brnana_port_get_rcu(to_net_dev(d));
+    lim = &p->storm[sa->class];
+    val = sa->bits ? READ_ONCE(lim->bps) : READ_ONCE(lim->pps);
+    rcu_read_unlock();
+
+    return sysfs_emit(buf, "%llu\n", val);
+}
+
+/**
+ * storm_store - Set a port's storm control limit
+ * @d:    The port's device
+ * @attr: The attribute, embedded in a struct brnana_storm_attr
+ * @buf:  The limit written by the user, 0 for none
+ * @len:  Length of @buf
+ *
+ * Return: @len on success, or a negative errno.
+ */
+static ssize_t storm_store(struct device *d,
+                           struct device_attribute *attr,
+                           const char *buf,
+                           size_t len)
+{
+    const struct brnana_storm_attr *sa = to_brnana_storm_attr(attr);
+    struct net_device *dev = to_net_dev(d);
+    const struct brnana_storm_limit *lim;
+    struct brnana_port_if *p;
+    u64 val;
+    int err;
+
+    if (!ns_capable(dev_net(dev)->user_ns, CAP_NET_ADMIN))
+        return -EPERM;
+
+    err = kstrtou64(buf, 0, &val);
+    if (err)
+        return err;
+
+    if (!rtnl_trylock())
+        return restart_syscall();
+
+    p = brnana_port_get_rtnl(dev);
+    if (p) {
+        lim = &p->storm[sa->class];
+        if (sa->bits)
+            brnana_storm_set(p, sa->class, lim->pps, val);
+        else
+            brnana_storm_set(p, sa->class, val, lim->bps);
+    } else
+        err = -ENODEV;
+    rtnl_unlock();
+
+    return err ? err : len;
+}
+
+#define BRNANA_STORM_ATTR(_name, _class, _bits)                       \
+    static struct brnana_storm_attr brnana_storm_attr_##_name = {     \
+        .attr = __ATTR(_name, 0644, storm_show, storm_store),         \
+        .class = _class,                                              \
+        .bits = _bits,                                                \
+    }
+
+BRNANA_STORM_ATTR(storm_bcast_pps, BRNANA_STORM_BCAST, false);
+BRNANA_STORM_ATTR(storm_bcast_bps, BRNANA_STORM_BCAST, true);
+BRNANA_STORM_ATTR(storm_mcast_pps, BRNANA_STORM_MCAST, false);
+BRNANA_STORM_ATTR(storm_mcast_bps, BRNANA_STORM_MCAST, true);
+BRNANA_STORM_ATTR(storm_unknown_ucast_pps, BRNANA_STORM_UNKNOWN_UCAST, false);
+BRNANA_STORM_ATTR(storm_unknown_ucast_bps, BRNANA_STORM_UNKNOWN_UCAST, true);
+
+static struct attribute *brnana_port_attrs[] = {
+    &brnana_storm_attr_storm_bcast_pps.attr.attr,
+    &brnana_storm_attr_storm_bcast_bps.attr.attr,
+    &brnana_storm_attr_storm_mcast_pps.attr.attr,
+    &brnana_storm_attr_storm_mcast_bps.attr.attr,
+    &brnana_storm_attr_storm_unknown_ucast_pps.attr.attr,
+    &brnana_storm_attr_storm_unknown_ucast_bps.attr.attr,
+    NULL,
+};
+
+/**
+ * brnana_port_group - Attributes under /sys/class/net/<port>/brnana_port/
+ *
+ * Added to the port's device when it is enslaved and removed when it is
+ * released, see brnana_add_port() and brnana_del_port().
+ */
+const struct attribute_group brnana_port_group = {
+    .name = "brnana_port",
+    .attrs = brnana_port_attrs,
+};
@@ -0,0 +1,188 @@
+/**
+ * @file brnana_trace.h
+ * @brief Tracepoints of the brnana forwarding path
+ *
+ * Tracepoints are patched in through static keys, so a disabled event costs
+ * a single no-op on the fast path. Enable them at runtime with e.g.:
+ *   echo 1 > /sys/kernel/tracing/events/brnana/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM brnana
+
+#if !defined(_BRNANA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BRNANA_TRACE_H
+
+#include <linux/if_ether.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/tracepoint.h>
+
+#include "brnana.h"
+
+#define BRNANA_DROP_REASONS                          \
+    EM(BRNANA_DROP_BR_DOWN, "BR_DOWN")               \
+    EM(BRNANA_DROP_INVALID_SRC, "INVALID_SRC")       \
+    EM(BRNANA_DROP_SAME_PORT, "SAME_PORT")           \
+    EM(BRNANA_DROP_PORT_DOWN, "PORT_DOWN")           \
+    EM(BRNANA_DROP_PKT_TOO_BIG, "PKT_TOO_BIG")       \
+    EM(BRNANA_DROP_NOMEM, "NOMEM")                   \
+    EM(BRNANA_DROP_VLAN_FILTERED, "VLAN_FILTERED")   \
+    EMe(BRNANA_DROP_STORM, "STORM")
+
+#undef EM
+#undef EMe
+#define EM(a, b) TRACE_DEFINE_ENUM(a);
+#define EMe(a, b) TRACE_DEFINE_ENUM(a);
+
+BRNANA_DROP_REASONS
+
+#undef EM
+#undef EMe
+#define EM(a, b) {a, b},
+#define EMe(a, b) {a, b}
+
+/**
+ * brnana_frame - Common layout of per-frame events
+ * @br:  The bridge device
+ * @dev: The port (or bridge) device the event happened on
+ * @skb: The frame; its MAC header must be set
+ */
+DECLARE_EVENT_CLASS(brnana_frame,
+
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb),
+
+    TP_ARGS(br, dev, skb),
+
+    TP_STRUCT__entry(
+        __string(br, br->name)
+        __string(dev, dev->name)
+        __array(u8, src, ETH_ALEN)
+        __array(u8, dst, ETH_ALEN)
+        __field(u16, proto)
+        __field(unsigned int, len)
+        __field(const void *, skbaddr)
+    ),
+
+    TP_fast_assign(
+        __assign_str(br, br->name);
+        __assign_str(dev, dev->name);
+        memcpy(__entry->src, eth_hdr(skb)->h_source, ETH_ALEN);
+        memcpy(__entry->dst, eth_hdr(skb)->h_dest, ETH_ALEN);
+        __entry->proto = ntohs(skb->protocol);
+        __entry->len = skb->len;
+        __entry->skbaddr = skb;
+    ),
+
+    TP_printk("br=%s dev=%s src=%pM dst=%pM proto=0x%04x len=%u skbaddr=%p",
+              __get_str(br), __get_str(dev), __entry->src, __entry->dst,
+              __entry->proto, __entry->len, __entry->skbaddr)
+);
+
+/** A frame entered the bridge on port @dev */
+DEFINE_EVENT(brnana_frame, brnana_rx,
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb),
+    TP_ARGS(br, dev, skb)
+);
+
+/** A frame was sent to its learned egress port @dev */
+DEFINE_EVENT(brnana_frame, brnana_forward,
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb),
+    TP_ARGS(br, dev, skb)
+);
+
+/** A frame that entered on @dev was replicated to the other ports */
+DEFINE_EVENT(brnana_frame, brnana_flood,
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb),
+    TP_ARGS(br, dev, skb)
+);
+
+/** A frame was handed to the bridge device's own stack */
+DEFINE_EVENT(brnana_frame, brnana_local_deliver,
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb),
+    TP_ARGS(br, dev, skb)
+);
+
+/**
+ * brnana_drop - A frame was dropped by the bridge
+ * @br:     The bridge device
+ * @dev:    The device the frame was on when it was dropped
+ * @skb:    The frame
+ * @reason: Why brnana dropped it
+ */
+TRACE_EVENT(brnana_drop,
+
+    TP_PROTO(const struct net_device *br, const struct net_device *dev,
+             const struct sk_buff *skb, enum brnana_drop_reason reason),
+
+    TP_ARGS(br, dev, skb, reason),
+
+    TP_STRUCT__entry(
+        __string(br, br->name)
+        __string(dev, dev->name)
+        __field(const void *, skbaddr)
+        __field(enum brnana_drop_reason, reason)
+    ),
+
+    TP_fast_assign(
+        __assign_str(br, br->name);
+        __assign_str(dev, dev->name);
+        __entry->skbaddr = skb;
+        __entry->reason = reason;
+    ),
+
+    TP_printk("br=%s dev=%s skbaddr=%p reason=%s", __get_str(br),
+              __get_str(dev), __entry->skbaddr,
+              __print_symbolic(__entry->reason, BRNANA_DROP_REASONS))
+);
+
+/**
+ * brnana_fdb_move - A learned address showed up behind another port
+ * @br:   The bridge device
+ * @addr: The MAC address
+ * @vid:  Its VLAN, 0 without VLAN filtering
+ * @from: The port it was learned on
+ * @to:   The port it was just seen on
+ */
+TRACE_EVENT(brnana_fdb_move,
+
+    TP_PROTO(const struct net_device *br, const unsigned char *addr, u16 vid,
+             const struct net_device *from, const struct net_device *to),
+
+    TP_ARGS(br, addr, vid, from, to),
+
+    TP_STRUCT__entry(
+        __string(br, br->name)
+        __string(from, from->name)
+        __string(to, to->name)
+        __array(u8, addr, ETH_ALEN)
+        __field(u16, vid)
+    ),
+
+    TP_fast_assign(
+        __assign_str(br, br->name);
+        __assign_str(from, from->name);
+        __assign_str(to, to->name);
+        memcpy(__entry->addr, addr, ETH_ALEN);
+        __entry->vid = vid;
+    ),
+
+    TP_printk("br=%s addr=%pM vid=%u from=%s to=%s", __get_str(br),
+              __entry->addr, __entry->vid, __get_str(from), __get_str(to))
+);
+
+#undef EM
+#undef EMe
+
+#endif /* _BRNANA_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE brnana_trace
+#include <trace/define_trace.h>
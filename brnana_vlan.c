@@ -0,0 +1,459 @@
+/**
+ * @file brnana_vlan.c
+ * @brief 802.1Q VLAN filtering of the brnana bridge
+ *
+ * With VLAN filtering on, every port (and the bridge device itself) is a
+ * member of a set of VLANs, one of them possibly its PVID. A frame is
+ * assigned a VLAN on ingress and only ever leaves on members of that VLAN,
+ * so one bridge carries many isolated broadcast domains. Membership is
+ * configured with the iproute2 `bridge vlan` command.
+ */
+#include <linux/if_bridge.h>
+
+#include "brnana.h"
+
+/**
+ * brnana_vlan_init - Make a port or bridge a member of the default VLAN
+ * @vg: The VLAN group to initialize
+ *
+ * Like the Linux bridge, new members get VLAN 1 as PVID, untagged, so that
+ * turning VLAN filtering on does not cut untagged traffic off.
+ */
+void brnana_vlan_init(struct brnana_vlan_group *vg)
+{
+    bitmap_zero(vg->vlan_bitmap, VLAN_N_VID);
+    bitmap_zero(vg->untagged_bitmap, VLAN_N_VID);
+
+    set_bit(BRNANA_DEFAULT_PVID, vg->vlan_bitmap);
+    set_bit(BRNANA_DEFAULT_PVID, vg->untagged_bitmap);
+    vg->pvid = BRNANA_DEFAULT_PVID;
+}
+
+/**
+ * brnana_vlan_ingress - Admit a frame into the bridge and find its VLAN
+ * @br:   The bridge
+ * @vg:   VLAN membership of the ingress port or bridge device
+ * @pskb: The frame, with skb->data pointing past the Ethernet header
+ * @vid:  Output: the frame's VLAN, 0 without VLAN filtering
+ *
+ * With VLAN filtering on, every admitted frame carries its VLAN in
+ * skb->vlan_tci from here on: untagged and priority-tagged frames get the
+ * PVID, an in-band 802.1Q tag is moved to the skb. Egress ports then keep or
+ * pop the tag without touching packet data. An 802.1ad tag is not ours and
+ * is treated as payload of an untagged frame.
+ *
+ * Return:
+ *   true if the frame may enter. On false, *pskb is the frame to drop, or
+ *   NULL if it was already freed.
+ */
+bool brnana_vlan_ingress(const struct brnana_if *br,
+                         const struct brnana_vlan_group *vg,
+                         struct sk_buff **pskb,
+                         u16 *vid)
+{
+    struct sk_buff *skb = *pskb;
+    u16 pvid, tpid = 0, tci = 0;
+
+    *vid = 0;
+    if (!READ_ONCE(br->vlan_enabled))
+        return true;
+
+    /**
+     * Receive already moved the tag to the skb; frames sent by the bridge
+     * device itself may still carry it in-band.
+     */
+    if (unlikely(!skb_vlan_tag_present(skb) &&
+                 skb->protocol == htons(ETH_P_8021Q))) {
+        skb = skb_vlan_untag(skb);
+        *pskb = skb;
+        if (unlikely(!skb))
+            return false;
+    }
+
+    if (skb_vlan_tag_present(skb)) {
+        tpid = ntohs(skb->vlan_proto);
+        tci = skb_vlan_tag_get(skb);
+    }
+
+    switch (brnana_vlan_classify(tpid, tci)) {
+    case BRNANA_VLAN_TAGGED:
+        *vid = tci & VLAN_VID_MASK;
+        return test_bit(*vid, vg->vlan_bitmap);
+    case BRNANA_VLAN_UNTAGGED:
+        if (likely(!tpid))
+            break;
+        /**
+         * Put the foreign tag back into the packet, it is payload.
+         */
+        skb_push(skb, ETH_HLEN);
+        skb = vlan_insert_tag_set_proto(skb, skb->vlan_proto, tci);
+        *pskb = skb;
+        if (unlikely(!skb))
+            return false;
+        skb_pull(skb, ETH_HLEN);
+        skb_reset_mac_len(skb);
+        __vlan_hwaccel_clear_tag(skb);
+        tci = 0;
+        break;
+    case BRNANA_VLAN_PRIO:
+        break;
+    }
+
+    /**
+     * Untagged or priority-tagged: the frame belongs to the PVID, if any.
+     */
+    pvid = READ_ONCE(vg->pvid);
+    if (!pvid)
+        return false;
+
+    __vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q),
+                           pvid | (tci & VLAN_PRIO_MASK));
+    *vid = pvid;
+    return test_bit(*vid, vg->vlan_bitmap);
+}
+
+/**
+ * brnana_vlan_filtering_set - Turn VLAN filtering on or off
+ * @br:     The bridge
+ * @on:     The new state
+ * @extack: Extended netlink ack for reporting errors to user space, or NULL
+ *
+ * Learned entries, multicast groups and neighbor bindings are keyed by
+ * VLAN, which is 0 for every frame without filtering, so they are all
+ * flushed when the state changes. Static FDB entries are configuration
+ * keyed the same way: rather than drop them or guess their new VLAN, the
+ * state cannot change while there are any. Called under RTNL.
+ *
+ * Return: 0, or -EBUSY if the bridge has static FDB entries.
+ */
+int brnana_vlan_filtering_set(struct brnana_if *br,
+                              bool on,
+                              struct netlink_ext_ack *extack)
+{
+    ASSERT_RTNL();
+
+    if (br->vlan_enabled == on)
+        return 0;
+
+    /* Static entries are only added and removed under RTNL */
+    if (br->fdb.n_static) {
+        NL_SET_ERR_MSG_MOD(extack, "Delete the static FDB entries first");
+        return -EBUSY;
+    }
+
+    WRITE_ONCE(br->vlan_enabled, on);
+    brnana_fdb_flush(br);
+    brnana_mcast_flush(br);
+    brnana_neigh_flush(br);
+    return 0;
+}
+
+/**
+ * brnana_vlan_group_get - Find the VLAN membership a bridge request is about
+ * @dev:  A brnana port, or a brnana bridge for `self` requests
+ * @br:   Output: the bridge
+ * @port: Output: the port, NULL for the bridge itself
+ *
+ * Called under RTNL, or under RCU from the dump path.
+ *
+ * Return: The VLAN group, or NULL if @dev is neither.
+ */
+static struct brnana_vlan_group *brnana_vlan_group_get(
+    struct net_device *dev, struct brnana_if **br, struct brnana_port_if **port)
+{
+    struct brnana_port_if *p;
+
+    if (brnana_dev_is_bridge(dev)) {
+        *br = dev_get_brnana_if(dev);
+        *port = NULL;
+        return &(*br)->vlans;
+    }
+
+    if (rcu_access_pointer(dev->rx_handler) != brnana_handle_frame)
+        return NULL;
+
+    p = rcu_dereference_rtnl(dev->rx_handler_data);
+    if (!p)
+        return NULL;
+
+    *br = p->br;
+    *port = p;
+    return &p->vlans;
+}
+
+/**
+ * brnana_vlan_add - Make a port or bridge a member of a VLAN
+ * @vg:    Its VLAN group
+ * @vid:   The VLAN
+ * @flags: BRIDGE_VLAN_INFO_PVID and/or BRIDGE_VLAN_INFO_UNTAGGED
+ *
+ * Re-adding a VLAN replaces its flags, as with the Linux bridge.
+ */
+static void brnana_vlan_add(struct brnana_vlan_group *vg, u16 vid, u16 flags)
+{
+    if (flags & BRIDGE_VLAN_INFO_UNTAGGED)
+        set_bit(vid, vg->untagged_bitmap);
+    else
+        clear_bit(vid, vg->untagged_bitmap);
+
+    set_bit(vid, vg->vlan_bitmap);
+
+    if (flags & BRIDGE_VLAN_INFO_PVID)
+        WRITE_ONCE(vg->pvid, vid);
+    else if (vg->pvid == vid)
+        WRITE_ONCE(vg->pvid, 0);
+}
+
+/**
+ * brnana_vlan_del - Remove a port or bridge from a VLAN
+ * @br:  The bridge
+ * @p:   The port, NULL for the bridge itself
+ * @vg:  Its VLAN group
+ * @vid: The VLAN
+ */
+static void brnana_vlan_del(struct brnana_if *br,
+                            struct brnana_port_if *p,
+                            struct brnana_vlan_group *vg,
+                            u16 vid)
+{
+    if (!test_and_clear_bit(vid, vg->vlan_bitmap))
+        return;
+
+    clear_bit(vid, vg->untagged_bitmap);
+    if (vg->pvid == vid)
+        WRITE_ONCE(vg->pvid, 0);
+
+    if (p)
+        brnana_fdb_delete_by_vlan(br, p, vid);
+}
+
+/**
+ * brnana_vlan_change - Apply the VLAN entries of a bridge request
+ * @dev:    The port, or the bridge itself
+ * @nlh:    The RTM_SETLINK/RTM_DELLINK request
+ * @add:    Add the VLANs if true, remove them otherwise
+ * @extack: Netlink extended acknowledgment structure
+ *
+ * Entries are IFLA_BRIDGE_VLAN_INFO attributes nested in IFLA_AF_SPEC,
+ * either single VIDs or RANGE_BEGIN/RANGE_END pairs. Called under RTNL.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+static int brnana_vlan_change(struct net_device *dev,
+                              struct nlmsghdr *nlh,
+                              bool add,
+                              struct netlink_ext_ack *extack)
+{
+    const struct bridge_vlan_info *vinfo, *range = NULL;
+    struct brnana_vlan_group *vg;
+    struct brnana_port_if *p;
+    struct brnana_if *br;
+    struct nlattr *afspec, *attr;
+    u16 first, flags;
+    int rem;
+
+    vg = brnana_vlan_group_get(dev, &br, &p);
+    if (!vg)
+        return -EINVAL;
+
+    afspec = nlmsg_find_attr(nlh, sizeof(struct ifinfomsg), IFLA_AF_SPEC);
+    if (!afspec)
+        return -EOPNOTSUPP;
+
+    nla_for_each_nested (attr, afspec, rem) {
+        if (nla_type(attr) != IFLA_BRIDGE_VLAN_INFO)
+            continue;
+        if (nla_len(attr) != sizeof(*vinfo))
+            return -EINVAL;
+
+        vinfo = nla_data(attr);
+        if (!vinfo->vid || vinfo->vid >= VLAN_VID_MASK) {
+            NL_SET_ERR_MSG_MOD(extack, "VLAN id must be in 1-4094");
+            return -EINVAL;
+        }
+
+        if (vinfo->flags & BRIDGE_VLAN_INFO_RANGE_BEGIN) {
+            if (range)
+                return -EINVAL;
+            range = vinfo;
+            continue;
+        }
+
+        if (range) {
+            if (!(vinfo->flags & BRIDGE_VLAN_INFO_RANGE_END) ||
+                vinfo->vid <= range->vid) {
+                NL_SET_ERR_MSG_MOD(extack, "Invalid VLAN range");
+                return -EINVAL;
+            }
+            if (range->flags & BRIDGE_VLAN_INFO_PVID) {
+                NL_SET_ERR_MSG_MOD(extack, "A VLAN range cannot be the PVID");
+                return -EINVAL;
+            }
+            first = range->vid;
+            flags = range->flags;
+            range = NULL;
+        } else {
+            first = vinfo->vid;
+            flags = vinfo->flags;
+        }
+
+        for (u16 vid = first; vid <= vinfo->vid; ++vid) {
+            if (add)
+                brnana_vlan_add(vg, vid, flags);
+            else
+                brnana_vlan_del(br, p, vg, vid);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * brnana_bridge_setlink - ndo_bridge_setlink callback (`bridge vlan add`)
+ * @dev:    The port, or the bridge itself with `self`
+ * @nlh:    The RTM_SETLINK request
+ * @flags:  BRIDGE_FLAGS_* of the request
+ * @extack: Netlink extended acknowledgment structure
+ *
+ * For example:
+ *   bridge vlan add dev veth1 vid 10 pvid untagged
+ *   bridge vlan add dev brnana0 vid 10 self
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_setlink(struct net_device *dev,
+                          struct nlmsghdr *nlh,
+                          u16 flags,
+                          struct netlink_ext_ack *extack)
+{
+    return brnana_vlan_change(dev, nlh, true, extack);
+}
+
+/**
+ * brnana_bridge_dellink - ndo_bridge_dellink callback (`bridge vlan del`)
+ * @dev:   The port, or the bridge itself with `self`
+ * @nlh:   The RTM_DELLINK request
+ * @flags: BRIDGE_FLAGS_* of the request
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_dellink(struct net_device *dev,
+                          struct nlmsghdr *nlh,
+                          u16 flags)
+{
+    return brnana_vlan_change(dev, nlh, false, NULL);
+}
+
+/**
+ * brnana_vlan_put - Emit one VLAN entry (or range) of a dump
+ * @skb:   The dump being filled
+ * @first: First VID of the range
+ * @last:  Last VID of the range
+ * @flags: BRIDGE_VLAN_INFO_* shared by the range
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_vlan_put(struct sk_buff *skb, u16 first, u16 last, u16 flags)
+{
+    struct bridge_vlan_info vinfo = { .vid = first, .flags = flags };
+
+    if (first != last) {
+        vinfo.flags |= BRIDGE_VLAN_INFO_RANGE_BEGIN;
+        if (nla_put(skb, IFLA_BRIDGE_VLAN_INFO, sizeof(vinfo), &vinfo))
+            return -EMSGSIZE;
+        vinfo.vid = last;
+        vinfo.flags = flags | BRIDGE_VLAN_INFO_RANGE_END;
+    }
+
+    if (nla_put(skb, IFLA_BRIDGE_VLAN_INFO, sizeof(vinfo), &vinfo))
+        return -EMSGSIZE;
+
+    return 0;
+}
+
+/**
+ * brnana_vlan_fill - Emit the VLAN membership of a port or bridge
+ * @skb:         The dump being filled, inside IFLA_AF_SPEC
+ * @dev:         The port, or the bridge itself
+ * @filter_mask: RTEXT_FILTER_* of the request
+ *
+ * With RTEXT_FILTER_BRVLAN_COMPRESSED, runs of consecutive VLANs with the
+ * same flags are sent as ranges, so a trunk port carrying 4094 VLANs fits
+ * in one message.
+ *
+ * Return: 0, or -EMSGSIZE if @skb is full.
+ */
+static int brnana_vlan_fill(struct sk_buff *skb,
+                            struct net_device *dev,
+                            u32 filter_mask)
+{
+    bool compress = filter_mask & RTEXT_FILTER_BRVLAN_COMPRESSED;
+    u16 vid, flags, first = 0, last = 0, range_flags = 0;
+    struct brnana_vlan_group *vg;
+    struct brnana_port_if *p;
+    struct brnana_if *br;
+    u16 pvid;
+
+    if (!(filter_mask &
+          (RTEXT_FILTER_BRVLAN | RTEXT_FILTER_BRVLAN_COMPRESSED)))
+        return 0;
+
+    vg = brnana_vlan_group_get(dev, &br, &p);
+    if (!vg)
+        return 0;
+
+    pvid = READ_ONCE(vg->pvid);
+
+    for_each_set_bit (vid, vg->vlan_bitmap, VLAN_N_VID) {
+        flags = 0;
+        if (vid == pvid)
+            flags |= BRIDGE_VLAN_INFO_PVID;
+        if (test_bit(vid, vg->untagged_bitmap))
+            flags |= BRIDGE_VLAN_INFO_UNTAGGED;
+
+        /**
+         * Extend the pending range, or flush it and start a new one. The
+         * PVID is always sent on its own.
+         */
+        if (compress && first && vid == last + 1 && flags == range_flags &&
+            !(flags & BRIDGE_VLAN_INFO_PVID)) {
+            last = vid;
+            continue;
+        }
+
+        if (first && brnana_vlan_put(skb, first, last, range_flags))
+            return -EMSGSIZE;
+
+        first = last = vid;
+        range_flags = flags;
+    }
+
+    if (first && brnana_vlan_put(skb, first, last, range_flags))
+        return -EMSGSIZE;
+
+    return 0;
+}
+
+/**
+ * brnana_bridge_getlink - ndo_bridge_getlink callback (`bridge vlan show`)
+ * @skb:         The dump being filled
+ * @pid:         Netlink port ID of the requester
+ * @seq:         Sequence number of the request
+ * @dev:         The port, or the bridge itself
+ * @filter_mask: RTEXT_FILTER_* of the request
+ * @nlflags:     Netlink flags of the message
+ *
+ * Called under RCU for every brnana port and bridge of the namespace.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int brnana_bridge_getlink(struct sk_buff *skb,
+                          u32 pid,
+                          u32 seq,
+                          struct net_device *dev,
+                          u32 filter_mask,
+                          int nlflags)
+{
+    return ndo_dflt_bridge_getlink(skb, pid, seq, dev, BRIDGE_MODE_UNDEF, 0,
+                                   0, nlflags, filter_mask, brnana_vlan_fill);
+}
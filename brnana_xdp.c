@@ -0,0 +1,202 @@
+/**
+ * @file brnana_xdp.c
+ * @brief BPF kfuncs letting XDP programs on brnana ports bridge frames
+ *
+ * An XDP program attached to a brnana port can learn source addresses and
+ * look destinations up in the bridge's MAC table before any skb exists,
+ * then bpf_redirect_map() the frame through a devmap holding the bridge's
+ * ports. Anything the kfuncs cannot resolve (broadcast, multicast, unknown
+ * unicast, frames for the bridge itself) is left to XDP_PASS, i.e. to the
+ * regular rx_handler path. See xdp/brnana_xdp.bpf.c for such a program.
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <net/xdp.h>
+
+#include "brnana.h"
+
+/**
+ * brnana_xdp_port - Get the brnana port an XDP frame was received on
+ * @ctx: XDP context
+ *
+ * XDP programs run inside an RCU read-side section.
+ *
+ * Return: The ingress port if it belongs to a running bridge, else NULL.
+ */
+static struct brnana_port_if *brnana_xdp_port(struct xdp_md *ctx)
+{
+    struct xdp_buff *xdp = (struct xdp_buff *) ctx;
+    struct net_device *dev = xdp->rxq->dev;
+    struct brnana_port_if *p;
+
+    if (rcu_access_pointer(dev->rx_handler) != brnana_handle_frame)
+        return NULL;
+
+    p = brnana_port_get_rcu(dev);
+    if (!p || !netif_running(p->br->dev))
+        return NULL;
+
+    return p;
+}
+
+__bpf_kfunc_start_defs();
+
+/**
+ * bpf_brnana_fdb_learn - Learn a source address seen by XDP
+ * @ctx:      XDP context of a frame received on a brnana port
+ * @addr:     The frame's source MAC address
+ * @addr__sz: Size of @addr, must be ETH_ALEN
+ *
+ * Frames redirected by XDP never reach brnana_handle_frame(), so the
+ * program must learn (and refresh) their source itself.
+ *
+ * Return:
+ *   0 on success, -EINVAL for a bad address, -ENODEV if the frame was not
+ *   received on a running brnana port, -EOPNOTSUPP with VLAN filtering
+ *   enabled (the skb path learns instead).
+ */
+__bpf_kfunc int bpf_brnana_fdb_learn(struct xdp_md *ctx,
+                                     const u8 *addr,
+                                     u32 addr__sz)
+{
+    struct brnana_port_if *p;
+
+    if (addr__sz != ETH_ALEN || !is_valid_ether_addr(addr))
+        return -EINVAL;
+
+    p = brnana_xdp_port(ctx);
+    if (!p)
+        return -ENODEV;
+
+    /**
+     * With VLAN filtering, the VLAN of a frame depends on the port's PVID
+     * and tag, which only the skb path resolves.
+     */
+    if (READ_ONCE(p->br->vlan_enabled))
+        return -EOPNOTSUPP;
+
+    brnana_fdb_update(&p->br->fdb, &p->fdb, addr, 0);
+    return 0;
+}
+
+/**
+ * bpf_brnana_fdb_lookup - Find the egress port of a destination address
+ * @ctx:      XDP context of a frame received on a brnana port
+ * @addr:     The frame's destination MAC address
+ * @addr__sz: Size of @addr, must be ETH_ALEN
+ *
+ * Nothing is counted yet: the redirect may still fall back to XDP_PASS,
+ * and the skb path then counts the frame. See bpf_brnana_fdb_forwarded().
+ *
+ * Return:
+ *   The ifindex of the port @addr was learned on, to be used as devmap key.
+ *   0 if the frame must take the skb path instead (multicast, unknown,
+ *   addressed to the bridge, behind the ingress port, egress port down or
+ *   VLAN filtering enabled).
+ *   -EINVAL for a bad size, -ENODEV if the frame was not received on a
+ *   running brnana port.
+ */
+__bpf_kfunc int bpf_brnana_fdb_lookup(struct xdp_md *ctx,
+                                      const u8 *addr,
+                                      u32 addr__sz)
+{
+    struct brnana_fdb_entry *f;
+    struct brnana_port_if *p, *to;
+
+    if (addr__sz != ETH_ALEN)
+        return -EINVAL;
+
+    p = brnana_xdp_port(ctx);
+    if (!p)
+        return -ENODEV;
+
+    if (is_multicast_ether_addr(addr) ||
+        ether_addr_equal(addr, p->br->dev->dev_addr) ||
+        READ_ONCE(p->br->vlan_enabled))
+        return 0;
+
+    f = brnana_fdb_find_rcu(&p->br->fdb, addr, 0);
+    if (!f)
+        return 0;
+
+    to = brnana_fdb_port(READ_ONCE(f->dst));
+    if (to == p || !brnana_port_can_xmit(to))
+        return 0;
+
+    return to->dev->ifindex;
+}
+
+/**
+ * bpf_brnana_fdb_forwarded - Count a frame redirected to a bridge port
+ * @ctx:     XDP context of a frame received on a brnana port
+ * @ifindex: The egress port, as returned by bpf_brnana_fdb_lookup()
+ *
+ * To be called once bpf_redirect_map() returned XDP_REDIRECT, so frames
+ * falling back to XDP_PASS are only counted by the skb path. The frame is
+ * counted as received and forwarded on the ingress port and as forwarded
+ * on the bridge, like there; its transmission is counted by the egress
+ * device. Egress devices that cannot transmit XDP frames would drop it.
+ *
+ * Return:
+ *   0 if the frame was counted, -ENODEV if it was not received on a
+ *   running brnana port, -EINVAL if @ifindex is not another port of the
+ *   same bridge, -EOPNOTSUPP if that port cannot take XDP frames.
+ */
+__bpf_kfunc int bpf_brnana_fdb_forwarded(struct xdp_md *ctx, u32 ifindex)
+{
+    struct xdp_buff *xdp = (struct xdp_buff *) ctx;
+    struct brnana_port_if *p, *to;
+    struct net_device *dev;
+
+    p = brnana_xdp_port(ctx);
+    if (!p)
+        return -ENODEV;
+
+    dev = dev_get_by_index_rcu(dev_net(p->dev), ifindex);
+    if (!dev || rcu_access_pointer(dev->rx_handler) != brnana_handle_frame)
+        return -EINVAL;
+
+    to = brnana_port_get_rcu(dev);
+    if (!to || to == p || to->br != p->br)
+        return -EINVAL;
+
+    if (!(READ_ONCE(dev->xdp_features) & NETDEV_XDP_ACT_NDO_XMIT))
+        return -EOPNOTSUPP;
+
+    brnana_stats_pkt(p->stats, BRNANA_STAT_RX_PACKETS,
+                     xdp->data_end - xdp->data);
+    brnana_stats_add(p->stats, BRNANA_STAT_FORWARD, 1);
+    brnana_stats_add(p->br->stats, BRNANA_STAT_FORWARD, 1);
+    return 0;
+}
+
+__bpf_kfunc_end_defs();
+
+BTF_SET8_START(brnana_xdp_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_brnana_fdb_learn)
+BTF_ID_FLAGS(func, bpf_brnana_fdb_lookup)
+BTF_ID_FLAGS(func, bpf_brnana_fdb_forwarded)
+BTF_SET8_END(brnana_xdp_kfunc_ids)
+
+/**
+ * brnana_xdp_kfunc_set - kfuncs exposed to XDP programs
+ */
+static const struct btf_kfunc_id_set brnana_xdp_kfunc_set = {
+    .owner = THIS_MODULE,
+    .set = &brnana_xdp_kfunc_ids,
+};
+
+/**
+ * brnana_xdp_init - Register the brnana kfuncs for XDP programs
+ *
+ * Requires module BTF (CONFIG_DEBUG_INFO_BTF_MODULES). Without it the
+ * bridge works as usual, only the XDP fast path is unavailable.
+ */
+void brnana_xdp_init(void)
+{
+    int err = register_btf_kfunc_id_set(BPF_PROG_TYPE_XDP,
+                                        &brnana_xdp_kfunc_set);
+    if (err)
+        pr_warn("C( o . o ) ╯ brnana: XDP kfuncs unavailable: %d\n", err);
+}
@@ -0,0 +1,299 @@
+/**
+ * @file brnana_fdb_bench.c
+ * @brief Lookup/learn throughput of the forwarding core under contention
+ *
+ * Threads hammer one table the way the receive path of as many CPUs would:
+ * each operation either learns a source address (brnana_fdb_update()) or
+ * resolves a destination (__brnana_fdb_dst_rcu(), or the bare hash walk
+ * with -f). A share of the learns can come from hosts moving to another
+ * port, or from never seen addresses, which take the locked slow path and
+ * evict. Hosts have consecutive addresses, which spread evenly over hash
+ * buckets and cache sets, or random ones with -r. One CSV line is printed
+ * per thread count:
+ *
+ *   ./brnana_fdb_bench -t 1,2,4,8 -n 4096 -l 50 -c 100
+ *
+ * Threads are not pinned; use taskset(1) for stable numbers.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "brnana_fdb_host.h"
+
+/** Operations between two checks of the stop flag and quiescent states */
+#define BENCH_BATCH 64
+
+/**
+ * struct bench_opts - What the benchmark runs
+ * @hosts:    Known addresses, learned before the clock starts
+ * @ports:    Ports the hosts are spread over
+ * @duration: Seconds per thread count
+ * @learn:    Percentage of operations that learn rather than look up
+ * @churn:    Learns of a never seen address, per million operations
+ * @move:     Learns of a known host on another port, per million operations
+ * @nocache:  Look up in the hash table, bypassing the per-CPU cache
+ * @random:   Give the hosts random addresses
+ */
+struct bench_opts {
+    unsigned int hosts;
+    unsigned int ports;
+    unsigned int duration;
+    unsigned int learn;
+    unsigned int churn;
+    unsigned int move;
+    bool nocache;
+    bool random;
+};
+
+/**
+ * struct bench_thread - One worker
+ * @thread: The pthread
+ * @id:     Index of the worker, seeds its generator
+ * @ops:    Operations done
+ * @hits:   Lookups answered by the cache
+ * @lookups: Lookups done
+ */
+struct bench_thread {
+    pthread_t thread;
+    unsigned int id;
+    u64 ops;
+    u64 hits;
+    u64 lookups;
+} ____cacheline_aligned_in_smp;
+
+static struct bench_opts opts = {
+    .hosts = 4096,
+    .ports = 8,
+    .duration = 2,
+    .learn = 50,
+};
+
+static struct brnana_fdb *fdb;
+static struct brnana_fdb_port *ports;
+static unsigned char (*macs)[ETH_ALEN];
+static int stop;
+
+/**
+ * bench_rand - xorshift64*, one state per thread
+ * @state: The state, never 0
+ *
+ * Return: 64 pseudo-random bits.
+ */
+static inline u64 bench_rand(u64 *state)
+{
+    u64 x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * bench_mac - Build the locally administered address of host @i
+ * @mac: Output
+ * @i:   The host
+ */
+static void bench_mac(unsigned char *mac, u64 i)
+{
+    mac[0] = 0x02;
+    mac[1] = (u8) (i >> 32);
+    mac[2] = (u8) (i >> 24);
+    mac[3] = (u8) (i >> 16);
+    mac[4] = (u8) (i >> 8);
+    mac[5] = (u8) i;
+}
+
+static void *bench_worker(void *arg)
+{
+    struct bench_thread *t = arg;
+    u64 state = 0x9E3779B97F4A7C15ULL * (t->id + 1);
+    u64 ops = 0, hits = 0, lookups = 0;
+    unsigned char fresh[ETH_ALEN];
+    struct brnana_fdb_port *dst;
+    unsigned int host, port;
+    u64 r;
+    bool hit;
+
+    brnana_user_thread_init();
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        for (int i = 0; i < BENCH_BATCH; ++i) {
+            r = bench_rand(&state);
+            host = (r >> 32) % opts.hosts;
+
+            if ((r & 0xffff) % 100 >= opts.learn) {
+                ++lookups;
+                if (opts.nocache) {
+                    hit = false;
+                    rcu_read_lock();
+                    brnana_fdb_find_rcu(fdb, macs[host], 0);
+                    rcu_read_unlock();
+                } else {
+                    dst = __brnana_fdb_dst_rcu(fdb, macs[host], 0, &hit);
+                    (void) dst;
+                }
+                hits += hit;
+                continue;
+            }
+
+            r = (r >> 16 & 0xffff) * 1000000 >> 16;
+            port = host % opts.ports;
+            if (r < opts.churn) {
+                bench_mac(fresh, opts.hosts + (bench_rand(&state) >> 24));
+                brnana_fdb_update(fdb, &ports[port], fresh, 0);
+                continue;
+            }
+            if (r < opts.churn + opts.move)
+                port = (port + 1) % opts.ports;
+            brnana_fdb_update(fdb, &ports[port], macs[host], 0);
+        }
+        ops += BENCH_BATCH;
+        brnana_user_quiescent();
+    }
+
+    t->ops = ops;
+    t->hits = hits;
+    t->lookups = lookups;
+
+    brnana_user_thread_exit();
+    return NULL;
+}
+
+/**
+ * bench_run - Measure one thread count and print its CSV line
+ * @nthreads: Number of workers
+ *
+ * Return: 0, or -1 on error.
+ */
+static int bench_run(unsigned int nthreads)
+{
+    u64 ops = 0, hits = 0, lookups = 0;
+    struct bench_thread *threads;
+    struct timespec start, end;
+    unsigned int n_learned;
+    double secs;
+
+    brnana_user_thread_init();
+
+    fdb = brnana_user_fdb_create();
+    if (!fdb)
+        return -1;
+    for (unsigned int i = 0; i < opts.ports; ++i)
+        brnana_fdb_port_init(&ports[i]);
+    if (opts.hosts > fdb->max_learned)
+        brnana_fdb_set_max_learned(fdb, opts.hosts, 0);
+    for (unsigned int i = 0; i < opts.hosts; ++i)
+        brnana_fdb_update(fdb, &ports[i % opts.ports], macs[i], 0);
+    brnana_user_fdb_moves = 0;
+
+    /* An idle registered thread would hold grace periods back */
+    brnana_user_thread_exit();
+
+    threads = aligned_alloc(64, nthreads * sizeof(*threads));
+    if (!threads)
+        return -1;
+    memset(threads, 0, nthreads * sizeof(*threads));
+
+    stop = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        threads[i].id = i;
+        if (pthread_create(&threads[i].thread, NULL, bench_worker,
+                           &threads[i]))
+            return -1;
+    }
+
+    sleep(opts.duration);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        ops += threads[i].ops;
+        hits += threads[i].hits;
+        lookups += threads[i].lookups;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    brnana_user_thread_init();
+    n_learned = fdb->n_learned;
+    brnana_user_fdb_destroy(fdb);
+    brnana_user_thread_exit();
+    free(threads);
+
+    printf("%u,%u,%u,%u,%u,%u,%d,%llu,%.2f,%.2f,%.3f,%lu,%u\n", nthreads,
+           opts.hosts, opts.ports, opts.learn, opts.churn, opts.move,
+           !opts.nocache, (unsigned long long) ops, ops / secs / 1e6,
+           secs * 1e9 * nthreads / (ops ? ops : 1),
+           lookups ? (double) hits / lookups : 0.0, brnana_user_fdb_moves,
+           n_learned);
+    fflush(stdout);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t threads,...] [-n hosts] [-p ports] [-d seconds]\n"
+            "          [-l learn%%] [-c churn ppm] [-m move ppm] [-f] [-r]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *threads = "1,2,4";
+    u64 state = 0x2545F4914F6CDD1DULL;
+    char *list, *tok, *save;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:n:p:d:l:c:m:frh")) != -1) {
+        switch (c) {
+        case 't': threads = optarg; break;
+        case 'n': opts.hosts = strtoul(optarg, NULL, 0); break;
+        case 'p': opts.ports = strtoul(optarg, NULL, 0); break;
+        case 'd': opts.duration = strtoul(optarg, NULL, 0); break;
+        case 'l': opts.learn = strtoul(optarg, NULL, 0); break;
+        case 'c': opts.churn = strtoul(optarg, NULL, 0); break;
+        case 'm': opts.move = strtoul(optarg, NULL, 0); break;
+        case 'f': opts.nocache = true; break;
+        case 'r': opts.random = true; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (!opts.hosts || opts.hosts > BRNANA_FDB_MAX_LIMIT || !opts.ports ||
+        !opts.duration || opts.learn > 100 ||
+        opts.churn + opts.move > 1000000)
+        usage(argv[0]);
+
+    ports = calloc(opts.ports, sizeof(*ports));
+    macs = calloc(opts.hosts, sizeof(*macs));
+    if (!ports || !macs)
+        return 1;
+    for (unsigned int i = 0; i < opts.hosts; ++i)
+        bench_mac(macs[i], opts.random ? bench_rand(&state) >> 24 : i);
+
+    printf("threads,hosts,ports,learn_pct,churn_ppm,move_ppm,fcache,ops,"
+           "mops,ns_per_op,fcache_hit_rate,moves,n_learned\n");
+
+    list = strdup(threads);
+    for (tok = strtok_r(list, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        c = atoi(tok);
+        if (c <= 0 || c >= BRNANA_USER_NR_CPUS)
+            usage(argv[0]);
+        if (bench_run(c))
+            return 1;
+    }
+
+    free(list);
+    free(macs);
+    free(ports);
+    return 0;
+}
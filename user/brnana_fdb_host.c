@@ -0,0 +1,69 @@
+/**
+ * @file brnana_fdb_host.c
+ * @brief Hooks of the forwarding core, as brnana_fdb.c provides in the kernel
+ *
+ * Entries are cache line aligned like the module's slab objects, so the
+ * userspace numbers see the same false sharing, or lack thereof.
+ */
+#include <stdlib.h>
+
+#include "brnana_fdb_host.h"
+
+/** Size of an entry, rounded up to whole cache lines */
+#define BRNANA_USER_FDB_ENTRY_SIZE \
+    ((sizeof(struct brnana_fdb_entry) + 63) & ~(size_t) 63)
+
+unsigned long brnana_user_fdb_moves;
+
+struct brnana_fdb_entry *brnana_fdb_host_alloc(gfp_t gfp)
+{
+    return aligned_alloc(64, BRNANA_USER_FDB_ENTRY_SIZE);
+}
+
+static void brnana_user_fdb_free_rcu(struct rcu_head *head)
+{
+    free(container_of(head, struct brnana_fdb_entry, rcu));
+}
+
+void brnana_fdb_host_free(struct brnana_fdb_entry *f)
+{
+    call_rcu(&f->rcu, brnana_user_fdb_free_rcu);
+}
+
+void brnana_fdb_host_moved(struct brnana_fdb *fdb,
+                           const struct brnana_fdb_entry *f,
+                           struct brnana_fdb_port *to)
+{
+    __atomic_fetch_add(&brnana_user_fdb_moves, 1, __ATOMIC_RELAXED);
+}
+
+struct brnana_fdb *brnana_user_fdb_create(void)
+{
+    size_t size = (sizeof(struct brnana_fdb) + 63) & ~(size_t) 63;
+    struct brnana_fdb *fdb = aligned_alloc(64, size);
+
+    if (!fdb)
+        return NULL;
+
+    if (brnana_fdb_core_init(fdb)) {
+        free(fdb);
+        return NULL;
+    }
+    fdb->fcache = alloc_percpu(struct brnana_fcache);
+    if (!fdb->fcache) {
+        brnana_fdb_core_destroy(fdb);
+        free(fdb);
+        return NULL;
+    }
+
+    return fdb;
+}
+
+void brnana_user_fdb_destroy(struct brnana_fdb *fdb)
+{
+    brnana_fdb_sweep(fdb, NULL, -1, true, true);
+    rcu_barrier();
+    brnana_fdb_core_destroy(fdb);
+    free_percpu(fdb->fcache);
+    free(fdb);
+}
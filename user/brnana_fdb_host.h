@@ -0,0 +1,31 @@
+/**
+ * @file brnana_fdb_host.h
+ * @brief Userspace host of the forwarding core: tables and their entries
+ *
+ * Programs under user/ include this instead of brnana_core.h directly.
+ * Every thread touching a table must call brnana_user_thread_init() first
+ * and brnana_user_quiescent() between operations, see brnana_shim.h.
+ */
+
+#ifndef _BRNANA_FDB_HOST_H
+#define _BRNANA_FDB_HOST_H
+
+#include "brnana_core.h"
+
+/** Moves reported by the core through brnana_fdb_host_moved() */
+extern unsigned long brnana_user_fdb_moves;
+
+/**
+ * brnana_user_fdb_create - Allocate and initialize a table
+ *
+ * Return: The table, or NULL.
+ */
+struct brnana_fdb *brnana_user_fdb_create(void);
+
+/**
+ * brnana_user_fdb_destroy - Free a table and all its entries
+ * @fdb: The table, which no other thread may still use
+ */
+void brnana_user_fdb_destroy(struct brnana_fdb *fdb);
+
+#endif /* _BRNANA_FDB_HOST_H */
@@ -0,0 +1,298 @@
+/**
+ * @file brnana_fuzz_frame.c
+ * @brief Fuzz target: received frames through the forwarding core
+ *
+ * Each input is an Ethernet frame as a port would receive it. The harness
+ * does what the receive path does with it, through the same core helpers:
+ * classifies the outer tag for VLAN filtering, learns the source address
+ * on a port picked from the address, extracts ARP and NS/NA fields and the
+ * DSCP, decides where the frame goes, resolves unicast destinations and
+ * walks the group records of IGMPv3 and MLDv2 reports with
+ * brnana_grec_next(). The table is shared by all inputs and kept small, so
+ * eviction, moves and ageing run too.
+ *
+ * Built with clang's -fsanitize=fuzzer,address it is a libFuzzer target;
+ * with -DBRNANA_FUZZ_MAIN it replays the files given on the command line,
+ * e.g. a corpus or a crash, under any compiler.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "brnana_fdb_host.h"
+
+/** Ports the learned addresses are spread over */
+#define FUZZ_PORTS 4
+
+/** Learning bounds, small enough for every input to evict */
+#define FUZZ_MAX_LEARNED 64
+#define FUZZ_PORT_MAX_LEARNED 32
+
+/** VLAN of untagged frames, VLAN filtering being on */
+#define FUZZ_PVID 1
+
+/** Protocols the harness looks into beyond the core's */
+#define FUZZ_IPPROTO_IGMP 2
+#define FUZZ_NEXTHDR_HOP 0
+#define FUZZ_IGMPV3_REPORT 0x22
+#define FUZZ_MLD2_REPORT 143
+
+/** The bridge device's address */
+static const u8 fuzz_local[ETH_ALEN] = { 0x02, 0, 0, 0, 0, 0x01 };
+
+static struct brnana_fdb *fdb;
+static struct brnana_fdb_port ports[FUZZ_PORTS];
+
+/**
+ * fuzz_setup - Create the table shared by all inputs
+ */
+static void fuzz_setup(void)
+{
+    brnana_user_thread_init();
+
+    fdb = brnana_user_fdb_create();
+    if (!fdb)
+        abort();
+    for (int i = 0; i < FUZZ_PORTS; ++i)
+        brnana_fdb_port_init(&ports[i]);
+    brnana_fdb_set_max_learned(fdb, FUZZ_MAX_LEARNED, FUZZ_PORT_MAX_LEARNED);
+    fdb->ageing_time = 1;
+}
+
+/**
+ * fuzz_records - Walk the group records of a report
+ * @recs:      The records
+ * @len:       Bytes from @recs to the end of the packet
+ * @ngrec:     Number of records the report claims
+ * @group_len: 4 for IGMPv3, 16 for MLDv2
+ */
+static void fuzz_records(const u8 *recs,
+                         size_t len,
+                         unsigned int ngrec,
+                         size_t group_len)
+{
+    struct brnana_grec rec;
+    u8 group[16];
+    size_t off = 0;
+
+    for (unsigned int i = 0; i < ngrec; ++i) {
+        if (!brnana_grec_next(recs, len, &off, group_len, &rec))
+            break;
+
+        /* Every record returned lies within the packet */
+        if (off > len || (const u8 *) rec.group < recs ||
+            (const u8 *) rec.group + group_len > recs + off)
+            abort();
+        memcpy(group, rec.group, group_len);
+    }
+}
+
+/**
+ * fuzz_ip4 - Look for an IGMPv3 report in an IPv4 packet
+ * @d:   The IPv4 header
+ * @len: Bytes up to the end of the frame
+ */
+static void fuzz_ip4(const u8 *d, size_t len)
+{
+    size_t ihl, tot;
+
+    if (len < 20 || d[0] >> 4 != 4)
+        return;
+    ihl = (d[0] & 0xf) * 4;
+    tot = get_unaligned_be16(d + 2);
+    if (ihl < 20 || tot < ihl || tot > len)
+        return;
+    if (d[9] != FUZZ_IPPROTO_IGMP)
+        return;
+
+    d += ihl;
+    len = tot - ihl;
+    if (len < 8 || d[0] != FUZZ_IGMPV3_REPORT)
+        return;
+
+    fuzz_records(d + 8, len - 8, get_unaligned_be16(d + 6), 4);
+}
+
+/**
+ * fuzz_ip6 - Look for an MLDv2 report in an IPv6 packet
+ * @d:   The IPv6 header
+ * @len: Bytes up to the end of the frame
+ */
+static void fuzz_ip6(const u8 *d, size_t len)
+{
+    size_t payload, hlen;
+    u8 nexthdr;
+
+    if (len < 40 || d[0] >> 4 != 6)
+        return;
+    payload = get_unaligned_be16(d + 4);
+    nexthdr = d[6];
+    if (payload > len - 40)
+        return;
+
+    d += 40;
+    len = payload;
+
+    /* Reports carry a router alert in a hop-by-hop options header */
+    if (nexthdr == FUZZ_NEXTHDR_HOP) {
+        if (len < 8)
+            return;
+        hlen = (d[1] + 1) * 8;
+        if (hlen > len)
+            return;
+        nexthdr = d[0];
+        d += hlen;
+        len -= hlen;
+    }
+    if (nexthdr != IPPROTO_ICMPV6 || len < 8 || d[0] != FUZZ_MLD2_REPORT)
+        return;
+
+    fuzz_records(d + 8, len - 8, get_unaligned_be16(d + 6), 16);
+}
+
+/**
+ * fuzz_within - Check that a field returned by a parser lies in the input
+ * @field: The field
+ * @len:   Its length
+ * @data:  The input
+ * @size:  Its length
+ */
+static void fuzz_within(const u8 *field,
+                        size_t len,
+                        const u8 *data,
+                        size_t size)
+{
+    if (field < data || field + len > data + size)
+        abort();
+}
+
+/**
+ * fuzz_neigh - Extract the fields brnana_neigh_rcv() looks at
+ * @proto: The ethertype
+ * @d:     The network header
+ * @len:   Bytes up to the end of the frame
+ */
+static void fuzz_neigh(u16 proto, const u8 *d, size_t len)
+{
+    struct brnana_arp arp;
+    struct brnana_nd nd;
+
+    if (proto == ETH_P_ARP && brnana_arp_parse(d, len, &arp)) {
+        if (arp.op != ARPOP_REQUEST && arp.op != ARPOP_REPLY)
+            abort();
+        fuzz_within(arp.sha, ETH_ALEN, d, len);
+    } else if (proto == ETH_P_IPV6 && brnana_nd_parse(d, len, &nd)) {
+        if (nd.type != NDISC_NEIGHBOUR_SOLICITATION &&
+            nd.type != NDISC_NEIGHBOUR_ADVERTISEMENT)
+            abort();
+        fuzz_within(nd.saddr, 16, d, len);
+        fuzz_within(nd.target, 16, d, len);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+    const u8 *dest = data, *src = data + ETH_ALEN;
+    struct brnana_fdb_port *dst;
+    size_t off = 2 * ETH_ALEN;
+    u16 proto, tpid = 0, tci = 0, vid = FUZZ_PVID;
+    enum brnana_fwd fwd;
+    int dscp;
+    bool hit;
+
+    if (!fdb)
+        fuzz_setup();
+
+    if (size < off + 2)
+        return 0;
+
+    /* Receive moves the outer tag, of either kind, out of the packet */
+    proto = get_unaligned_be16(data + off);
+    off += 2;
+    if (proto == ETH_P_8021Q || proto == ETH_P_8021AD) {
+        if (size < off + 4)
+            return 0;
+        tpid = proto;
+        tci = get_unaligned_be16(data + off);
+        proto = get_unaligned_be16(data + off + 2);
+        off += 4;
+    }
+
+    switch (brnana_vlan_classify(tpid, tci)) {
+    case BRNANA_VLAN_TAGGED:
+        vid = tci & VLAN_VID_MASK;
+        break;
+    case BRNANA_VLAN_UNTAGGED:
+        /* A foreign tag goes back into the packet */
+        if (tpid) {
+            proto = tpid;
+            off -= 4;
+        }
+        break;
+    case BRNANA_VLAN_PRIO:
+        break;
+    }
+
+    /* Only a valid source is learned, as brnana_handle_frame() does */
+    if (is_valid_ether_addr(src))
+        brnana_fdb_update(fdb, &ports[src[5] % FUZZ_PORTS], src, vid);
+
+    fuzz_neigh(proto, data + off, size - off);
+
+    if (size - off >= 2) {
+        dscp = brnana_dscp(proto, data + off);
+        if (dscp < -1 || dscp > 63 ||
+            (dscp < 0) != (proto != ETH_P_IP && proto != ETH_P_IPV6))
+            abort();
+    }
+
+    fwd = brnana_fwd_classify(dest, fuzz_local);
+    switch (fwd) {
+    case BRNANA_FWD_BCAST:
+    case BRNANA_FWD_MCAST:
+        if (proto == ETH_P_IP)
+            fuzz_ip4(data + off, size - off);
+        else if (proto == ETH_P_IPV6)
+            fuzz_ip6(data + off, size - off);
+        break;
+    case BRNANA_FWD_LOCAL:
+        break;
+    case BRNANA_FWD_UNICAST:
+        dst = __brnana_fdb_dst_rcu(fdb, dest, vid, &hit);
+        if (dst && (dst < ports || dst >= ports + FUZZ_PORTS))
+            abort();
+        break;
+    }
+
+    /* Age a slice now and then, every entry is old after a jiffy */
+    if (size & 1)
+        brnana_fdb_gc_slice(fdb);
+
+    brnana_user_quiescent();
+    return 0;
+}
+
+#ifdef BRNANA_FUZZ_MAIN
+/**
+ * main - Run each file given on the command line once
+ */
+int main(int argc, char **argv)
+{
+    static u8 buf[65536];
+    size_t len;
+    FILE *f;
+
+    for (int i = 1; i < argc; ++i) {
+        f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return 1;
+        }
+        len = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,221 @@
+/**
+ * @file brnana_shim.c
+ * @brief Userspace RCU, per-CPU data and time for the forwarding core
+ *
+ * RCU follows the quiescent-state based scheme: a global epoch is bumped
+ * when a batch of callbacks starts waiting, and the batch runs once every
+ * registered thread reported a quiescent state with an epoch at least as
+ * recent. Each thread keeps its own two batches, the one waiting and the
+ * one filling up, so call_rcu() takes no lock.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include "brnana_shim.h"
+
+/**
+ * struct brnana_user_thread - Registration slot of a thread
+ * @online: The slot is in use
+ * @qs:     Epoch of the thread's last quiescent state
+ */
+struct brnana_user_thread {
+    int online;
+    u64 qs;
+} ____cacheline_aligned_in_smp;
+
+/**
+ * struct brnana_user_batch - A list of RCU callbacks
+ * @head:  First callback, NULL if empty
+ * @tail:  Where the next callback is linked
+ * @epoch: Epoch the batch waits for
+ */
+struct brnana_user_batch {
+    struct rcu_head *head;
+    struct rcu_head **tail;
+    u64 epoch;
+};
+
+static struct brnana_user_thread brnana_user_threads[BRNANA_USER_NR_CPUS];
+static u64 brnana_user_epoch = 1;
+
+/** Callbacks left behind by exited threads, run by rcu_barrier() */
+static pthread_mutex_t brnana_user_orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_head *brnana_user_orphans;
+
+__thread unsigned int brnana_user_cpu;
+static __thread struct brnana_user_batch brnana_user_wait, brnana_user_next;
+
+/**
+ * brnana_user_batch_run - Run and empty a batch
+ * @b: The batch
+ */
+static void brnana_user_batch_run(struct brnana_user_batch *b)
+{
+    struct rcu_head *head = b->head, *next;
+
+    for (; head; head = next) {
+        next = head->next;
+        head->func(head);
+    }
+    b->head = NULL;
+    b->tail = &b->head;
+}
+
+/**
+ * brnana_user_batch_orphan - Hand a batch over to rcu_barrier()
+ * @b: The batch
+ */
+static void brnana_user_batch_orphan(struct brnana_user_batch *b)
+{
+    if (!b->head)
+        return;
+
+    pthread_mutex_lock(&brnana_user_orphans_lock);
+    *b->tail = brnana_user_orphans;
+    brnana_user_orphans = b->head;
+    pthread_mutex_unlock(&brnana_user_orphans_lock);
+
+    b->head = NULL;
+    b->tail = &b->head;
+}
+
+/**
+ * brnana_user_gp_done - Check whether every thread went past an epoch
+ * @epoch: The epoch
+ *
+ * Return: true if no registered thread can still hold a reference taken
+ * before @epoch started.
+ */
+static bool brnana_user_gp_done(u64 epoch)
+{
+    for (int i = 0; i < BRNANA_USER_NR_CPUS; ++i) {
+        struct brnana_user_thread *t = &brnana_user_threads[i];
+
+        if (__atomic_load_n(&t->online, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&t->qs, __ATOMIC_ACQUIRE) < epoch)
+            return false;
+    }
+
+    return true;
+}
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+    head->func = func;
+    head->next = NULL;
+    *brnana_user_next.tail = head;
+    brnana_user_next.tail = &head->next;
+}
+
+void brnana_user_quiescent(void)
+{
+    u64 now = __atomic_load_n(&brnana_user_epoch, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&brnana_user_threads[brnana_user_cpu].qs, now,
+                     __ATOMIC_SEQ_CST);
+
+    if (brnana_user_wait.head) {
+        if (!brnana_user_gp_done(brnana_user_wait.epoch))
+            return;
+        brnana_user_batch_run(&brnana_user_wait);
+    }
+
+    if (brnana_user_next.head) {
+        brnana_user_wait = brnana_user_next;
+        brnana_user_wait.epoch =
+            __atomic_add_fetch(&brnana_user_epoch, 1, __ATOMIC_SEQ_CST);
+        brnana_user_next.head = NULL;
+        brnana_user_next.tail = &brnana_user_next.head;
+    }
+}
+
+void synchronize_rcu(void)
+{
+    u64 epoch = __atomic_add_fetch(&brnana_user_epoch, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&brnana_user_threads[brnana_user_cpu].qs, epoch,
+                     __ATOMIC_SEQ_CST);
+    while (!brnana_user_gp_done(epoch))
+        sched_yield();
+}
+
+void rcu_barrier(void)
+{
+    struct rcu_head *head, *next;
+
+    brnana_user_batch_run(&brnana_user_wait);
+    brnana_user_batch_run(&brnana_user_next);
+
+    pthread_mutex_lock(&brnana_user_orphans_lock);
+    head = brnana_user_orphans;
+    brnana_user_orphans = NULL;
+    pthread_mutex_unlock(&brnana_user_orphans_lock);
+
+    for (; head; head = next) {
+        next = head->next;
+        head->func(head);
+    }
+}
+
+void brnana_user_thread_init(void)
+{
+    int expected;
+
+    for (unsigned int i = 0; i < BRNANA_USER_NR_CPUS; ++i) {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&brnana_user_threads[i].online,
+                                        &expected, 1, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+            brnana_user_cpu = i;
+            brnana_user_wait.tail = &brnana_user_wait.head;
+            brnana_user_next.tail = &brnana_user_next.head;
+            brnana_user_quiescent();
+            return;
+        }
+    }
+
+    abort();
+}
+
+void brnana_user_thread_exit(void)
+{
+    brnana_user_batch_orphan(&brnana_user_wait);
+    brnana_user_batch_orphan(&brnana_user_next);
+    __atomic_store_n(&brnana_user_threads[brnana_user_cpu].online, 0,
+                     __ATOMIC_RELEASE);
+}
+
+void *brnana_user_alloc_percpu(size_t size)
+{
+    size_t total = (BRNANA_USER_NR_CPUS * size + 63) & ~(size_t) 63;
+    void *ptr = aligned_alloc(64, total);
+
+    if (ptr)
+        memset(ptr, 0, total);
+    return ptr;
+}
+
+void brnana_user_free_percpu(void *ptr)
+{
+    free(ptr);
+}
+
+unsigned long brnana_user_jiffies(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * HZ + ts.tv_nsec / (1000000000L / HZ);
+}
+
+u32 get_random_u32(void)
+{
+    u32 val;
+
+    if (getrandom(&val, sizeof(val), 0) != sizeof(val))
+        val = (u32) rand();
+    return val;
+}
@@ -0,0 +1,521 @@
+/**
+ * @file brnana_shim.h
+ * @brief Kernel APIs used by the forwarding core, on top of libc and pthreads
+ *
+ * Just enough of the kernel for brnana_core.h and brnana_fdb_core.c to build
+ * unchanged in userspace: types, protocol numbers, lists, a spinlock,
+ * atomics, jhash, per-CPU data and RCU. Semantics match the kernel's where
+ * the core relies on them, performance is close enough for comparing hash
+ * layouts and cache behavior, not for absolute numbers.
+ *
+ * RCU is quiescent-state based: readers are free, and each thread that
+ * reads the table reports a quiescent state between operations with
+ * brnana_user_quiescent(), as a CPU does by leaving softirq context.
+ * "CPUs" are threads that called brnana_user_thread_init().
+ */
+
+#ifndef _BRNANA_SHIM_H
+#define _BRNANA_SHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef uint16_t __be16;
+typedef uint32_t __be32;
+typedef unsigned int gfp_t;
+
+#define GFP_ATOMIC 0U
+#define GFP_KERNEL 0U
+
+#define ETH_ALEN 6
+
+/* Protocol numbers of the headers the core parses */
+
+#define ETH_P_IP 0x0800
+#define ETH_P_ARP 0x0806
+#define ETH_P_8021Q 0x8100
+#define ETH_P_IPV6 0x86dd
+#define ETH_P_8021AD 0x88a8
+#define VLAN_PRIO_MASK 0xe000
+#define VLAN_VID_MASK 0x0fff
+#define ARPHRD_ETHER 1
+#define ARPOP_REQUEST 1
+#define ARPOP_REPLY 2
+#define IPPROTO_ICMPV6 58
+#define NDISC_NEIGHBOUR_SOLICITATION 135
+#define NDISC_NEIGHBOUR_ADVERTISEMENT 136
+
+/** Ticks of the emulated jiffies, see brnana_user_jiffies() */
+#define HZ 1000
+
+#define __percpu
+#define __rcu
+#define __read_mostly
+#define ____cacheline_aligned_in_smp __attribute__((__aligned__(64)))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define BIT(nr) (1UL << (nr))
+
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+#define min_t(type, x, y) ((type) (x) < (type) (y) ? (type) (x) : (type) (y))
+#define max_t(type, x, y) ((type) (x) > (type) (y) ? (type) (x) : (type) (y))
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+
+#define static_assert(expr, ...) _Static_assert(expr, #expr)
+
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *) &(x))
+#define WRITE_ONCE(x, val)                        \
+    do {                                          \
+        *(volatile __typeof__(x) *) &(x) = (val); \
+    } while (0)
+
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() barrier()
+#endif
+
+#define time_after(a, b) ((long) ((b) - (a)) < 0)
+#define time_after_eq(a, b) ((long) ((a) - (b)) >= 0)
+
+#define lockdep_assert_held(l) ((void) (l))
+#define lockdep_is_held(l) ((void) (l), 1)
+
+static inline unsigned long rounddown_pow_of_two(unsigned long n)
+{
+    return 1UL << (sizeof(n) * 8 - 1 - __builtin_clzl(n));
+}
+
+static inline int order_base_2(unsigned long n)
+{
+    return n > 1 ? (int) (sizeof(n) * 8) - __builtin_clzl(n - 1) : 0;
+}
+
+/* Memory; there is no vmalloc fallback to choose */
+
+#define struct_size(p, member, n) \
+    (sizeof(*(p)) + sizeof(*(p)->member) * (size_t) (n))
+
+#define kvzalloc(size, gfp) calloc(1, size)
+#define kvfree(ptr) free(ptr)
+
+/* Byte order and unaligned access, little and big endian hosts alike */
+
+#define get_unaligned(ptr)                      \
+    ({                                          \
+        __typeof__(+*(ptr)) __v;                \
+        memcpy(&__v, (ptr), sizeof(*(ptr)));    \
+        __v;                                    \
+    })
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+    const u8 *b = p;
+
+    return (u16) (b[0] << 8 | b[1]);
+}
+
+/* Ethernet addresses */
+
+static inline bool ether_addr_equal(const u8 *a, const u8 *b)
+{
+    return !memcmp(a, b, ETH_ALEN);
+}
+
+static inline void ether_addr_copy(u8 *dst, const u8 *src)
+{
+    memcpy(dst, src, ETH_ALEN);
+}
+
+static inline bool is_multicast_ether_addr(const u8 *addr)
+{
+    return addr[0] & 1;
+}
+
+static inline bool is_broadcast_ether_addr(const u8 *addr)
+{
+    return (addr[0] & addr[1] & addr[2] & addr[3] & addr[4] & addr[5]) == 0xff;
+}
+
+static inline bool is_zero_ether_addr(const u8 *addr)
+{
+    return !(addr[0] | addr[1] | addr[2] | addr[3] | addr[4] | addr[5]);
+}
+
+static inline bool is_valid_ether_addr(const u8 *addr)
+{
+    return !is_multicast_ether_addr(addr) && !is_zero_ether_addr(addr);
+}
+
+/* Hashing: hash_32() and lookup3's jhash(), as in the kernel */
+
+#define GOLDEN_RATIO_32 0x61C88647U
+
+static inline u32 hash_32(u32 val, unsigned int bits)
+{
+    return (val * GOLDEN_RATIO_32) >> (32 - bits);
+}
+
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+    return (word << (shift & 31)) | (word >> ((-shift) & 31));
+}
+
+#define JHASH_INITVAL 0xdeadbeefU
+
+#define __jhash_mix(a, b, c)  \
+    {                         \
+        a -= c;               \
+        a ^= rol32(c, 4);     \
+        c += b;               \
+        b -= a;               \
+        b ^= rol32(a, 6);     \
+        a += c;               \
+        c -= b;               \
+        c ^= rol32(b, 8);     \
+        b += a;               \
+        a -= c;               \
+        a ^= rol32(c, 16);    \
+        c += b;               \
+        b -= a;               \
+        b ^= rol32(a, 19);    \
+        a += c;               \
+        c -= b;               \
+        c ^= rol32(b, 4);     \
+        b += a;               \
+    }
+
+#define __jhash_final(a, b, c) \
+    {                          \
+        c ^= b;                \
+        c -= rol32(b, 14);     \
+        a ^= c;                \
+        a -= rol32(c, 11);     \
+        b ^= a;                \
+        b -= rol32(a, 25);     \
+        c ^= b;                \
+        c -= rol32(b, 16);     \
+        a ^= c;                \
+        a -= rol32(c, 4);      \
+        b ^= a;                \
+        b -= rol32(a, 14);     \
+        c ^= b;                \
+        c -= rol32(b, 24);     \
+    }
+
+static inline u32 jhash(const void *key, u32 length, u32 initval)
+{
+    const u8 *k = key;
+    u32 a, b, c;
+
+    a = b = c = JHASH_INITVAL + length + initval;
+
+    while (length > 12) {
+        a += k[0] | (u32) k[1] << 8 | (u32) k[2] << 16 | (u32) k[3] << 24;
+        b += k[4] | (u32) k[5] << 8 | (u32) k[6] << 16 | (u32) k[7] << 24;
+        c += k[8] | (u32) k[9] << 8 | (u32) k[10] << 16 | (u32) k[11] << 24;
+        __jhash_mix(a, b, c);
+        length -= 12;
+        k += 12;
+    }
+
+    switch (length) {
+    case 12: c += (u32) k[11] << 24; /* fallthrough */
+    case 11: c += (u32) k[10] << 16; /* fallthrough */
+    case 10: c += (u32) k[9] << 8;   /* fallthrough */
+    case 9:  c += k[8];              /* fallthrough */
+    case 8:  b += (u32) k[7] << 24;  /* fallthrough */
+    case 7:  b += (u32) k[6] << 16;  /* fallthrough */
+    case 6:  b += (u32) k[5] << 8;   /* fallthrough */
+    case 5:  b += k[4];              /* fallthrough */
+    case 4:  a += (u32) k[3] << 24;  /* fallthrough */
+    case 3:  a += (u32) k[2] << 16;  /* fallthrough */
+    case 2:  a += (u32) k[1] << 8;   /* fallthrough */
+    case 1:
+        a += k[0];
+        __jhash_final(a, b, c);
+        break;
+    case 0:
+        break;
+    }
+
+    return c;
+}
+
+u32 get_random_u32(void);
+
+/* Atomics and memory ordering */
+
+typedef struct {
+    int counter;
+} atomic_t;
+
+static inline void atomic_set(atomic_t *v, int i)
+{
+    __atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_inc(atomic_t *v)
+{
+    __atomic_fetch_add(&v->counter, 1, __ATOMIC_RELAXED);
+}
+
+static inline int atomic_read_acquire(const atomic_t *v)
+{
+    return __atomic_load_n(&v->counter, __ATOMIC_ACQUIRE);
+}
+
+#define smp_mb__before_atomic() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* Spinlocks; there are no bottom halves to disable */
+
+typedef struct {
+    int locked;
+} spinlock_t;
+
+static inline void spin_lock_init(spinlock_t *l)
+{
+    l->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t *l)
+{
+    while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&l->locked, __ATOMIC_RELAXED))
+            cpu_relax();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+#define spin_lock_bh spin_lock
+#define spin_unlock_bh spin_unlock
+
+/* Doubly linked lists */
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+    new->prev = head->prev;
+    new->next = head;
+    head->prev->next = new;
+    head->prev = new;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+static inline void list_move_tail(struct list_head *list,
+                                  struct list_head *head)
+{
+    list_del(list);
+    list_add_tail(list, head);
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+    return READ_ONCE(head->next) == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member) \
+    list_entry((ptr)->next, type, member)
+
+#define list_next_entry(pos, member) \
+    list_entry((pos)->member.next, __typeof__(*(pos)), member)
+
+#define list_for_each_entry(pos, head, member)                       \
+    for (pos = list_first_entry(head, __typeof__(*pos), member);     \
+         &pos->member != (head); pos = list_next_entry(pos, member))
+
+#define list_for_each_entry_safe(pos, n, head, member)               \
+    for (pos = list_first_entry(head, __typeof__(*pos), member),     \
+        n = list_next_entry(pos, member);                            \
+         &pos->member != (head); pos = n, n = list_next_entry(n, member))
+
+/* Hash lists, with the publication order RCU readers rely on */
+
+struct hlist_head {
+    struct hlist_node *first;
+};
+
+struct hlist_node {
+    struct hlist_node *next, **pprev;
+};
+
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+
+static inline void hlist_add_head_rcu(struct hlist_node *n,
+                                      struct hlist_head *h)
+{
+    struct hlist_node *first = h->first;
+
+    n->next = first;
+    n->pprev = &h->first;
+    __atomic_store_n(&h->first, n, __ATOMIC_RELEASE);
+    if (first)
+        first->pprev = &n->next;
+}
+
+static inline void hlist_del_rcu(struct hlist_node *n)
+{
+    struct hlist_node *next = n->next;
+
+    WRITE_ONCE(*n->pprev, next);
+    if (next)
+        next->pprev = n->pprev;
+    n->pprev = NULL;
+}
+
+#define hlist_entry_safe(ptr, type, member)                  \
+    ({                                                       \
+        __typeof__(ptr) ____ptr = (ptr);                     \
+        ____ptr ? container_of(____ptr, type, member) : NULL; \
+    })
+
+#define hlist_for_each_entry(pos, head, member)                            \
+    for (pos = hlist_entry_safe((head)->first, __typeof__(*(pos)), member); \
+         pos;                                                              \
+         pos = hlist_entry_safe((pos)->member.next, __typeof__(*(pos)),    \
+                                member))
+
+#define hlist_for_each_entry_safe(pos, n, head, member)                    \
+    for (pos = hlist_entry_safe((head)->first, __typeof__(*pos), member);  \
+         pos && ({                                                         \
+             n = pos->member.next;                                         \
+             1;                                                            \
+         });                                                               \
+         pos = hlist_entry_safe(n, __typeof__(*pos), member))
+
+#define hlist_for_each_entry_rcu(pos, head, member)                         \
+    for (pos = hlist_entry_safe(                                            \
+             __atomic_load_n(&(head)->first, __ATOMIC_ACQUIRE),             \
+             __typeof__(*(pos)), member);                                   \
+         pos;                                                               \
+         pos = hlist_entry_safe(                                            \
+             __atomic_load_n(&(pos)->member.next, __ATOMIC_ACQUIRE),        \
+             __typeof__(*(pos)), member))
+
+/* RCU */
+
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+};
+
+#define rcu_read_lock() barrier()
+#define rcu_read_unlock() barrier()
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+
+/** Threads only give up the CPU between operations */
+#define cond_resched() barrier()
+
+/**
+ * call_rcu - Run @func once every registered thread went quiescent
+ * @head: Embedded in the object to free
+ * @func: Callback
+ */
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
+
+/**
+ * rcu_barrier - Run every pending callback; no reader may be left
+ */
+void rcu_barrier(void);
+
+/**
+ * synchronize_rcu - Wait until every other registered thread went quiescent
+ *
+ * The calling thread must be registered and holds no reference itself.
+ */
+void synchronize_rcu(void);
+
+/* Per-CPU data: one copy per registered thread */
+
+/** Upper bound of the threads registered at once */
+#define BRNANA_USER_NR_CPUS 256
+
+extern __thread unsigned int brnana_user_cpu;
+
+#define alloc_percpu(type) \
+    ((type *) brnana_user_alloc_percpu(sizeof(type)))
+#define free_percpu(ptr) brnana_user_free_percpu(ptr)
+#define per_cpu_ptr(ptr, cpu) (&(ptr)[cpu])
+#define this_cpu_ptr(ptr) per_cpu_ptr(ptr, brnana_user_cpu)
+
+void *brnana_user_alloc_percpu(size_t size);
+void brnana_user_free_percpu(void *ptr);
+
+/* Time */
+
+/**
+ * brnana_user_jiffies - Monotonic time in 1/HZ s, from a coarse clock
+ *
+ * Return: The current emulated jiffies.
+ */
+unsigned long brnana_user_jiffies(void);
+
+#define jiffies brnana_user_jiffies()
+
+/* Threads */
+
+/**
+ * brnana_user_thread_init - Make the calling thread a CPU
+ *
+ * Gives it its own per-CPU data and makes it an RCU reader. Must be called
+ * before the thread reads any table.
+ */
+void brnana_user_thread_init(void);
+
+/**
+ * brnana_user_thread_exit - Retire the calling thread
+ */
+void brnana_user_thread_exit(void);
+
+/**
+ * brnana_user_quiescent - Report that the thread holds no RCU reference
+ *
+ * Also runs the callbacks whose grace period has ended. Call between two
+ * operations, as often as possible.
+ */
+void brnana_user_quiescent(void);
+
+#endif /* _BRNANA_SHIM_H */
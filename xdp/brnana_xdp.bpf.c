@@ -0,0 +1,70 @@
+/**
+ * @file brnana_xdp.bpf.c
+ * @brief XDP fast path for brnana ports
+ *
+ * Attach to every port of a brnana bridge. Known unicast frames are
+ * redirected to their egress port through the brnana_ports devmap before
+ * an skb is allocated; everything else is passed to the regular brnana
+ * rx_handler, which floods, delivers locally or drops as usual.
+ *
+ * brnana_ports must hold the ifindex of every port of the bridge, keyed by
+ * that same ifindex (see brnana_xdp.sh). Ports missing from it fall back to
+ * the skb path; redirected frames are counted with
+ * bpf_brnana_fdb_forwarded().
+ */
+#include "vmlinux.h"
+
+#include <bpf/bpf_helpers.h>
+
+#define ETH_ALEN 6
+
+extern int bpf_brnana_fdb_learn(struct xdp_md *ctx,
+                                const __u8 *addr,
+                                __u32 addr__sz) __ksym;
+extern int bpf_brnana_fdb_lookup(struct xdp_md *ctx,
+                                 const __u8 *addr,
+                                 __u32 addr__sz) __ksym;
+extern int bpf_brnana_fdb_forwarded(struct xdp_md *ctx, __u32 ifindex) __ksym;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+    __uint(max_entries, 1024);
+    __type(key, __u32);
+    __type(value, struct bpf_devmap_val);
+} brnana_ports SEC(".maps");
+
+SEC("xdp")
+int brnana_xdp_fwd(struct xdp_md *ctx)
+{
+    void *data_end = (void *) (long) ctx->data_end;
+    void *data = (void *) (long) ctx->data;
+    struct ethhdr *eth = data;
+    __u8 addr[ETH_ALEN];
+    int ifindex, act;
+
+    if ((void *) (eth + 1) > data_end)
+        return XDP_PASS;
+
+    /**
+     * Replication and local delivery stay on the skb path.
+     */
+    if (eth->h_dest[0] & 1)
+        return XDP_PASS;
+
+    __builtin_memcpy(addr, eth->h_source, ETH_ALEN);
+    if (bpf_brnana_fdb_learn(ctx, addr, ETH_ALEN))
+        return XDP_PASS;
+
+    __builtin_memcpy(addr, eth->h_dest, ETH_ALEN);
+    ifindex = bpf_brnana_fdb_lookup(ctx, addr, ETH_ALEN);
+    if (ifindex <= 0)
+        return XDP_PASS;
+
+    act = bpf_redirect_map(&brnana_ports, ifindex, XDP_PASS);
+    if (act == XDP_REDIRECT)
+        bpf_brnana_fdb_forwarded(ctx, ifindex);
+
+    return act;
+}
+
+char _license[] SEC("license") = "Dual MIT/GPL";
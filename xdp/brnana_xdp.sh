@@ -0,0 +1,41 @@
+#!/bin/sh
+# Attach (or detach) the brnana XDP fast path on every port of a bridge.
+#
+#   brnana_xdp.sh attach brnana0
+#   brnana_xdp.sh detach brnana0
+#
+# Ports enslaved after attaching need another `attach`.
+set -e
+
+PIN=/sys/fs/bpf/brnana
+BR=${2:-brnana0}
+OBJ=$(dirname "$0")/brnana_xdp.bpf.o
+
+ports() {
+    ip -o link show master "$BR" | awk -F': ' '{ sub(/@.*/, "", $2); print $2 }'
+}
+
+case "$1" in
+attach)
+    if [ ! -e "$PIN/prog" ]; then
+        mkdir -p "$PIN"
+        bpftool prog load "$OBJ" "$PIN/prog" type xdp pinmaps "$PIN"
+    fi
+    for port in $(ports); do
+        ifindex=$(cat /sys/class/net/"$port"/ifindex)
+        key=$(printf '%08x' "$ifindex" | sed 's/\(..\)\(..\)\(..\)\(..\)/0x\4 0x\3 0x\2 0x\1/')
+        bpftool map update pinned "$PIN/brnana_ports" key $key value $key 0 0 0 0
+        ip link set dev "$port" xdp pinned "$PIN/prog"
+    done
+    ;;
+detach)
+    for port in $(ports); do
+        ip link set dev "$port" xdp off
+    done
+    rm -rf "$PIN"
+    ;;
+*)
+    echo "usage: $0 attach|detach [bridge]" >&2
+    exit 1
+    ;;
+esac